@@ -73,8 +73,10 @@ void setup() {
         WaterMeterData data = waterMeter->getData();
         String output;
         output += "Water Meter Status:\n";
-        output += "  Total: " + String(data.totalM3, 3) + " m³\n";
-        output += "  Daily: " + String(data.dailyLiters) + " L\n";
+        char m3[24];
+        waterMeterFormatM3(m3, sizeof(m3), data.totalMl);
+        output += "  Total: " + String(m3) + " m³\n";
+        output += "  Daily: " + String(data.dailyLiters()) + " L\n";
         output += "  Pulses: " + String((unsigned long)data.pulseCount) + "\n";
         return output;
     });
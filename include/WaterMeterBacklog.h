@@ -0,0 +1,234 @@
+#ifndef WATER_METER_BACKLOG_H
+#define WATER_METER_BACKLOG_H
+
+#include <Arduino.h>
+#include <DomoticsCore/Storage.h>
+#include <stddef.h>
+#include <string.h>
+#include "WaterMeterConfig.h"
+#include "WaterMeterPersistence.h"
+
+/**
+ * @brief One buffered reading of one meter (24 bytes)
+ */
+struct __attribute__((packed)) BacklogReading {
+    static constexpr uint8_t FLAG_EPOCH = 0x01;  // time is UTC epoch seconds (else uptime seconds)
+
+    uint32_t time;
+    uint8_t channel;
+    uint8_t flags;
+    uint16_t flowCentiLpm;  // Flow rate in 0.01 L/min
+    uint64_t totalMl;
+    uint64_t dailyMl;
+};
+
+/**
+ * @brief Flash spill unit: READINGS readings in one storage blob
+ */
+struct __attribute__((packed)) BacklogChunk {
+    static constexpr uint8_t READINGS = 16;
+
+    uint32_t magic;
+    uint32_t seq;       // Write order, slot = seq % WATER_METER_BACKLOG_SLOTS
+    uint32_t bootId;    // Boot that wrote it (uptime timestamps only make sense in that boot)
+    uint8_t count;
+    uint8_t reserved[3];
+    BacklogReading readings[READINGS];
+    uint32_t crc;       // Over everything above
+};
+
+/**
+ * @brief Store-and-forward buffer for readings taken while MQTT is down
+ *
+ * Readings go into a RAM ring of WATER_METER_BACKLOG_READINGS. When it is
+ * full, its oldest BacklogChunk::READINGS readings are written as one blob
+ * to WATER_METER_BACKLOG_SLOTS rotating storage keys ("wm_bl0".."wm_blN");
+ * when those are full too, the oldest chunk is overwritten and its readings
+ * counted as dropped. Chunks survive reboots and are picked up by attach().
+ *
+ * peek()/pop() hand out readings oldest first (flash chunks, then RAM),
+ * never across a chunk/RAM boundary, so the caller can publish a batch and
+ * only pop it once the publish succeeded. Everything runs in loop().
+ */
+class BacklogStore {
+public:
+    static constexpr uint32_t MAGIC = 0x4C42571A;
+    static constexpr uint8_t CHUNK = BacklogChunk::READINGS;
+    static constexpr uint16_t RAM_READINGS = WATER_METER_BACKLOG_READINGS;
+    static_assert(RAM_READINGS >= CHUNK, "WATER_METER_BACKLOG_READINGS must hold at least one chunk");
+
+    struct Stats {
+        uint32_t buffered = 0;     // Readings pushed
+        uint32_t forwarded = 0;    // Readings popped after a successful publish
+        uint32_t dropped = 0;      // Oldest readings lost because both RAM and flash were full
+        uint32_t spills = 0;       // Chunks written to flash
+        uint32_t spillFailures = 0;
+        uint32_t recovered = 0;    // Readings found in flash at attach()
+    };
+
+    /**
+     * @brief Storage (nullptr = RAM only) and this boot's id; scans for chunks left by earlier boots
+     */
+    void attach(DomoticsCore::Components::StorageComponent* s, uint32_t currentBootId) {
+        storage = s;
+        bootId = currentBootId;
+        if (!storage) return;
+        bool found = false;
+        for (uint8_t slot = 0; slot < WATER_METER_BACKLOG_SLOTS; slot++) {
+            BacklogChunk c;
+            if (!readSlot(slot, c)) continue;
+            if (!found || (int32_t)(c.seq - headSeq) < 0) headSeq = c.seq;
+            if (!found || (int32_t)(c.seq + 1 - tailSeq) > 0) tailSeq = c.seq + 1;
+            found = true;
+            stats.recovered += c.count;
+        }
+        if (!found) headSeq = tailSeq = 0;
+        if (tailSeq - headSeq > WATER_METER_BACKLOG_SLOTS) headSeq = tailSeq - WATER_METER_BACKLOG_SLOTS;
+    }
+
+    void push(const BacklogReading& r) {
+        if (ramCount == RAM_READINGS) {
+            if (!spill()) {
+                ramHead = (ramHead + 1) % RAM_READINGS;  // RAM only: lose the oldest
+                ramCount--;
+                stats.dropped++;
+            }
+        }
+        ram[(ramHead + ramCount) % RAM_READINGS] = r;
+        ramCount++;
+        stats.buffered++;
+    }
+
+    bool empty() const { return ramCount == 0 && chunks() == 0; }
+
+    /** @brief Readings waiting (flash chunks counted as full) */
+    uint32_t size() const {
+        return ramCount + (uint32_t)chunks() * CHUNK - (loaded ? loadedPos : 0);
+    }
+
+    /**
+     * @brief Copy up to max oldest readings without removing them
+     * @param sameBoot false when they come from a chunk written before this boot
+     */
+    uint8_t peek(BacklogReading* out, uint8_t max, bool& sameBoot) {
+        while (chunks() > 0) {
+            if (!loaded && !loadHead()) continue;  // Unreadable chunk skipped by loadHead()
+            uint8_t n = 0;
+            while (n < max && loadedPos + n < current.count) {
+                out[n] = current.readings[loadedPos + n];
+                n++;
+            }
+            sameBoot = current.bootId == bootId;
+            return n;
+        }
+        uint8_t n = 0;
+        while (n < max && n < ramCount) {
+            out[n] = ram[(ramHead + n) % RAM_READINGS];
+            n++;
+        }
+        sameBoot = true;
+        return n;
+    }
+
+    /** @brief Remove the n readings returned by the last peek() */
+    void pop(uint8_t n) {
+        stats.forwarded += n;
+        if (loaded) {
+            loadedPos += n;
+            if (loadedPos >= current.count) dropHead();
+            return;
+        }
+        if (n > ramCount) n = ramCount;
+        ramHead = (ramHead + n) % RAM_READINGS;
+        ramCount -= n;
+    }
+
+    /**
+     * @brief UTC epoch for a reading if known (uptime readings of this boot + synced clock)
+     * @return 0 when only the uptime is known
+     */
+    static uint32_t epochOf(const BacklogReading& r, bool sameBoot, uint32_t nowEpoch, uint32_t nowUptimeS) {
+        if (r.flags & BacklogReading::FLAG_EPOCH) return r.time;
+        if (!sameBoot || nowEpoch == 0 || r.time > nowUptimeS) return 0;
+        return nowEpoch - (nowUptimeS - r.time);
+    }
+
+    const Stats& getStats() const { return stats; }
+
+private:
+    uint8_t chunks() const { return (uint8_t)(tailSeq - headSeq); }
+
+    String slotKey(uint8_t slot) const {
+        char key[12];
+        snprintf(key, sizeof(key), "wm_bl%u", (unsigned)slot);
+        return String(key);
+    }
+
+    static uint32_t chunkCrc(const BacklogChunk& c) {
+        return CounterStore::crc32(reinterpret_cast<const uint8_t*>(&c), offsetof(BacklogChunk, crc));
+    }
+
+    bool readSlot(uint8_t slot, BacklogChunk& c) const {
+        if (storage->getBlob(slotKey(slot), reinterpret_cast<uint8_t*>(&c), sizeof(c)) != sizeof(c)) return false;
+        return c.magic == MAGIC && c.crc == chunkCrc(c) && c.count <= CHUNK && c.seq % WATER_METER_BACKLOG_SLOTS == slot;
+    }
+
+    /** @brief Oldest RAM readings -> one flash chunk (oldest chunk overwritten when all slots are used) */
+    bool spill() {
+        if (!storage) return false;
+        if (chunks() == WATER_METER_BACKLOG_SLOTS) {
+            // Count what the overwritten chunk still held
+            stats.dropped += loaded ? current.count - loadedPos : CHUNK;
+            dropHead();
+        }
+        BacklogChunk c = {};
+        c.magic = MAGIC;
+        c.seq = tailSeq;
+        c.bootId = bootId;
+        c.count = CHUNK;
+        for (uint8_t i = 0; i < CHUNK; i++) {
+            c.readings[i] = ram[(ramHead + i) % RAM_READINGS];
+        }
+        c.crc = chunkCrc(c);
+        if (!storage->putBlob(slotKey(c.seq % WATER_METER_BACKLOG_SLOTS), reinterpret_cast<const uint8_t*>(&c), sizeof(c))) {
+            stats.spillFailures++;
+            return false;
+        }
+        tailSeq++;
+        ramHead = (ramHead + CHUNK) % RAM_READINGS;
+        ramCount -= CHUNK;
+        stats.spills++;
+        return true;
+    }
+
+    bool loadHead() {
+        if (readSlot(headSeq % WATER_METER_BACKLOG_SLOTS, current) && current.seq == headSeq) {
+            loaded = true;
+            loadedPos = 0;
+            return true;
+        }
+        dropHead();  // Torn or missing: nothing to replay from it
+        return false;
+    }
+
+    void dropHead() {
+        storage->remove(slotKey(headSeq % WATER_METER_BACKLOG_SLOTS));
+        headSeq++;
+        loaded = false;
+        loadedPos = 0;
+    }
+
+    DomoticsCore::Components::StorageComponent* storage = nullptr;
+    uint32_t bootId = 0;
+    BacklogReading ram[RAM_READINGS];
+    uint16_t ramHead = 0;
+    uint16_t ramCount = 0;
+    uint32_t headSeq = 0;     // Oldest chunk still in flash
+    uint32_t tailSeq = 0;     // Next chunk to write
+    BacklogChunk current;     // Head chunk being replayed
+    bool loaded = false;
+    uint8_t loadedPos = 0;    // Readings of current already popped
+    Stats stats;
+};
+
+#endif // WATER_METER_BACKLOG_H
@@ -0,0 +1,205 @@
+#ifndef WATER_METER_BASELINE_H
+#define WATER_METER_BASELINE_H
+
+#include <Arduino.h>
+#include <DomoticsCore/Storage.h>
+#include <math.h>
+#include <string.h>
+#include "WaterMeterHistory.h"
+
+/**
+ * @brief Hour-of-week consumption baseline and anomaly score
+ *
+ * 168 slots (Monday 00h = 0 .. Sunday 23h = 167), each the running mean and
+ * sum of squared deviations (M2) of the liters used in that hour of the
+ * week. closeHour() is the only update: once per closed local hour, O(1)
+ * (Welford), no history is kept.
+ *
+ * The score of a closed hour is computed against its slot before the hour
+ * is folded in:
+ *
+ *   score = (liters - mean) / max(stddev, minSigmaL)
+ *
+ * 0 until the slot has minWeeks samples. The sigma floor keeps hours that
+ * are always quiet (nights) from scoring huge on a few liters.
+ *
+ * After windowWeeks samples the count stops growing and M2 decays by 1/n
+ * per update, so a slot follows roughly the last windowWeeks weeks (habits
+ * change) instead of freezing on everything ever seen.
+ *
+ * RAM: 168 x (uint8_t + 2 x float) = 1.5 KB. Persistence: one blob per
+ * weekday ("wm_w0".."wm_w6", "wmN_w0".. for channel N), only weekdays
+ * updated since the last flush are written (normally one, once an hour).
+ */
+class WeeklyBaseline {
+public:
+    static constexpr uint8_t SLOTS = 7 * 24;
+
+    struct Stats {
+        uint32_t updates = 0;    // Hours folded in since boot
+        uint32_t anomalies = 0;  // Closed hours scored at or above the threshold
+        uint32_t writes = 0;     // Weekday blobs written
+    };
+
+    /**
+     * @param windowWeeks Samples after which a slot stops growing (1-255)
+     * @param minWeeks Samples a slot needs before hours are scored
+     * @param minSigmaL Standard deviation floor (liters)
+     * @param threshold Score that flags an hour (0 = never)
+     */
+    void configure(uint8_t windowWeeks, uint8_t minWeeks, float minSigmaL, float threshold) {
+        window = windowWeeks ? windowWeeks : 1;
+        minSamples = minWeeks ? minWeeks : 1;
+        sigmaFloor = minSigmaL > 0.0f ? minSigmaL : 0.0f;
+        scoreThreshold = threshold;
+    }
+
+    /** @brief Storage + channel (0 = legacy "wm_*" keys, N = "wmN_*") */
+    void attach(DomoticsCore::Components::StorageComponent* s, uint8_t ch = 0) {
+        storage = s;
+        channel = ch;
+    }
+
+    /** @brief Slot of a local YYYYMMDDHH hour key (PeriodAccumulators) */
+    static uint8_t slotOf(uint32_t hourKey) {
+        int32_t day = ConsumptionHistory::dayNumber(hourKey / 100);
+        uint8_t weekday = (uint8_t)(((day + 3) % 7 + 7) % 7);  // 1970-01-01 was a Thursday, Monday = 0
+        return (uint8_t)(weekday * 24 + hourKey % 100);
+    }
+
+    /** @brief Hours since 1970-01-01 00h local for a YYYYMMDDHH key (consecutive hours differ by 1) */
+    static int32_t hourNumber(uint32_t hourKey) {
+        return ConsumptionHistory::dayNumber(hourKey / 100) * 24 + (int32_t)(hourKey % 100);
+    }
+
+    /** @brief Score of an hour's volume against a slot as it is now */
+    float score(uint8_t slot, float liters) const {
+        if (slot >= SLOTS || count[slot] < minSamples) return 0.0f;
+        float sigma = count[slot] > 1 ? sqrtf(m2[slot] / (float)(count[slot] - 1)) : 0.0f;
+        if (sigma < sigmaFloor) sigma = sigmaFloor;
+        return sigma > 0.0f ? (liters - mean[slot]) / sigma : 0.0f;
+    }
+
+    /**
+     * @brief Score a closed hour, then fold it into its slot
+     * @param hourKey YYYYMMDDHH of the hour that closed
+     * @return The hour's score
+     */
+    float closeHour(uint32_t hourKey, float liters) {
+        uint8_t slot = slotOf(hourKey);
+        lastScore = score(slot, liters);
+        lastMean = mean[slot];
+        lastLiters = liters;
+        lastHourKey = hourKey;
+        anomaly = scoreThreshold > 0.0f && lastScore >= scoreThreshold;
+        if (anomaly) stats.anomalies++;
+
+        uint8_t n = count[slot];
+        if (n < window) {
+            n++;
+        } else {
+            m2[slot] -= m2[slot] / (float)n;  // Full window: oldest weeks fade out
+        }
+        float delta = liters - mean[slot];
+        mean[slot] += delta / (float)n;
+        m2[slot] += delta * (liters - mean[slot]);
+        count[slot] = n;
+
+        dirty |= (uint8_t)(1 << (slot / 24));
+        stats.updates++;
+        return lastScore;
+    }
+
+    float getLastScore() const { return lastScore; }
+    float getLastMean() const { return lastMean; }      // Slot mean the last hour was scored against
+    float getLastLiters() const { return lastLiters; }
+    uint32_t getLastHourKey() const { return lastHourKey; }  // 0 = no hour closed since boot
+    bool isAnomaly() const { return anomaly; }
+
+    uint8_t samples(uint8_t slot) const { return slot < SLOTS ? count[slot] : 0; }
+    float slotMean(uint8_t slot) const { return slot < SLOTS ? mean[slot] : 0.0f; }
+    float slotSigma(uint8_t slot) const {
+        return slot < SLOTS && count[slot] > 1 ? sqrtf(m2[slot] / (float)(count[slot] - 1)) : 0.0f;
+    }
+
+    const Stats& getStats() const { return stats; }
+
+    /**
+     * @brief Write weekdays updated since the last flush
+     * @return Number of blobs written
+     */
+    uint8_t flush() {
+        if (!storage || !dirty) return 0;
+        uint8_t written = 0;
+        for (uint8_t weekday = 0; weekday < 7; weekday++) {
+            if (!(dirty & (1 << weekday))) continue;
+            DayBlob blob;
+            blob.weekday = weekday;
+            memcpy(blob.count, &count[weekday * 24], sizeof(blob.count));
+            memcpy(blob.mean, &mean[weekday * 24], sizeof(blob.mean));
+            memcpy(blob.m2, &m2[weekday * 24], sizeof(blob.m2));
+            if (storage->putBlob(key(weekday), reinterpret_cast<const uint8_t*>(&blob), sizeof(blob))) {
+                dirty &= (uint8_t)~(1 << weekday);
+                written++;
+            }
+        }
+        stats.writes += written;
+        return written;
+    }
+
+    /** @brief Restore stored weekdays (missing or foreign blobs leave those slots empty) */
+    void load() {
+        if (!storage) return;
+        for (uint8_t weekday = 0; weekday < 7; weekday++) {
+            DayBlob blob;
+            if (storage->getBlob(key(weekday), reinterpret_cast<uint8_t*>(&blob), sizeof(blob)) != sizeof(blob) ||
+                blob.weekday != weekday) {
+                continue;
+            }
+            memcpy(&count[weekday * 24], blob.count, sizeof(blob.count));
+            memcpy(&mean[weekday * 24], blob.mean, sizeof(blob.mean));
+            memcpy(&m2[weekday * 24], blob.m2, sizeof(blob.m2));
+        }
+    }
+
+private:
+    struct __attribute__((packed)) DayBlob {
+        uint8_t weekday;
+        uint8_t count[24];
+        float mean[24];
+        float m2[24];
+    };
+
+    String key(uint8_t weekday) const {
+        char buf[12];
+        if (channel == 0) {
+            snprintf(buf, sizeof(buf), "wm_w%u", (unsigned)weekday);
+        } else {
+            snprintf(buf, sizeof(buf), "wm%u_w%u", (unsigned)channel, (unsigned)weekday);
+        }
+        return String(buf);
+    }
+
+    DomoticsCore::Components::StorageComponent* storage = nullptr;
+    uint8_t channel = 0;
+
+    uint8_t count[SLOTS] = {};
+    float mean[SLOTS] = {};
+    float m2[SLOTS] = {};
+
+    uint8_t window = 8;
+    uint8_t minSamples = 3;
+    float sigmaFloor = 5.0f;
+    float scoreThreshold = 4.0f;
+
+    float lastScore = 0.0f;
+    float lastMean = 0.0f;
+    float lastLiters = 0.0f;
+    uint32_t lastHourKey = 0;
+    bool anomaly = false;
+
+    uint8_t dirty = 0;  // Bit per weekday
+    Stats stats;
+};
+
+#endif // WATER_METER_BASELINE_H
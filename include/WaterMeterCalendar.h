@@ -0,0 +1,116 @@
+#ifndef WATER_METER_CALENDAR_H
+#define WATER_METER_CALENDAR_H
+
+#include <Arduino.h>
+#include <time.h>
+#include <stdlib.h>
+
+/**
+ * @brief Deadline-based local-calendar rollover scheduler
+ *
+ * Replaces per-loop time()/localtime_r() polling. The hot path is due(),
+ * a single millis() comparison against a cached deadline. check() does the
+ * real work only when that deadline expires:
+ * - at the next local hour boundary, midnight included (computed with
+ *   mktime(), tm_isdst = -1, so 23h/25h DST days land on the real midnight), or
+ * - every RESYNC_CHECK_MS, which only calls time() to detect clock jumps
+ *   (first NTP sync, NTP corrections, manual set) and recomputes then, or
+ * - right away after invalidate() (the component calls it on "ntp/synced").
+ *
+ * The current day is kept as a YYYYMMDD key that the component persists
+ * (history cursor). The scheduler only says when to look at the clock:
+ * rollovers themselves, missed ones included, come from
+ * PeriodAccumulators::roll() on the local time at each deadline.
+ */
+class CalendarScheduler {
+public:
+    static constexpr uint32_t RESYNC_CHECK_MS = 60000;   // Jump detection cadence when synced
+    static constexpr uint32_t UNSYNCED_CHECK_MS = 5000;  // Retry cadence until time is valid
+    static constexpr time_t MIN_VALID_EPOCH = 1609459200; // 2021-01-01: anything earlier = not synced
+    static constexpr int32_t JUMP_TOLERANCE_S = 5;
+
+    /** @brief Hot-path check: true when check() must run */
+    bool due(uint32_t nowMs) const {
+        return (int32_t)(nowMs - nextCheckMs) >= 0;
+    }
+
+    /**
+     * @brief Track the local day/hour and re-arm the deadline
+     * @param now Wall clock (time(nullptr))
+     * @param nowMs millis()
+     * @param timeSourceReady NTP component active
+     */
+    void check(time_t now, uint32_t nowMs, bool timeSourceReady) {
+        if (!timeSourceReady || now < MIN_VALID_EPOCH) {
+            synced = false;
+            nextCheckMs = nowMs + UNSYNCED_CHECK_MS;
+            return;
+        }
+
+        bool jumped = false;
+        if (synced) {
+            time_t expected = refEpoch + (time_t)((nowMs - refMs) / 1000);
+            jumped = labs((long)(now - expected)) > JUMP_TOLERANCE_S;
+        }
+        refEpoch = now;
+        refMs = nowMs;
+
+        if (!synced || jumped || now >= deadlineEpoch) {
+            struct tm local;
+            if (!localtime_r(&now, &local)) {
+                nextCheckMs = nowMs + UNSYNCED_CHECK_MS;
+                return;
+            }
+            periodDayKey = dayKey(local);
+            hour = (uint8_t)local.tm_hour;
+            deadlineEpoch = nextLocalHour(local);
+            if (deadlineEpoch <= now) {
+                deadlineEpoch = now + 60;  // Ambiguous DST hour: re-evaluate shortly
+            }
+            synced = true;
+        }
+
+        time_t remaining = deadlineEpoch - now;
+        uint32_t waitMs = remaining * 1000 < (time_t)RESYNC_CHECK_MS ? (uint32_t)(remaining * 1000) : RESYNC_CHECK_MS;
+        nextCheckMs = nowMs + waitMs;
+    }
+
+    /** @brief Restore persisted period (0 = unknown, no catch-up) */
+    void setPeriodDayKey(uint32_t key) { periodDayKey = key; }
+    uint32_t getPeriodDayKey() const { return periodDayKey; }
+
+    /** @brief Local hour (0-23) of the current period, valid when synced */
+    uint8_t getHour() const { return hour; }
+
+    bool isSynced() const { return synced; }
+
+    /** @brief Force evaluation on next due() (NTP sync notification, "ntp/synced") */
+    void invalidate(uint32_t nowMs) {
+        synced = false;
+        nextCheckMs = nowMs;
+    }
+
+    static uint32_t dayKey(const struct tm& t) {
+        return (uint32_t)(t.tm_year + 1900) * 10000 + (uint32_t)(t.tm_mon + 1) * 100 + (uint32_t)t.tm_mday;
+    }
+
+    static time_t nextLocalHour(const struct tm& t) {
+        struct tm next = t;
+        next.tm_hour += 1;  // mktime normalizes day/month/year overflow
+        next.tm_min = 0;
+        next.tm_sec = 0;
+        next.tm_isdst = -1;  // Let libc resolve DST for that boundary
+        return mktime(&next);
+    }
+
+private:
+    uint32_t nextCheckMs = 0;
+    uint32_t periodDayKey = 0;
+    time_t deadlineEpoch = 0;
+    time_t refEpoch = 0;
+    uint32_t refMs = 0;
+    uint8_t hour = 0;
+    bool synced = false;
+};
+
+#endif // WATER_METER_CALENDAR_H
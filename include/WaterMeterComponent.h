@@ -9,9 +9,28 @@
  * - FALLING edge detection = magnet LEAVING sensor (1 liter complete)
  * - Boot initialization delay (no counting for 3 seconds after power-on)
  * - Hardware debounce + software debounce (configurable)
- * - Daily/Yearly consumption tracking
- * - Auto-save to NVS storage every 30s
- * - Event bus data publishing every 5s
+ * - Lock-free ISR → loop() queue of pulse timestamps (no pulse lost on slow loop)
+ * - Pluggable pulse source: GPIO interrupt (default), ESP32 PCNT hardware counter, mock
+ * - Optional pulse task (config.pulseTask): pulse draining, flow and LED in a pinned
+ *   FreeRTOS task woken by the ISR, loop() only takes over the totals
+ * - Multi-channel: one component per meter (config.channel), per-channel ISR slot,
+ *   storage keys, HA entity ids and WebUI contexts
+ * - Daily/Yearly consumption tracking (deadline-scheduled local midnight / new year resets,
+ *   DST-aware, missed rollovers caught up at boot)
+ * - Consumption history: hourly buckets (7 days) + daily buckets (1 year), incrementally persisted
+ * - Flow rate (L/min): instantaneous from pulse intervals, EWMA, 1 min / 15 min averages
+ * - Edge timing histograms (fall-to-fall, LOW, HIGH) and optional debounce auto-tuning
+ * - Leak (continuous flow over 24 h) and burst (sustained high flow) alarms, "watermeter.alarm" events
+ * - Unusual usage: each closed hour scored against its hour-of-week baseline (running mean/variance,
+ *   one O(1) update per hour, 1.5 KB RAM, persisted per weekday)
+ * - Auto-save to NVS storage every 5 min (single CRC-protected record, skipped when unchanged,
+ *   rotated across slots for wear levelling)
+ * - Pulse journal between saves: RTC memory (warm resets) + small flash log flushed every 30 s
+ *   while flowing (power loss), replayed on top of the last record at boot
+ * - Event bus: "watermeter.data" on change (at most every 5 s), "watermeter.pulses" timestamp
+ *   batches; nothing built or emitted while a topic has no subscriber
+ * - Tear-free getData() from any task/core: loop() publishes one WaterMeterData per
+ *   state change through a sequence lock, readers never lock or disable interrupts
  * - LED visual feedback (non-blocking)
  * - Console commands for status and reset
  * 
@@ -26,7 +45,8 @@
  * - Magnet leaves → Sensor 0.2V→3.5V → ESP32 HIGH→LOW = **COUNT** ✓
  * 
  * Note: ISR and volatile variables must be GLOBAL to avoid
- * ESP32 IRAM linker issues with C++ class static members.
+ * ESP32 IRAM linker issues with C++ class static members
+ * (per-channel table g_channels in WaterMeterPulseSource.h).
  */
 
 #include <DomoticsCore/IComponent.h>
@@ -36,6 +56,18 @@
 #include <DomoticsCore/Core.h>
 #include <time.h>
 #include "WaterMeterConfig.h"
+#include "WaterMeterPulseSource.h"
+#include "WaterMeterFlowRate.h"
+#include "WaterMeterPersistence.h"
+#include "WaterMeterCalendar.h"
+#include "WaterMeterHistory.h"
+#include "WaterMeterJournal.h"
+#include "WaterMeterLeak.h"
+#include "WaterMeterBaseline.h"
+#include "WaterMeterVolume.h"
+#include "WaterMeterPeriods.h"
+#include "WaterMeterPulseBatch.h"
+#include "WaterMeterSeqLock.h"
 
 using namespace DomoticsCore;
 using namespace DomoticsCore::Components;
@@ -43,86 +75,116 @@ using namespace DomoticsCore::Components;
 #define LOG_WATER "WATER"
 #define LOG_SENSOR "SENSOR"
 
-// Water meter data for event bus
+// Water meter data for event bus (volumes in integer mL, converted at the output edge)
 struct WaterMeterData {
+    uint8_t channel;
     uint64_t pulseCount;
-    uint64_t dailyLiters;
-    uint64_t yearlyLiters;
-    double totalM3;
-    double dailyM3;
-    double yearlyM3;
-};
-
-// ISR globals - must be outside class to avoid IRAM issues
-namespace {
-    volatile uint64_t g_pulseCount = 0;
-    volatile unsigned long g_lastPulseTime = 0;
-    volatile bool g_newPulseDetected = false;
-    volatile bool g_pulseIgnored = false;
-    volatile unsigned long g_lastIgnoredTimeDiff = 0;
-    volatile unsigned long g_bootTime = 0;           // Boot timestamp for initialization delay
-    volatile bool g_initializationComplete = false;  // ISR enabled after delay
-    volatile bool g_initJustCompleted = false;       // Flag to log init completion (non-ISR)
-    
-    // Config values used by ISR (set by component during begin())
-    volatile uint8_t g_pulsePin = 34;                // Pin number for digitalRead in ISR
-    volatile uint32_t g_pulseDebounceMs = 500;       // Debounce time
-    volatile uint32_t g_pulseHighStableMs = 150;     // Stable HIGH time required
-    volatile uint32_t g_bootInitDelayMs = 3000;      // Boot init delay
-    volatile unsigned long g_lastRisingTime = 0;     // Last time signal went HIGH
-}
-
-// ISR - global function that works
-void IRAM_ATTR waterMeterPulseISR() {
-    unsigned long currentTime = millis();
-    int pinState = digitalRead(g_pulsePin);
+    uint64_t totalMl;
+    uint64_t dailyMl;
+    uint64_t yearlyMl;
+    uint64_t periodMl[WATER_PERIOD_COUNT];          // Running totals, indexed by WaterPeriod
+    uint64_t previousPeriodMl[WATER_PERIOD_COUNT];  // Closing value of each period's last cycle
+    float flowRateLpm;      // Instantaneous (last pulse interval, decays to 0 when idle)
+    float flowRateAvgLpm;   // EWMA of instantaneous rate
+    float flow1mLpm;        // Average over the last minute
+    float flow15mLpm;       // Average over the last 15 minutes
+    bool leakAlarm;         // Continuous flow without a quiet gap for the whole leak window
+    bool burstAlarm;        // Flow above burst threshold for too long
+    uint32_t continuousFlowS;  // Time since water last stopped for a full leak gap
+    float anomalyScore;     // Last closed hour vs its hour-of-week baseline (deviations, 0 = not scored)
+    float usualHourL;       // Baseline mean that hour was scored against
+    bool anomaly;           // anomalyScore at or above config.anomalyThreshold
     
-    // Ignore pulses during initialization period (prevents boot false positives)
-    if (!g_initializationComplete) {
-        if (currentTime - g_bootTime < g_bootInitDelayMs) {
-            return;  // Silent ignore during boot
-        }
-        g_initializationComplete = true;
-        g_initJustCompleted = true;  // Flag for logging in loop()
-        // Initialize lastRisingTime to now to avoid immediate false trigger if we start LOW
-        g_lastRisingTime = currentTime;
-    }
-    
-    if (pinState == LOW) { // FALLING EDGE (Potential Pulse)
-        unsigned long timeDiff = currentTime - g_lastPulseTime;
-        unsigned long stableHighDiff = currentTime - g_lastRisingTime;
-        
-        // Valid pulse requires:
-        // 1. Enough time since last pulse (Debounce)
-        // 2. Signal was HIGH for enough time before this FALLING edge (Stability)
-        if (timeDiff > g_pulseDebounceMs && stableHighDiff > g_pulseHighStableMs) {
-            g_pulseCount++;
-            g_lastPulseTime = currentTime;
-            g_newPulseDetected = true;
-        } else {
-            g_pulseIgnored = true;
-            g_lastIgnoredTimeDiff = timeDiff;
-            // Note: we could also log why it was ignored (debounce vs stability) but keep it simple
-        }
-    } else { // RISING EDGE (Magnet leaving)
-        g_lastRisingTime = currentTime;
-    }
-}
+    uint64_t totalLiters() const { return waterMeterMlToLiters(totalMl); }
+    uint64_t dailyLiters() const { return waterMeterMlToLiters(dailyMl); }
+    uint64_t yearlyLiters() const { return waterMeterMlToLiters(yearlyMl); }
+    float totalM3() const { return waterMeterMlToM3(totalMl); }
+    float dailyM3() const { return waterMeterMlToM3(dailyMl); }
+    float yearlyM3() const { return waterMeterMlToM3(yearlyMl); }
+    uint64_t periodLiters(WaterPeriod p) const { return waterMeterMlToLiters(periodMl[(uint8_t)p]); }
+    uint64_t previousLiters(WaterPeriod p) const { return waterMeterMlToLiters(previousPeriodMl[(uint8_t)p]); }
+};
 
 class WaterMeterComponent : public IComponent {
 private:
     WaterMeterConfig config;
+    uint8_t ch;                        // Channel index into g_channels (fixed for the component's lifetime)
+    
+    // Runtime state data (not configuration), loop() task only; other tasks read the snapshot
+    uint64_t pulseCount = 0;           // Pulses credited (drained + untimed), persisted
+    PeriodAccumulators periods;        // Hour/day/week/month/billing/year totals (mL)
+    uint32_t historyRemainderMl = 0;   // Sub-liter volume not yet added to the (liter) history
+    PulseVolume volume;                // litersPerPulse as integer mL
+    uint32_t stateVersion = 1;         // Bumped on any visible change (WebUI snapshot cache key)
+    SeqLock<WaterMeterData> snapshot;  // getData() for every task, written by loop() on change
+    std::atomic<uint32_t> snapshotVersion{0};  // stateVersion held by snapshot
+    float lastFlowSnapshot[4] = {};    // Flow outputs at last version bump
+    CalendarScheduler calendar;        // Next midnight / resync deadline for resets
+    IComponent* ntp = nullptr;         // Cached NTP component (looked up when the deadline expires)
+    bool ntpSubscribed = false;        // "ntp/synced" handler registered (once per component)
+    
+    // Pulse queue consumer state
+    uint32_t lastQueueOverflows = 0;   // source->untimedCount() already credited
+    uint32_t lastPulseUs = 0;          // Timestamp of last drained pulse
+    uint32_t lastPulseIntervalUs = 0;  // Interval between the last two drained pulses (0 = unknown)
+    bool havePulseTimestamp = false;
+    uint32_t loggedRejectedDebounce = 0;  // ISR rejection counters at the last "ignored" log
+    uint32_t loggedRejectedStable = 0;
+    
+    std::unique_ptr<PulseSource> source;  // Pulse acquisition backend (created in begin())
+    PulseSourceType activeSourceType = PulseSourceType::Interrupt;
+    bool sourceInjected = false;
     
-    // Runtime state data (not configuration)
-    uint64_t dailyLiters = 0;
-    uint64_t yearlyLiters = 0;
-    int lastDay = -1;
-    int lastYear = -1;
+    // Pulse task mode: the task owns source draining, pulse timing, flow and LED;
+    // loop() credits the pulses it hands over (totals, journal, events, saves)
+    struct PulseTaskState {
+        uint64_t drained;              // Pulses taken from the source since the task started
+        uint32_t untimed;              // ...of which without timestamp
+        uint32_t lastPulseIntervalUs;
+        float flow[4];                 // Instant, EWMA, 1 min, 15 min (L/min)
+    };
+    PulseTask pulseTask;
+    bool taskMode = false;
+    SeqLock<PulseTaskState> taskState;                 // Task -> loop(): counters and flow
+    PulseQueue<WATER_METER_PULSE_QUEUE_SIZE> handoff;  // Task -> loop(): timestamps for "watermeter.pulses"
+    PulseTaskState taskLocal = {};                     // Task side, published after each change
+    PulseTaskState handed = {};                        // loop() side: last state credited
+    uint32_t handoffOverflows = 0;                     // handoff.overflowCount() already credited
+    uint32_t taskLedOnMs = 0;
+    uint32_t taskFlowMs = 0;
+    bool taskLedOn = false;
+    
+    // Event bus emission (subscriber presence re-checked every LISTENER_CHECK_MS)
+    PulseBatcher pulseBatch;           // "watermeter.pulses" batch being filled
+    uint32_t publishedVersion = 0;     // stateVersion of the last "watermeter.data" event
+    bool dataListeners = false;
+    bool pulseListeners = false;
+    FlowRateEstimator flow;
+    LeakDetector leakDetector;
+    WeeklyBaseline baseline;
+    uint32_t baselineHourKey = 0;      // Hour whose start loop() saw live (0 = none yet): only such hours are sampled
+    bool calendarRolled = false;       // First synced rollover check done (boot catch-up is not live)
+    CounterStore store;
+    ConsumptionHistory history;
+    PulseJournal journal;
+    
+    // Copies for readers on other tasks (web, console, metrics), written by loop()
+    struct MeterStats {
+        CounterStore::Stats saves;
+        PulseJournal::Stats journal;
+        WeeklyBaseline::Stats baseline;
+    };
+    SeqLock<MeterStats> statsSnapshot;            // Each 1 s tick and after saves
+    SeqLock<ConsumptionHistory> historySnapshot;  // Each 1 s tick the history changed in
+    bool historyChanged = false;
     
     // Non-blocking timers (initialized in constructor)
     Utils::NonBlockingDelay saveTimer;
     Utils::NonBlockingDelay publishTimer;
     Utils::NonBlockingDelay ledTimer;
+    Utils::NonBlockingDelay flowTimer;
+    Utils::NonBlockingDelay tuneTimer;
+    Utils::NonBlockingDelay listenerTimer;
 
 public:
     /**
@@ -131,15 +193,31 @@ public:
      */
     explicit WaterMeterComponent(const WaterMeterConfig& cfg = WaterMeterConfig())
         : config(cfg),
+          ch(cfg.channel < WATER_METER_MAX_CHANNELS ? cfg.channel : 0),
           saveTimer(cfg.saveIntervalMs),
           publishTimer(cfg.publishIntervalMs),
-          ledTimer(cfg.ledFlashMs) {
-        metadata.name = "WaterMeter";
+          ledTimer(cfg.ledFlashMs),
+          flowTimer(FLOW_UPDATE_MS),
+          tuneTimer(TUNE_CHECK_MS),
+          listenerTimer(LISTENER_CHECK_MS) {
+        flow.configure(cfg.litersPerPulse, cfg.flowZeroTimeoutMs, cfg.flowEwmaTauMs);
+        volume.configure(cfg.litersPerPulse);
+        periods.setBillingStartDay(cfg.billingStartDay);
+        leakDetector.configure(cfg.leakGapMinutes, cfg.leakWindowHours, cfg.burstFlowLpm, cfg.burstMinutes);
+        baseline.configure(cfg.anomalyWindowWeeks, cfg.anomalyMinWeeks, cfg.anomalyMinSigmaL, cfg.anomalyThreshold);
+        pulseBatch.setMaxAge(cfg.pulseBatchMs);
+        config.channel = ch;
+        // Unique component name per channel: "WaterMeter", "WaterMeter_hot", ...
+        metadata.name = String("WaterMeter") + getEntitySuffix();
         metadata.version = WATER_METER_VERSION;
         metadata.author = "JNOV";
         metadata.description = "Water meter pulse counter with DomoticsCore integration";
     }
 
+    ~WaterMeterComponent() override {
+        stopPulseTask();  // Before the members it works on go away
+    }
+
     std::vector<Dependency> getDependencies() const override {
         return {
             {"Storage", false},  // Optional - persistent data storage
@@ -157,20 +235,17 @@ public:
         DLOG_I(LOG_WATER, "Initializing water meter (pin=%d, led=%d, L/pulse=%.1f)...",
                config.pulseInputPin, config.statusLedPin, config.litersPerPulse);
 
-        // Update global ISR config values
-        g_pulsePin = config.pulseInputPin;
-        g_pulseDebounceMs = config.pulseDebounceMs;
-        g_pulseHighStableMs = config.pulseHighStableMs;
-        g_bootInitDelayMs = config.bootInitDelayMs;
-
         // GPIO setup
         pinMode(config.pulseInputPin, INPUT);
         pinMode(config.statusLedPin, OUTPUT);
         digitalWrite(config.statusLedPin, LOW);
 
         // Record boot time for initialization delay
-        g_bootTime = millis();
-        g_initializationComplete = false;
+        g_channels.bootTime[ch] = millis();
+        flow.reset(g_channels.bootTime[ch]);
+        leakDetector.reset(g_channels.bootTime[ch]);
+        havePulseTimestamp = false;
+        g_channels.initializationComplete[ch] = false;
         
         // Read initial GPIO state (for diagnostics)
         int initialState = digitalRead(config.pulseInputPin);
@@ -181,74 +256,147 @@ public:
         // Let GPIO stabilize
         delay(100);
         
-        // Attach interrupt (CHANGE to detect both edges for stability check)
-        attachInterrupt(digitalPinToInterrupt(config.pulseInputPin), waterMeterPulseISR, CHANGE);
-        DLOG_I(LOG_WATER, "Interrupt attached to GPIO %d (CHANGE mode for stability check)", config.pulseInputPin);
-        DLOG_W(LOG_WATER, "⏳ Pulse detection disabled for %lu ms (boot protection)", config.bootInitDelayMs);
+        // Start pulse acquisition (ISR by default; an injected source is kept)
+        if (!source || (!sourceInjected && config.pulseSource != activeSourceType)) {
+            source = createPulseSource(config.pulseSource);
+            activeSourceType = config.pulseSource;
+        }
+        lastQueueOverflows = source->untimedCount();
+        if (!source->begin(config)) {
+            DLOG_E(LOG_WATER, "Pulse source '%s' failed to start, falling back to ISR", source->name());
+            source = createPulseSource(PulseSourceType::Interrupt);
+            activeSourceType = PulseSourceType::Interrupt;
+            lastQueueOverflows = source->untimedCount();
+            source->begin(config);
+        }
+        DLOG_I(LOG_WATER, "Pulse source '%s' started on GPIO %d", source->name(), config.pulseInputPin);
+        DLOG_W(LOG_WATER, "⏳ Pulse detection disabled for %lu ms (boot protection)", (unsigned long)config.bootInitDelayMs);
         
         setActive(true);
         
         // Load from storage if available
         loadFromStorage();
+        publishHistory();
+        publishStats();
+        
+        // NTP (re)sync: recompute the calendar deadline now instead of on the next jump check
+        if (!ntpSubscribed) {
+            getCore()->on<bool>("ntp/synced", [this](const bool&) {
+                calendar.invalidate(millis());
+            });
+            ntpSubscribed = true;
+        }
+        
+        if (config.pulseTask) {
+            startPulseTask();
+        }
+        
+        publishSnapshot();
         
-        DLOG_I(LOG_WATER, "Water meter ready: %llu pulses (%.3f m³)",
-               g_pulseCount, g_pulseCount * config.litersPerPulse / 1000.0);
+        DLOG_I(LOG_WATER, "Water meter ready: %llu pulses (%llu L, %lu mL/pulse)",
+               (unsigned long long)pulseCount, (unsigned long long)waterMeterMlToLiters(volume.toMl(pulseCount)), (unsigned long)volume.mlPerPulse());
         return ComponentStatus::Success;
     }
 
     void loop() override {
         // Log initialization completion (outside ISR)
-        if (g_initJustCompleted) {
+        if (g_channels.initJustCompleted[ch]) {
             DLOG_I(LOG_SENSOR, "✓ Pulse detection enabled after %lu ms (boot protection complete)", 
-                   millis() - g_bootTime);
-            g_initJustCompleted = false;
-        }
-        
-        // Handle new pulse from ISR
-        if (g_newPulseDetected) {
-            dailyLiters += static_cast<uint64_t>(config.litersPerPulse);
-            yearlyLiters += static_cast<uint64_t>(config.litersPerPulse);
-            
-            DLOG_I(LOG_SENSOR, "PULSE: count=%llu, daily=%lluL, yearly=%lluL", 
-                   g_pulseCount, dailyLiters, yearlyLiters);
-            
-            // LED feedback - non-blocking
-            if (config.enableLed) {
-                digitalWrite(config.statusLedPin, HIGH);
-                ledTimer.reset();
-            }
-            
-            g_newPulseDetected = false;
+                   millis() - g_channels.bootTime[ch]);
+            g_channels.initJustCompleted[ch] = false;
+        }
+        
+        // Event bus subscribers come and go rarely: one lookup per topic per second
+        if (listenerTimer.isReady()) {
+            updateListeners();
+        }
+        
+        // Handle new pulses from ISR (batched drain, nothing lost while loop was busy),
+        // or credit what the pulse task drained since the last loop()
+        if (taskMode) {
+            collectPulseTask();
+        } else {
+            processPulseQueue();
+        }
+        
+        // Partial "watermeter.pulses" batch old enough
+        if (pulseBatch.due(millis())) {
+            publishPulseBatch();
         }
         
-        // Turn off LED after timer
-        if (config.enableLed && digitalRead(config.statusLedPin) == HIGH && ledTimer.isReady()) {
+        // Journal pulses credited since the last full save (no-op when nothing pending)
+        if (config.enableJournal) {
+            journal.service(millis());
+        }
+        
+        // Flow rate decay / averages
+        if (flowTimer.isReady()) {
+            uint32_t now = millis();
+            if (!taskMode) flow.update(now);  // Pulse task: updated there, handed over with the counters
+            updateAlarms(now);
+            touchIfFlowChanged();
+            if (historyChanged) publishHistory();
+            publishStats();
+        }
+        
+        // Debounce / stability auto-tuning from the ISR edge histograms
+        if (config.autoTuneDebounce && tuneTimer.isReady()) {
+            autoTuneDebounce();
+        }
+        
+        // Turn off LED after timer (pulse task: done there)
+        if (!taskMode && config.enableLed && digitalRead(config.statusLedPin) == HIGH && ledTimer.isReady()) {
             digitalWrite(config.statusLedPin, LOW);
         }
         
         // Log ignored pulses (debounce)
-        if (g_pulseIgnored) {
-            DLOG_W(LOG_SENSOR, "Pulse ignored (debounce): %lu ms", g_lastIgnoredTimeDiff);
-            g_pulseIgnored = false;
+        if (g_channels.pulseIgnored[ch]) {
+            g_channels.pulseIgnored[ch] = false;
+            // One line per loop() with the rejections since the previous one
+            uint32_t debounce = g_channels.isr[ch].rejectedDebounce;
+            uint32_t stable = g_channels.isr[ch].rejectedStable;
+            DLOG_W(LOG_SENSOR, "Edges ignored: +%lu debounce, +%lu stability (last %lu ms after pulse)",
+                   (unsigned long)(debounce - loggedRejectedDebounce),
+                   (unsigned long)(stable - loggedRejectedStable),
+                   (unsigned long)g_channels.lastIgnoredTimeDiff[ch]);
+            loggedRejectedDebounce = debounce;
+            loggedRejectedStable = stable;
         }
         
-        // Check for daily/yearly reset (requires NTP)
-        checkTimeBasedResets();
+        // Check for daily/yearly reset (requires NTP) - one compare until the deadline
+        if (calendar.due(millis())) {
+            checkTimeBasedResets();
+        }
         
         // Auto-save with non-blocking timer
         if (saveTimer.isReady()) {
             saveToStorage();
         }
         
-        // Publish data with non-blocking timer
-        if (publishTimer.isReady()) {
+        // One consistent copy of everything above for readers on other tasks
+        if (stateVersion != snapshotVersion.load(std::memory_order_relaxed)) {
+            publishSnapshot();
+        }
+        
+        // Publish data on change, coalesced to one event per publishIntervalMs
+        if (dataListeners && stateVersion != publishedVersion && publishTimer.isReady()) {
             publishData();
         }
     }
 
     ComponentStatus shutdown() override {
-        if (config.enabled) {
-            detachInterrupt(digitalPinToInterrupt(config.pulseInputPin));
+        if (config.enabled && source) {
+            bool task = taskMode;
+            stopPulseTask();
+            source->end();
+            // Credit what the source accepted before it stopped
+            if (task) {
+                servicePulseTask(millis());
+                collectPulseTask();
+                taskMode = false;
+            } else {
+                processPulseQueue();
+            }
         }
         saveToStorage();
         setActive(false);
@@ -256,15 +404,14 @@ public:
         return ComponentStatus::Success;
     }
 
+    /**
+     * @brief Latest state, safe from any task or core (WebUI, console, MQTT)
+     * 
+     * A copy published by loop() after the last change: pulse count, totals,
+     * periods, flow and alarms always belong to the same instant.
+     */
     WaterMeterData getData() const {
-        WaterMeterData data;
-        data.pulseCount = g_pulseCount;
-        data.dailyLiters = dailyLiters;
-        data.yearlyLiters = yearlyLiters;
-        data.totalM3 = (g_pulseCount * config.litersPerPulse) / 1000.0;
-        data.dailyM3 = dailyLiters / 1000.0;
-        data.yearlyM3 = yearlyLiters / 1000.0;
-        return data;
+        return snapshot.read();
     }
 
     /**
@@ -285,7 +432,8 @@ public:
     void setConfig(const WaterMeterConfig& cfg) {
         // Detect what changed
         bool hardwareChanged = (cfg.pulseInputPin != config.pulseInputPin) ||
-                               (cfg.statusLedPin != config.statusLedPin);
+                               (cfg.statusLedPin != config.statusLedPin) ||
+                               (cfg.pulseSource != config.pulseSource);
         bool enabledChanged = (cfg.enabled != config.enabled);
         bool timersChanged = (cfg.saveIntervalMs != config.saveIntervalMs) ||
                             (cfg.publishIntervalMs != config.publishIntervalMs) ||
@@ -294,12 +442,29 @@ public:
         DLOG_I(LOG_WATER, "Updating config: enabled=%d, pin=%d, led=%d, L/pulse=%.1f, highStable=%dms",
                cfg.enabled, cfg.pulseInputPin, cfg.statusLedPin, cfg.litersPerPulse, cfg.pulseHighStableMs);
         
-        // Apply new config
+        // Apply new config (pulse task paused: it reads flow, LED and source settings)
+        bool task = taskMode && !hardwareChanged && !enabledChanged;
+        if (task) {
+            stopPulseTask();
+            collectPulseTask();
+            taskMode = false;
+        }
         config = cfg;
+        flow.configure(config.litersPerPulse, config.flowZeroTimeoutMs, config.flowEwmaTauMs);
+        volume.configure(config.litersPerPulse);
+        periods.setBillingStartDay(config.billingStartDay);
+        leakDetector.configure(config.leakGapMinutes, config.leakWindowHours, config.burstFlowLpm, config.burstMinutes);
+        baseline.configure(config.anomalyWindowWeeks, config.anomalyMinWeeks, config.anomalyMinSigmaL, config.anomalyThreshold);
+        pulseBatch.setMaxAge(config.pulseBatchMs);
+        journal.setFlushInterval(config.journalFlushMs);
         
-        // Update ISR globals
-        g_pulseDebounceMs = config.pulseDebounceMs;
-        g_pulseHighStableMs = config.pulseHighStableMs;
+        // Update pulse source (ISR globals / polled debounce)
+        if (source) {
+            source->configure(config);
+        }
+        if (config.enabled && config.pulseTask && source && !hardwareChanged && !enabledChanged) {
+            startPulseTask();  // Resumes a paused task, or starts one newly enabled
+        }
         
         // Update timers if intervals changed
         if (timersChanged) {
@@ -307,7 +472,7 @@ public:
             publishTimer = Utils::NonBlockingDelay(config.publishIntervalMs);
             ledTimer = Utils::NonBlockingDelay(config.ledFlashMs);
             DLOG_I(LOG_WATER, "Timers updated: save=%lums, publish=%lums",
-                   config.saveIntervalMs, config.publishIntervalMs);
+                   (unsigned long)config.saveIntervalMs, (unsigned long)config.publishIntervalMs);
         }
         
         // Restart if hardware config changed or enabled state changed
@@ -319,106 +484,727 @@ public:
     }
 
     void resetDaily() {
-        dailyLiters = 0;
+        periods.reset(WaterPeriod::Day);
+        touch();
         saveToStorage();
         DLOG_I(LOG_WATER, "Daily counter reset");
     }
 
     void resetYearly() {
-        yearlyLiters = 0;
+        periods.reset(WaterPeriod::Year);
+        touch();
         saveToStorage();
         DLOG_I(LOG_WATER, "Yearly counter reset");
     }
 
     void overridePulseCount(uint64_t newCount) {
-        g_pulseCount = newCount;
+        pulseCount = newCount;
+        touch();
         saveToStorage();
-        DLOG_I(LOG_WATER, "Pulse count overridden to %llu (%.3f m³)", 
-               g_pulseCount, g_pulseCount * config.litersPerPulse / 1000.0);
+        DLOG_I(LOG_WATER, "Pulse count overridden to %llu (%llu L)", 
+               (unsigned long long)pulseCount, (unsigned long long)waterMeterMlToLiters(volume.toMl(newCount)));
     }
 
     void overrideDailyLiters(uint64_t newValue) {
-        dailyLiters = newValue;
+        periods.set(WaterPeriod::Day, newValue * 1000);
+        touch();
         saveToStorage();
-        DLOG_I(LOG_WATER, "Daily liters overridden to %llu L (%.3f m³)", 
-               dailyLiters, dailyLiters / 1000.0);
+        DLOG_I(LOG_WATER, "Daily liters overridden to %llu L", (unsigned long long)newValue);
     }
 
     void overrideYearlyLiters(uint64_t newValue) {
-        yearlyLiters = newValue;
+        periods.set(WaterPeriod::Year, newValue * 1000);
+        touch();
         saveToStorage();
-        DLOG_I(LOG_WATER, "Yearly liters overridden to %llu L (%.3f m³)", 
-               yearlyLiters, yearlyLiters / 1000.0);
+        DLOG_I(LOG_WATER, "Yearly liters overridden to %llu L", (unsigned long long)newValue);
+    }
+
+    /**
+     * @brief Pulses whose timestamp the pulse source lost (ISR queue full)
+     * 
+     * Dropped pulses are still counted; only their timing is lost.
+     */
+    uint32_t getQueueOverflowCount() const {
+        return source ? source->untimedCount() : 0;
+    }
+
+    /**
+     * @brief Use a specific pulse source instead of config.pulseSource
+     * 
+     * Must be called before begin() (e.g. MockPulseSource in host tests).
+     */
+    void setPulseSource(std::unique_ptr<PulseSource> custom) {
+        source = std::move(custom);
+        sourceInjected = (source != nullptr);
+    }
+
+    /**
+     * @brief Active pulse source (nullptr before begin())
+     */
+    PulseSource* getPulseSource() const {
+        return source.get();
+    }
+
+    /**
+     * @brief Channel index of this meter
+     */
+    uint8_t getChannel() const {
+        return ch;
+    }
+
+    /**
+     * @brief Suffix for per-channel ids: "" (channel 0 without name), "_<name>" or "_<channel>"
+     * 
+     * Appended to HA entity ids, WebUI context ids and the component name so
+     * a single-meter install keeps its existing ids.
+     */
+    String getEntitySuffix() const {
+        if (config.channelName.length() > 0) return String("_") + config.channelName;
+        if (ch == 0) return String("");
+        return String("_") + String((unsigned)ch);
+    }
+
+    /**
+     * @brief Monotonic version of the visible state
+     * 
+     * Changes whenever counters, flow outputs or alarms change; equal versions
+     * mean getData() would return the same values (cache/ETag key). This is
+     * the version of the published snapshot, so a getData() that follows
+     * returns at least this state.
+     */
+    uint32_t getStateVersion() const {
+        return snapshotVersion.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Copy of the hourly/daily consumption history (any task; at most ~1 s behind loop())
+     */
+    ConsumptionHistory getHistory() const {
+        return historySnapshot.read();
+    }
+
+    /**
+     * @brief Hour-of-week baseline counters (any task; at most ~1 s behind loop())
+     */
+    WeeklyBaseline::Stats getBaselineStats() const {
+        return statsSnapshot.read().baseline;
+    }
+
+    /**
+     * @brief Persistence counters: writes, skipped unchanged saves, write latency (any task)
+     */
+    CounterStore::Stats getPersistenceStats() const {
+        return statsSnapshot.read().saves;
+    }
+
+    /**
+     * @brief Pulse journal counters: flash entries written, pulses replayed at boot (any task)
+     */
+    PulseJournal::Stats getJournalStats() const {
+        return statsSnapshot.read().journal;
+    }
+
+    /**
+     * @brief Meter resolution actually used for the totals (litersPerPulse rounded, or the build constant)
+     */
+    uint32_t getMlPerPulse() const {
+        return volume.mlPerPulse();
+    }
+
+    /**
+     * @brief Name of the active pulse source ("isr", "pcnt", "mock"; "none" before begin())
+     */
+    const char* getPulseSourceName() const {
+        return source ? source->name() : "none";
+    }
+
+    /**
+     * @brief Edge counters by outcome + ISR execution time of this channel
+     */
+    IsrStats::Snapshot getIsrStats() const {
+        return g_channels.isr[ch].snapshot();
+    }
+
+#if WATER_METER_EDGE_STATS
+    /**
+     * @brief Edge timing histograms of this channel (filled by the ISR source only)
+     */
+    const EdgeStats& getEdgeStats() const {
+        return g_channels.edges[ch];
+    }
+
+    /**
+     * @brief What the debounce tuner would pick from the current histograms
+     */
+    DebounceTuner::Result evaluateDebounce() const {
+        return DebounceTuner::evaluate(g_channels.edges[ch]);
+    }
+#endif
+
+    /**
+     * @brief Interval between the last two pulses in microseconds (0 = unknown)
+     */
+    uint32_t getLastPulseIntervalUs() const {
+        return taskMode ? handed.lastPulseIntervalUs : lastPulseIntervalUs;
+    }
+
+    /**
+     * @brief Pulse task run count and worst run time (nullptr when pulses are drained in loop())
+     */
+    const PulseTask::Stats* getPulseTaskStats() const {
+        return taskMode ? &pulseTask.getStats() : nullptr;
     }
 
 private:
+    static constexpr uint32_t PULSE_DRAIN_BATCH = 16;
+    static constexpr uint32_t FLOW_UPDATE_MS = 1000;
+    static constexpr uint32_t TUNE_CHECK_MS = 60000;
+    static constexpr uint32_t LISTENER_CHECK_MS = 1000;
+
+    void processPulseQueue() {
+        uint32_t batch[PULSE_DRAIN_BATCH];
+        uint32_t drained = 0;
+        uint32_t n;
+        
+        if (!source) return;
+        source->service(millis());  // Polled backends read their counter here
+        
+        while ((n = source->drain(batch, PULSE_DRAIN_BATCH)) > 0) {
+            for (uint32_t i = 0; i < n; i++) {
+                onPulse(batch[i]);
+            }
+            drained += n;
+        }
+        
+        // Pulses whose timestamp did not fit in the queue still count
+        uint32_t overflows = source->untimedCount();
+        uint32_t untimed = overflows - lastQueueOverflows;
+        lastQueueOverflows = overflows;
+        if (untimed > 0) {
+            creditPulses(untimed);
+            if (pulseListeners) pulseBatch.addUntimed(untimed, millis());
+            flow.onUntimedPulses(untimed, millis());
+            leakDetector.onPulse(millis());
+            havePulseTimestamp = false;  // Timing chain broken
+            DLOG_W(LOG_SENSOR, "Pulse queue overflow: %lu pulses counted without timestamp", 
+                   (unsigned long)untimed);
+        }
+        
+        if (drained + untimed == 0) {
+            return;
+        }
+        
+        DLOG_I(LOG_SENSOR, "PULSE: +%lu, count=%llu, daily=%lluL, yearly=%lluL", 
+               (unsigned long)(drained + untimed), (unsigned long long)pulseCount,
+               (unsigned long long)waterMeterMlToLiters(periods.current(WaterPeriod::Day)), (unsigned long long)waterMeterMlToLiters(periods.current(WaterPeriod::Year)));
+        
+        // LED feedback - non-blocking
+        if (config.enableLed) {
+            digitalWrite(config.statusLedPin, HIGH);
+            ledTimer.reset();
+        }
+    }
+
+    void onPulse(uint32_t timestampUs) {
+        uint32_t now = millis();
+        timePulse(timestampUs, now);
+        creditPulses(1);
+        leakDetector.onPulse(now);
+        if (pulseListeners && pulseBatch.add(timestampUs, now)) {
+            publishPulseBatch();
+        }
+    }
+
+    /** @brief Interval to the previous pulse + flow estimator (loop() or pulse task, never both) */
+    void timePulse(uint32_t timestampUs, uint32_t nowMs) {
+        lastPulseIntervalUs = havePulseTimestamp ? (timestampUs - lastPulseUs) : 0;
+        lastPulseUs = timestampUs;
+        havePulseTimestamp = true;
+        flow.onPulse(lastPulseIntervalUs, nowMs);
+    }
+
+    void startPulseTask() {
+        if (taskMode) return;
+        taskLocal = PulseTaskState();
+        handed = taskLocal;
+        taskState.write(taskLocal);
+        handoffOverflows = handoff.overflowCount();
+        taskLedOn = false;
+        taskFlowMs = millis();
+        
+        // Wake-ups between pulses only serve timers: LED off, flow decay, counter polling
+        uint32_t tickMs = FLOW_UPDATE_MS;
+        if (config.enableLed && config.ledFlashMs < tickMs) tickMs = config.ledFlashMs;
+        if (activeSourceType == PulseSourceType::Pcnt && config.pcntPollMs < tickMs) tickMs = config.pcntPollMs;
+        
+        char name[16];
+        snprintf(name, sizeof(name), "wm_pulse%u", (unsigned)ch);
+        if (!pulseTask.start(name, pulseTaskWork, this, config.pulseTaskCore, config.pulseTaskPriority, tickMs)) {
+            DLOG_E(LOG_WATER, "Pulse task could not be created, pulses stay in loop()");
+            return;
+        }
+        taskMode = true;
+        g_channels.pulseTask[ch] = pulseTask.notifyHandle();
+        DLOG_I(LOG_WATER, "Pulse task started on core %u (priority %u, tick %lu ms)",
+               (unsigned)config.pulseTaskCore, (unsigned)config.pulseTaskPriority, (unsigned long)tickMs);
+    }
+
+    /** @brief Stop waking/running the task; taskMode stays set until its last state is collected */
+    void stopPulseTask() {
+        if (!taskMode) return;
+        g_channels.pulseTask[ch] = nullptr;
+        pulseTask.stop();
+    }
+
+    static void pulseTaskWork(void* self, uint32_t nowMs) {
+        static_cast<WaterMeterComponent*>(self)->servicePulseTask(nowMs);
+    }
+
+    /**
+     * @brief Pulse task body: drain the source, time pulses, flow, LED; publish to loop()
+     * 
+     * Only task-owned state is touched here (source, pulse timing, flow
+     * estimator, LED pin, taskLocal); totals stay with loop().
+     */
+    void servicePulseTask(uint32_t nowMs) {
+        uint32_t batch[PULSE_DRAIN_BATCH];
+        uint32_t drained = 0;
+        uint32_t n;
+        
+        source->service(nowMs);
+        while ((n = source->drain(batch, PULSE_DRAIN_BATCH)) > 0) {
+            for (uint32_t i = 0; i < n; i++) {
+                timePulse(batch[i], nowMs);
+                handoff.push(batch[i]);  // Full: counted, loop() batches it as untimed
+            }
+            drained += n;
+        }
+        uint32_t overflows = source->untimedCount();
+        uint32_t untimed = overflows - lastQueueOverflows;
+        lastQueueOverflows = overflows;
+        if (untimed > 0) {
+            flow.onUntimedPulses(untimed, nowMs);
+            havePulseTimestamp = false;  // Timing chain broken
+        }
+        
+        bool changed = drained + untimed > 0;
+        if (changed && config.enableLed) {
+            digitalWrite(config.statusLedPin, HIGH);
+            taskLedOn = true;
+            taskLedOnMs = nowMs;
+        }
+        if (taskLedOn && nowMs - taskLedOnMs >= config.ledFlashMs) {
+            digitalWrite(config.statusLedPin, LOW);
+            taskLedOn = false;
+        }
+        if (nowMs - taskFlowMs >= FLOW_UPDATE_MS) {
+            flow.update(nowMs);
+            taskFlowMs = nowMs;
+            changed = true;
+        }
+        if (!changed) return;
+        
+        taskLocal.drained += drained + untimed;
+        taskLocal.untimed += untimed;
+        taskLocal.lastPulseIntervalUs = lastPulseIntervalUs;
+        taskLocal.flow[0] = flow.instantLpm();
+        taskLocal.flow[1] = flow.ewmaLpm();
+        taskLocal.flow[2] = flow.avg1mLpm();
+        taskLocal.flow[3] = flow.avg15mLpm();
+        taskState.write(taskLocal);
+    }
+
+    /**
+     * @brief loop() side of the pulse task: credit the pulses drained since the last call
+     */
+    void collectPulseTask() {
+        uint32_t now = millis();
+        PulseTaskState s = taskState.read();
+        
+        // Timestamps run ahead of s at most by one task run: same pulses, credited next loop()
+        uint32_t batch[PULSE_DRAIN_BATCH];
+        uint32_t n;
+        while ((n = handoff.drain(batch, PULSE_DRAIN_BATCH)) > 0) {
+            if (!pulseListeners) continue;
+            for (uint32_t i = 0; i < n; i++) {
+                if (pulseBatch.add(batch[i], now)) {
+                    publishPulseBatch();
+                }
+            }
+        }
+        uint32_t lost = handoff.overflowCount() - handoffOverflows;
+        handoffOverflows += lost;
+        uint32_t untimed = s.untimed - handed.untimed;
+        if (pulseListeners && lost + untimed > 0) {
+            pulseBatch.addUntimed(lost + untimed, now);
+        }
+        
+        uint32_t pulses = (uint32_t)(s.drained - handed.drained);
+        handed = s;
+        if (untimed > 0) {
+            DLOG_W(LOG_SENSOR, "Pulse queue overflow: %lu pulses counted without timestamp", (unsigned long)untimed);
+        }
+        if (pulses == 0) return;
+        
+        creditPulses(pulses);
+        leakDetector.onPulse(now);
+        DLOG_I(LOG_SENSOR, "PULSE: +%lu, count=%llu, daily=%lluL, yearly=%lluL (pulse task)",
+               (unsigned long)pulses, (unsigned long long)pulseCount,
+               (unsigned long long)waterMeterMlToLiters(periods.current(WaterPeriod::Day)), (unsigned long long)waterMeterMlToLiters(periods.current(WaterPeriod::Year)));
+    }
+
+    /** @brief Instant, EWMA, 1 min, 15 min flow as loop() sees it (L/min) */
+    void flowOutputs(float out[4]) const {
+        if (taskMode) {
+            memcpy(out, handed.flow, sizeof(handed.flow));
+            return;
+        }
+        out[0] = flow.instantLpm();
+        out[1] = flow.ewmaLpm();
+        out[2] = flow.avg1mLpm();
+        out[3] = flow.avg15mLpm();
+    }
+
+    /**
+     * @brief Apply tuner proposals that moved by more than 10% (no flapping
+     * between neighbouring bins); values only live until the next setConfig()/reboot
+     */
+    void autoTuneDebounce() {
+#if WATER_METER_EDGE_STATS
+        DebounceTuner::Result r = DebounceTuner::evaluate(g_channels.edges[ch]);
+        bool changed = false;
+        if (r.debounce.valid && differsBy10Percent(r.debounce.thresholdMs, config.pulseDebounceMs)) {
+            DLOG_I(LOG_SENSOR, "Auto-tune: debounce %lu -> %lu ms (noise <= %lu us, pulses >= %lu us)",
+                   (unsigned long)config.pulseDebounceMs, (unsigned long)r.debounce.thresholdMs,
+                   (unsigned long)r.debounce.noiseUs, (unsigned long)r.debounce.realUs);
+            config.pulseDebounceMs = r.debounce.thresholdMs;
+            changed = true;
+        }
+        if (r.stable.valid && differsBy10Percent(r.stable.thresholdMs, config.pulseHighStableMs)) {
+            DLOG_I(LOG_SENSOR, "Auto-tune: high stable %lu -> %lu ms (noise <= %lu us, dwell >= %lu us)",
+                   (unsigned long)config.pulseHighStableMs, (unsigned long)r.stable.thresholdMs,
+                   (unsigned long)r.stable.noiseUs, (unsigned long)r.stable.realUs);
+            config.pulseHighStableMs = r.stable.thresholdMs;
+            changed = true;
+        }
+        if (changed && source) {
+            source->configure(config);
+            touch();
+        }
+#endif
+    }
+
+    static bool differsBy10Percent(uint32_t proposed, uint32_t current) {
+        uint32_t delta = proposed > current ? proposed - current : current - proposed;
+        return delta * 10 > current;
+    }
+
+    void creditPulses(uint32_t pulses) {
+        pulseCount += pulses;
+        addVolume(volume.toMl(pulses));
+        if (config.enableJournal) {
+            journal.record(pulses);
+        }
+        touch();
+    }
+
+    /** @brief Credit a volume to every period and the (whole liter) history */
+    void addVolume(uint32_t ml) {
+        periods.add(ml);
+        historyRemainderMl += ml;
+        if (historyRemainderMl >= 1000) {
+            history.add(historyRemainderMl / 1000);
+            historyChanged = true;
+            historyRemainderMl %= 1000;
+        }
+    }
+
+    WaterMeterState captureState() const {
+        WaterMeterState state;
+        state.pulseCount = pulseCount;
+        state.dailyMl = periods.current(WaterPeriod::Day);
+        state.yearlyMl = periods.current(WaterPeriod::Year);
+        state.periodDayKey = calendar.getPeriodDayKey();
+        state.periods = periods.getTotals();
+        return state;
+    }
+
     void loadFromStorage() {
+        // Storage is looked up once here; saves reuse the cached pointer
         auto* storage = getCore()->getComponent<Components::StorageComponent>("Storage");
+        store.attach(storage, ch);
+        history.attach(storage, ch);
+        baseline.attach(storage, ch);
+        journal.attach(storage, ch, config.journalFlushMs);
         if (!storage) {
             DLOG_W(LOG_WATER, "Storage not available, using defaults");
             return;
         }
 
-        // Load uint64_t using native v1.0.1+ support
-        g_pulseCount = storage->getULong64("pulse_count", 0);
-        dailyLiters = storage->getULong64("daily_liters", 0);
-        yearlyLiters = storage->getULong64("yearly_liters", 0);
+        history.load();
+        baseline.load();
+        
+        WaterMeterState state;
+        if (store.load(state)) {
+            pulseCount = state.pulseCount;
+            periods.restore(state.periods);
+            calendar.setPeriodDayKey(state.periodDayKey);
+            touch();
+            DLOG_I(LOG_WATER, "Loaded record #%lu: %llu pulses, %lluL daily, %lluL yearly",
+                   (unsigned long)store.getSequence(), (unsigned long long)pulseCount,
+                   (unsigned long long)waterMeterMlToLiters(periods.current(WaterPeriod::Day)), (unsigned long long)waterMeterMlToLiters(periods.current(WaterPeriod::Year)));
+            replayJournal();
+            return;
+        }
+
+        if (ch != 0) {
+            DLOG_I(LOG_WATER, "Channel %u: no stored record, starting from zero", (unsigned)ch);
+            replayJournal();
+            return;
+        }
         
-        DLOG_I(LOG_WATER, "Loaded from storage: %llu pulses, %lluL daily, %lluL yearly",
-               g_pulseCount, dailyLiters, yearlyLiters);
+        // No record yet: migrate legacy per-counter keys (pre-record firmware, single meter)
+        pulseCount = storage->getULong64("pulse_count", 0);
+        uint64_t legacyDaily = storage->getULong64("daily_liters", 0);
+        uint64_t legacyYearly = storage->getULong64("yearly_liters", 0);
+        periods.set(WaterPeriod::Day, legacyDaily * 1000);
+        periods.set(WaterPeriod::Year, legacyYearly * 1000);
+        touch();
+        store.save(captureState(), true);
+        journal.rebase(store.getSequence());
+        
+        DLOG_I(LOG_WATER, "Loaded from legacy keys: %llu pulses, %lluL daily, %lluL yearly",
+               (unsigned long long)pulseCount, (unsigned long long)legacyDaily, (unsigned long long)legacyYearly);
     }
 
-    void saveToStorage() {
-        auto* storage = getCore()->getComponent<Components::StorageComponent>("Storage");
-        if (!storage) {
-            DLOG_W(LOG_WATER, "Storage not available, skipping save");
+    /**
+     * @brief Re-apply pulses journaled after the loaded record (power loss / reset
+     * before the next full save), then fold them into a new record
+     */
+    void replayJournal() {
+        if (!config.enableJournal) {
+            journal.rebase(store.getSequence());
+            return;
+        }
+        uint32_t pulses = journal.recover(store.getSequence());
+        if (pulses == 0) {
             return;
         }
+        pulseCount += pulses;
+        addVolume(volume.toMl(pulses));
+        touch();
+        DLOG_I(LOG_WATER, "Journal replay (%s): +%lu pulses on record #%lu",
+               journal.getStats().recoveredFrom == PulseJournal::Source::Rtc ? "RTC" : "flash",
+               (unsigned long)pulses, (unsigned long)store.getSequence());
+        if (store.save(captureState(), true) == CounterStore::SaveResult::Written) {
+            journal.rebase(store.getSequence());
+        }
+    }
 
-        // Save uint64_t using native v1.0.1+ support
-        storage->putULong64("pulse_count", g_pulseCount);
-        storage->putULong64("daily_liters", dailyLiters);
-        storage->putULong64("yearly_liters", yearlyLiters);
+    void saveToStorage() {
+        CounterStore::SaveResult result = store.save(captureState());
+        switch (result) {
+            case CounterStore::SaveResult::Written:
+                DLOG_D(LOG_WATER, "Saved record #%lu in %lu us: %llu pulses, %lluL daily, %lluL yearly",
+                       (unsigned long)store.getSequence(), (unsigned long)store.getStats().lastLatencyUs,
+                       (unsigned long long)pulseCount, (unsigned long long)waterMeterMlToLiters(periods.current(WaterPeriod::Day)),
+                       (unsigned long long)waterMeterMlToLiters(periods.current(WaterPeriod::Year)));
+                journal.rebase(store.getSequence());  // Record now holds every journaled pulse
+                break;
+            case CounterStore::SaveResult::Failed:
+                DLOG_E(LOG_WATER, "Save failed (%lu failures)", (unsigned long)store.getStats().failures);
+                break;
+            case CounterStore::SaveResult::NoStorage:
+                DLOG_W(LOG_WATER, "Storage not available, skipping save");
+                break;
+            case CounterStore::SaveResult::Unchanged:
+                journal.rebase(store.getSequence());  // Stored record already matches
+                break;  // Nothing changed since last write - no flash cycle
+        }
         
-        DLOG_D(LOG_WATER, "Saved: %llu pulses, %lluL daily, %lluL yearly",
-               g_pulseCount, dailyLiters, yearlyLiters);
+        // History: only the hourly row / daily chunk touched since last save
+        uint8_t historyBlobs = history.flush();
+        if (historyBlobs) {
+            DLOG_D(LOG_WATER, "History: %u blobs written", historyBlobs);
+        }
+        baseline.flush();
+        publishStats();
     }
 
     void checkTimeBasedResets() {
-        auto* ntp = getCore()->getComponent("NTP");
-        if (!ntp || !ntp->isActive()) {
-            return;  // NTP not ready
+        // Only reached when the cached calendar deadline expires (see CalendarScheduler)
+        if (!ntp) {
+            ntp = getCore()->getComponent("NTP");
         }
-
         time_t now = time(nullptr);
-        struct tm timeinfo;
-        if (!localtime_r(&now, &timeinfo)) {
-            return;  // Time not valid
+        calendar.check(now, millis(), ntp && ntp->isActive());
+        if (!calendar.isSynced()) {
+            return;
+        }
+        history.setCursor(calendar.getPeriodDayKey(), calendar.getHour());
+        historyChanged = true;
+        
+        // Period rollovers (midnight, Monday, 1st, billing day, Jan 1st, each hour);
+        // keys are persisted, so periods missed while powered off are caught up here
+        struct tm local;
+        if (!localtime_r(&now, &local)) {
+            return;
+        }
+        uint32_t closedHourKey = periods.key(WaterPeriod::Hour);
+        uint8_t rolled = periods.roll(local);
+        bool live = calendarRolled;
+        calendarRolled = true;
+        if (rolled & (1 << (uint8_t)WaterPeriod::Hour)) {
+            closeBaselineHour(closedHourKey, live);
+        }
+        if (!rolled) {
+            return;
+        }
+        for (uint8_t p = 0; p < WATER_PERIOD_COUNT; p++) {
+            if (!(rolled & (1 << p)) || p == (uint8_t)WaterPeriod::Hour) continue;
+            DLOG_I(LOG_WATER, "New %s period (%lu): previous closed at %llu L",
+                   PeriodAccumulators::name((WaterPeriod)p), (unsigned long)periods.key((WaterPeriod)p),
+                   (unsigned long long)waterMeterMlToLiters(periods.previous((WaterPeriod)p)));
+        }
+        touch();
+        // Hour-only rollovers wait for the periodic save (24 extra flash writes a day otherwise)
+        if (rolled != (1 << (uint8_t)WaterPeriod::Hour)) {
+            saveToStorage();
         }
+    }
+
+    /**
+     * @brief Feed the hour that just closed to the baseline, if it was watched whole
+     *
+     * Skipped: the hour the board booted in, hours caught up at boot, and a
+     * jump over missing hours (power off, DST spring forward) - partial hours
+     * would drag the baseline down.
+     */
+    void closeBaselineHour(uint32_t closedHourKey, bool live) {
+        uint32_t newHourKey = periods.key(WaterPeriod::Hour);
+        bool whole = live && closedHourKey == baselineHourKey && closedHourKey != 0 &&
+                     WeeklyBaseline::hourNumber(newHourKey) == WeeklyBaseline::hourNumber(closedHourKey) + 1;
+        baselineHourKey = live ? newHourKey : 0;
+        if (!whole) {
+            return;
+        }
+        float liters = (float)periods.previous(WaterPeriod::Hour) / 1000.0f;
+        float score = baseline.closeHour(closedHourKey, liters);
+        if (baseline.isAnomaly()) {
+            DLOG_W(LOG_WATER, "Unusual usage %lu: %.0f L (usual %.0f L), score %.1f",
+                   (unsigned long)closedHourKey, liters, baseline.getLastMean(), score);
+        } else {
+            DLOG_D(LOG_WATER, "Hour %lu: %.0f L (usual %.0f L), score %.1f",
+                   (unsigned long)closedHourKey, liters, baseline.getLastMean(), score);
+        }
+    }
+
+    void touch() {
+        stateVersion++;
+    }
+
+    void touchIfFlowChanged() {
+        // Idle meter: flow outputs stay at 0, version (and WebUI cache) stays put
+        float current[4];
+        flowOutputs(current);
+        if (memcmp(current, lastFlowSnapshot, sizeof(current)) != 0) {
+            memcpy(lastFlowSnapshot, current, sizeof(current));
+            touch();
+        }
+    }
 
-        int currentDay = timeinfo.tm_yday;   // Day of year (0-365)
-        int currentYear = timeinfo.tm_year;  // Years since 1900
+    void updateAlarms(uint32_t now) {
+        // 1 min average: a single short interval must not look like a burst
+        float rates[4];
+        flowOutputs(rates);
+        uint8_t changed = leakDetector.update(now, rates[2]);
+        if (changed) {
+            touch();
+            publishSnapshot();  // Alarm subscribers read getData(): it must already carry the flip
+        }
+        if (changed & LeakDetector::CHANGED_LEAK) {
+            publishAlarm(leakDetector.makeAlarm(WaterMeterAlarm::Leak), ch);
+        }
+        if (changed & LeakDetector::CHANGED_BURST) {
+            publishAlarm(leakDetector.makeAlarm(WaterMeterAlarm::Burst), ch);
+        }
+    }
 
-        // Daily reset at midnight (day changed)
-        if (lastDay != -1 && currentDay != lastDay) {
-            DLOG_I(LOG_WATER, "Daily reset triggered (day %d -> %d)", lastDay, currentDay);
-            resetDaily();
+    void publishAlarm(WaterMeterAlarm alarm, uint8_t channel) {
+        alarm.channel = channel;
+        const char* name = alarm.type == WaterMeterAlarm::Leak ? "Leak" : "Burst";
+        if (alarm.active) {
+            DLOG_W(LOG_WATER, "🚨 %s alarm: %lu s, %.2f L/min", name, (unsigned long)alarm.durationS, alarm.flowLpm);
+        } else {
+            DLOG_I(LOG_WATER, "%s alarm cleared", name);
         }
-        lastDay = currentDay;
+        emit("watermeter.alarm", alarm, false);
+    }
+
+    void updateListeners() {
+        EventBus& bus = getCore()->getEventBus();
+        dataListeners = bus.hasSubscribers("watermeter.data");
+        bool pulses = bus.hasSubscribers("watermeter.pulses");
+        if (!pulses) pulseBatch.clear();  // Last subscriber gone: drop the partial batch
+        pulseListeners = pulses;
+    }
+
+    void publishPulseBatch() {
+        emit("watermeter.pulses", pulseBatch.finish(ch), false);
+        pulseBatch.clear();
+    }
 
-        // Yearly reset on January 1st (year changed)
-        if (lastYear != -1 && currentYear != lastYear) {
-            DLOG_I(LOG_WATER, "Yearly reset triggered (year %d -> %d)", lastYear + 1900, currentYear + 1900);
-            resetYearly();
+    /** @brief Current loop() state as one WaterMeterData (loop() task only) */
+    WaterMeterData buildData() const {
+        WaterMeterData data;
+        data.channel = ch;
+        data.pulseCount = pulseCount;
+        data.totalMl = volume.toMl(data.pulseCount);
+        data.dailyMl = periods.current(WaterPeriod::Day);
+        data.yearlyMl = periods.current(WaterPeriod::Year);
+        for (uint8_t p = 0; p < WATER_PERIOD_COUNT; p++) {
+            data.periodMl[p] = periods.current((WaterPeriod)p);
+            data.previousPeriodMl[p] = periods.previous((WaterPeriod)p);
         }
-        lastYear = currentYear;
+        float rates[4];
+        flowOutputs(rates);
+        data.flowRateLpm = rates[0];
+        data.flowRateAvgLpm = rates[1];
+        data.flow1mLpm = rates[2];
+        data.flow15mLpm = rates[3];
+        data.leakAlarm = leakDetector.isLeak();
+        data.burstAlarm = leakDetector.isBurst();
+        data.continuousFlowS = leakDetector.continuousFlowMs() / 1000;
+        data.anomalyScore = baseline.getLastScore();
+        data.usualHourL = baseline.getLastMean();
+        data.anomaly = baseline.isAnomaly();
+        return data;
+    }
+
+    void publishSnapshot() {
+        snapshot.write(buildData());
+        snapshotVersion.store(stateVersion, std::memory_order_release);
+    }
+
+    void publishHistory() {
+        historySnapshot.write(history);
+        historyChanged = false;
+    }
+
+    void publishStats() {
+        MeterStats stats;
+        stats.saves = store.getStats();
+        stats.journal = journal.getStats();
+        stats.baseline = baseline.getStats();
+        statsSnapshot.write(stats);
     }
 
     void publishData() {
-        WaterMeterData data = getData();
+        publishedVersion = stateVersion;
+        WaterMeterData data = snapshot.read();
         emit("watermeter.data", data, false);
         
-        DLOG_D(LOG_WATER, "Total: %.3f m³, Daily: %llu L, Yearly: %.3f m³", 
-               data.totalM3, data.dailyLiters, data.yearlyM3);
+        DLOG_D(LOG_WATER, "Total: %llu L, Daily: %llu L, Yearly: %llu L, Flow: %.2f L/min", 
+               (unsigned long long)data.totalLiters(), (unsigned long long)data.dailyLiters(), (unsigned long long)data.yearlyLiters(), data.flowRateLpm);
     }
 };
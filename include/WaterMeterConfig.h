@@ -6,6 +6,92 @@
 // Water Meter Version
 #define WATER_METER_VERSION "1.0.0"
 
+// ISR -> loop() pulse timestamp queue size (power of two, override with -D)
+#ifndef WATER_METER_PULSE_QUEUE_SIZE
+#define WATER_METER_PULSE_QUEUE_SIZE 64
+#endif
+
+// Maximum number of meters (channels) on one board; ISR state is sized by this
+#ifndef WATER_METER_MAX_CHANNELS
+#define WATER_METER_MAX_CHANNELS 4
+#endif
+
+// Number of rotating storage slots for the packed counter record
+#ifndef WATER_METER_PERSIST_SLOTS
+#define WATER_METER_PERSIST_SLOTS 4
+#endif
+
+// Number of rotating storage slots for the pulse journal written between saves
+#ifndef WATER_METER_JOURNAL_SLOTS
+#define WATER_METER_JOURNAL_SLOTS 4
+#endif
+
+// Edge timing histograms in the ISR (debounce auto-tuning, `edges` command); 0 = compiled out
+#ifndef WATER_METER_EDGE_STATS
+#define WATER_METER_EDGE_STATS 1
+#endif
+
+// Fixed meter resolution in mL per pulse (e.g. 1000, 100, 10); 0 = from litersPerPulse at runtime
+#ifndef WATER_METER_ML_PER_PULSE
+#define WATER_METER_ML_PER_PULSE 0
+#endif
+
+// CPU cycle timing of every ISR run (min/max/histogram, `water stats`); 0 = counters only
+#ifndef WATER_METER_ISR_TIMING
+#define WATER_METER_ISR_TIMING 1
+#endif
+
+// Pulse timestamps per "watermeter.pulses" event (a full batch is emitted at once, max 255)
+#ifndef WATER_METER_PULSE_BATCH_SIZE
+#define WATER_METER_PULSE_BATCH_SIZE 32
+#endif
+
+// Lines buffered for the `water watch` console stream (oldest kept, newest dropped when full)
+#ifndef WATER_METER_WATCH_LINES
+#define WATER_METER_WATCH_LINES 32
+#endif
+
+// Readings kept in RAM while MQTT is down, then spilled to N storage slots of 16 readings each
+#ifndef WATER_METER_BACKLOG_READINGS
+#define WATER_METER_BACKLOG_READINGS 64
+#endif
+#ifndef WATER_METER_BACKLOG_SLOTS
+#define WATER_METER_BACKLOG_SLOTS 16
+#endif
+
+// Full-resolution pulse log on raw flash (data partition label; host builds use RAM of this size)
+#ifndef WATER_METER_PULSE_LOG
+#define WATER_METER_PULSE_LOG 1
+#endif
+#ifndef WATER_METER_PULSE_LOG_PARTITION
+#define WATER_METER_PULSE_LOG_PARTITION "spiffs"
+#endif
+#ifndef WATER_METER_PULSE_LOG_HOST_BYTES
+#define WATER_METER_PULSE_LOG_HOST_BYTES (32 * 4096)
+#endif
+
+// /metrics response buffer (static, one scrape at a time): ~1.5 KB per meter + board metrics
+#ifndef WATER_METER_METRICS_BYTES
+#define WATER_METER_METRICS_BYTES (4096 + WATER_METER_MAX_CHANNELS * 1536)
+#endif
+
+// On-device consumption history: hourly buckets for N days, daily buckets for N days
+#ifndef WATER_METER_HISTORY_HOURLY_DAYS
+#define WATER_METER_HISTORY_HOURLY_DAYS 7
+#endif
+#ifndef WATER_METER_HISTORY_DAILY_DAYS
+#define WATER_METER_HISTORY_DAILY_DAYS 366
+#endif
+
+/**
+ * @brief Pulse acquisition backend (see WaterMeterPulseSource.h)
+ */
+enum class PulseSourceType : uint8_t {
+    Interrupt = 0,  // GPIO CHANGE interrupt + software debounce/stability check (default)
+    Pcnt = 1,       // ESP32 hardware pulse counter, polled (no CPU interrupt per edge)
+    Mock = 2        // Injected pulses (host tests)
+};
+
 /**
  * @brief WaterMeter configuration structure
  * 
@@ -13,24 +99,75 @@
  * All configurable parameters with sensible defaults.
  */
 struct WaterMeterConfig {
+    // Channel (one WaterMeterComponent per physical meter)
+    uint8_t channel = 0;               // 0..WATER_METER_MAX_CHANNELS-1, selects ISR slot and storage keys
+    String channelName = "";           // Label for entities/contexts ("cold", "hot", ...); empty = legacy ids on channel 0
+    
     // Hardware Configuration
     uint8_t pulseInputPin = 34;        // GPIO pin for pulse detection (input-only, interrupt capable)
     uint8_t statusLedPin = 32;         // External LED for status indication (GPIO32: high-Z when ESP32 off)
+    PulseSourceType pulseSource = PulseSourceType::Interrupt;
+    uint32_t pcntPollMs = 50;          // PCNT: counter poll period (timestamp resolution)
+    uint16_t pcntFilterTicks = 1023;   // PCNT: glitch filter in APB cycles (1023 = 12.8 µs, max)
+    
+    // Pulse Task (pulse draining, flow and LED outside loop(), see PulseTask)
+    bool pulseTask = false;            // Dedicated task woken by the ISR instead of the shared loop()
+    uint8_t pulseTaskCore = 0;         // Core it is pinned to (Arduino loop() runs on core 1)
+    uint8_t pulseTaskPriority = 5;     // FreeRTOS priority (loop() 1, async_tcp 3, WiFi 23)
     
     // Water Meter Settings
-    float litersPerPulse = 1.0;        // Volume per pulse in liters
+    float litersPerPulse = 1.0;        // Volume per pulse in liters (rounded to whole mL, see PulseVolume)
     uint32_t pulseDebounceMs = 500;    // Debounce time in milliseconds (for magnetic sensor)
     uint32_t pulseHighStableMs = 150;  // Minimum stable HIGH time required before accepting next pulse
     uint32_t bootInitDelayMs = 3000;   // Boot initialization delay (no pulse counting for 3 seconds)
+    bool autoTuneDebounce = false;     // Adjust the two values above from live edge histograms (ISR source)
+    
+    // Consumption Periods
+    uint8_t billingStartDay = 1;       // Billing cycle starts on this day of month (1-28)
     
     // Timing Configuration
-    uint32_t saveIntervalMs = 30000;   // Save data every 30 seconds
-    uint32_t publishIntervalMs = 5000; // Publish data every 5 seconds
+    uint32_t saveIntervalMs = 300000;  // Full counter snapshot every 5 minutes
+    uint32_t journalFlushMs = 30000;   // Pulse journal flush to flash while water flows (0 = every loop); RTC covers warm resets
+    uint32_t pulseLogFlushMs = 60000;  // Pulse timestamp log: RAM records written at least this often
+    uint32_t publishIntervalMs = 5000; // Min interval between "watermeter.data" events (sent on change only)
+    uint32_t pulseBatchMs = 1000;      // Max age of a "watermeter.pulses" batch (0 = every loop with pulses)
     uint32_t ledFlashMs = 50;          // LED flash duration
     
+    // Flow Rate
+    uint32_t flowZeroTimeoutMs = 120000; // No pulse for this long = zero flow
+    uint32_t flowEwmaTauMs = 30000;      // EWMA time constant for averaged flow rate
+    
+    // Leak / Burst Detection (0 disables a check)
+    uint32_t leakGapMinutes = 120;       // A quiet period this long means "water stopped"
+    uint32_t leakWindowHours = 24;       // No such quiet period for this long = leak alarm
+    float burstFlowLpm = 20.0;           // Flow above this...
+    uint32_t burstMinutes = 30;          // ...for this long = burst alarm
+    
+    // Usage Anomaly (hour-of-week baseline, see WeeklyBaseline)
+    uint8_t anomalyWindowWeeks = 8;      // Weeks each hour-of-week baseline follows (older weeks fade out)
+    uint8_t anomalyMinWeeks = 3;         // Samples an hour-of-week needs before its hours are scored
+    float anomalyMinSigmaL = 5.0;        // Standard deviation floor (liters): a few liters in a quiet hour is not news
+    float anomalyThreshold = 4.0;        // Score (deviations above the usual) that flags an hour (0 = never)
+    
+    // Home Assistant Publishing (change-driven, see PublishPolicy)
+    uint32_t haActiveIntervalMs = 5000;  // Check for changes every 5 s while water flows
+    uint32_t haIdleIntervalMs = 60000;   // Check every 60 s when idle
+    uint32_t haHeartbeatMs = 900000;     // Republish unchanged values every 15 min
+    float haVolumeThresholdL = 1.0;      // Min volume change (liters) worth publishing
+    float haFlowThresholdLpm = 0.2;      // Min flow rate change (L/min) worth publishing
+    uint8_t haBurstMessages = 20;        // Max messages in a burst
+    uint16_t haMessagesPerMinute = 60;   // Sustained message rate limit
+    bool haDiagnostics = false;          // Also expose ISR counters/timing as HA diagnostic sensors
+    
+    // Offline Buffering (readings taken while MQTT is down, replayed on reconnect, see BacklogStore)
+    uint32_t backlogIntervalMs = 60000;  // One reading per meter this often while offline (0 = off)
+    uint8_t backlogBatch = 10;           // Readings per replayed MQTT message
+    uint32_t backlogReplayMs = 1000;     // Min interval between replayed messages
+    
     // Feature Flags
     bool enabled = true;               // Enable/disable component
     bool enableLed = true;             // Enable/disable LED feedback
+    bool enableJournal = true;         // Journal pulses between snapshots (RTC memory + flash)
 };
 
 // Water Meter specific log tags
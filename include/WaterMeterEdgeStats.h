@@ -0,0 +1,231 @@
+#ifndef WATER_METER_EDGE_STATS_H
+#define WATER_METER_EDGE_STATS_H
+
+#include <Arduino.h>
+#include <math.h>
+#include "WaterMeterConfig.h"
+
+/**
+ * @brief Log-scaled histogram of edge timings (ISR side: one increment)
+ *
+ * Two bins per octave from 64 µs: bin 0 = below 64 µs, bin b covers
+ * [binLowerUs(b), binLowerUs(b + 1)), the last bin everything from
+ * ~537 s up (long idle periods, micros() wrap). Resolution is ±25%, enough
+ * to separate ms contact bounce from 100 ms+ magnet dwell times.
+ *
+ * record() is forced inline so it ends up inside the IRAM ISR body.
+ * Counts are plain 32-bit increments from one ISR: loop() readers may see a
+ * count one edge behind, which is irrelevant for statistics.
+ */
+struct EdgeHistogram {
+    static constexpr uint8_t BINS = 48;
+    static constexpr uint8_t FIRST_OCTAVE = 6;  // 2^6 = 64 µs
+    static constexpr uint32_t TOP_MS = (1UL << (FIRST_OCTAVE + (BINS - 2) / 2)) / 1000;  // Top bin start in ms
+
+    volatile uint32_t bins[BINS];
+
+    static inline __attribute__((always_inline)) uint8_t binFor(uint32_t us) {
+        if (us < (1UL << FIRST_OCTAVE)) return 0;
+        uint32_t octave = 31 - __builtin_clz(us);
+        uint32_t bin = 1 + (octave - FIRST_OCTAVE) * 2 + ((us >> (octave - 1)) & 1);
+        return bin < BINS ? (uint8_t)bin : BINS - 1;
+    }
+
+    /**
+     * @brief Account one interval (µs and ms of the same interval: the µs
+     * difference wraps after 71 min, the ms one routes long gaps to the top bin)
+     */
+    inline __attribute__((always_inline)) void record(uint32_t us, uint32_t ms) {
+        bins[ms >= TOP_MS ? BINS - 1 : binFor(us)]++;
+    }
+
+    /** @brief Lower bound of a bin in µs (0 for bin 0) */
+    static uint32_t binLowerUs(uint8_t bin) {
+        if (bin == 0) return 0;
+        uint32_t octave = FIRST_OCTAVE + (bin - 1) / 2;
+        return (1UL << octave) + (((bin - 1) & 1) ? (1UL << (octave - 1)) : 0);
+    }
+
+    /** @brief Upper bound of a bin in µs (UINT32_MAX for the top bin) */
+    static uint32_t binUpperUs(uint8_t bin) {
+        return bin + 1 < BINS ? binLowerUs(bin + 1) : UINT32_MAX;
+    }
+
+    uint32_t total() const {
+        uint32_t sum = 0;
+        for (uint8_t b = 0; b < BINS; b++) sum += bins[b];
+        return sum;
+    }
+
+    void clear() {
+        for (uint8_t b = 0; b < BINS; b++) bins[b] = 0;
+    }
+};
+
+/**
+ * @brief Per-channel edge timing statistics fed by waterMeterPulseISR()
+ *
+ * - fallInterval: falling to falling edge, every edge (bounce trains, glitches)
+ * - pulseInterval: time since the last accepted pulse, for falling edges
+ *   that passed the HIGH-stability check (exactly what pulseDebounceMs
+ *   decides on, rejected ones included)
+ * - lowTime: LOW duration, measured at the rising edge (idle, no magnet)
+ * - highTime: HIGH duration, measured at the falling edge (what
+ *   pulseHighStableMs decides on: bounce spikes vs magnet dwell)
+ */
+struct EdgeStats {
+    EdgeHistogram fallInterval;
+    EdgeHistogram pulseInterval;
+    EdgeHistogram lowTime;
+    EdgeHistogram highTime;
+    volatile uint32_t accepted;      // Falling edges counted as pulses since clear()
+    volatile uint32_t lastFallUs;
+    volatile uint32_t lastFallMs;
+    volatile uint32_t lastRiseUs;
+    volatile uint32_t lastPulseUs;
+
+    /** @brief Restart collection; edge times start at nowUs/nowMs */
+    void clear(uint32_t nowUs, uint32_t nowMs) {
+        fallInterval.clear();
+        pulseInterval.clear();
+        lowTime.clear();
+        highTime.clear();
+        accepted = 0;
+        lastFallUs = lastRiseUs = lastPulseUs = nowUs;
+        lastFallMs = nowMs;
+    }
+};
+
+/**
+ * @brief Picks pulseDebounceMs / pulseHighStableMs from EdgeStats
+ *
+ * Both values are put in the middle (geometric mean, the histograms are
+ * log-scaled) of the gap between a noise class and a real class:
+ * - stability, from highTime: the `accepted` longest HIGH periods are the
+ *   magnet dwells of counted pulses, everything shorter is bounce/glitch.
+ *   Noise = 99th percentile below that rank, real = 1st percentile above.
+ * - debounce, from pulseInterval: those edges already passed the stability
+ *   check, so they are taken as real unless the histogram shows a valley
+ *   (Otsu's threshold over bin indices, classes SEPARATION apart). Without
+ *   a valley the debounce becomes half the shortest (1st percentile)
+ *   interval: it lets through every pulse seen so far, including those the
+ *   current debounce rejects at high flow.
+ * A proposal is only made after MIN_PULSES accepted pulses, when the classes
+ * are SEPARATION apart, the value lies within [MIN, MAX] for that parameter,
+ * and at least as many samples lie above it as pulses were accepted (the new
+ * value would not have rejected a pulse counted so far).
+ */
+class DebounceTuner {
+public:
+    static constexpr uint32_t MIN_PULSES = 100;
+    static constexpr float SEPARATION = 2.0f;
+    static constexpr uint32_t DEBOUNCE_MIN_MS = 10;
+    static constexpr uint32_t DEBOUNCE_MAX_MS = 2000;
+    static constexpr uint32_t STABLE_MIN_MS = 5;
+    static constexpr uint32_t STABLE_MAX_MS = 500;
+
+    struct Split {
+        bool valid = false;
+        uint32_t noiseUs = 0;     // Noise class 99th percentile (bin upper bound, 0 = no noise)
+        uint32_t realUs = 0;      // Real class 1st percentile (bin lower bound)
+        uint32_t thresholdMs = 0;
+    };
+
+    struct Result {
+        Split debounce;   // From pulseInterval
+        Split stable;     // From highTime
+        uint32_t accepted = 0;
+    };
+
+    static Result evaluate(const EdgeStats& stats) {
+        Result r;
+        r.accepted = stats.accepted;
+        if (r.accepted < MIN_PULSES) return r;
+
+        uint32_t counts[EdgeHistogram::BINS];
+        uint32_t total = snapshot(stats.highTime, counts);
+        if (total >= r.accepted) {
+            uint32_t noise = total - r.accepted;
+            r.stable.realUs = EdgeHistogram::binLowerUs(rankBin(counts, noise + r.accepted / 100));
+            r.stable.noiseUs = noise ? EdgeHistogram::binUpperUs(rankBin(counts, noise * 99 / 100)) : 0;
+            finish(r.stable, counts, r.accepted, STABLE_MIN_MS, STABLE_MAX_MS);
+        }
+
+        total = snapshot(stats.pulseInterval, counts);
+        if (total >= r.accepted) {
+            uint8_t k = otsu(counts, total);
+            if (k > 0) {
+                uint32_t below = 0;
+                for (uint8_t b = 0; b < k; b++) below += counts[b];
+                r.debounce.noiseUs = EdgeHistogram::binUpperUs(rankBin(counts, below * 99 / 100));
+                r.debounce.realUs = EdgeHistogram::binLowerUs(rankBin(counts, below + (total - below) / 100));
+            }
+            if (k == 0 || (float)r.debounce.realUs < SEPARATION * (float)r.debounce.noiseUs) {
+                r.debounce.noiseUs = 0;  // No valley: all stable edges are pulses
+                r.debounce.realUs = EdgeHistogram::binLowerUs(rankBin(counts, total / 100));
+            }
+            finish(r.debounce, counts, r.accepted, DEBOUNCE_MIN_MS, DEBOUNCE_MAX_MS);
+        }
+        return r;
+    }
+
+private:
+    static uint32_t snapshot(const EdgeHistogram& h, uint32_t* counts) {
+        uint32_t total = 0;
+        for (uint8_t b = 0; b < EdgeHistogram::BINS; b++) {
+            counts[b] = h.bins[b];
+            total += counts[b];
+        }
+        return total;
+    }
+
+    /** @brief Bin holding the sample of 0-based rank `rank` (ascending) */
+    static uint8_t rankBin(const uint32_t* counts, uint32_t rank) {
+        uint32_t seen = 0;
+        for (uint8_t b = 0; b < EdgeHistogram::BINS; b++) {
+            seen += counts[b];
+            if (seen > rank) return b;
+        }
+        return EdgeHistogram::BINS - 1;
+    }
+
+    /** @brief Otsu boundary k (class 0 = bins < k), 0 if fewer than two populated bins */
+    static uint8_t otsu(const uint32_t* counts, uint32_t total) {
+        float weighted = 0;
+        for (uint8_t b = 0; b < EdgeHistogram::BINS; b++) weighted += (float)b * counts[b];
+        uint8_t best = 0;
+        float bestVar = 0, w0 = 0, sum0 = 0;
+        for (uint8_t k = 1; k < EdgeHistogram::BINS; k++) {
+            w0 += counts[k - 1];
+            sum0 += (float)(k - 1) * counts[k - 1];
+            float w1 = (float)total - w0;
+            if (w0 == 0 || w1 == 0) continue;
+            float diff = sum0 / w0 - (weighted - sum0) / w1;
+            float var = w0 * w1 * diff * diff;
+            if (var > bestVar) {
+                bestVar = var;
+                best = k;
+            }
+        }
+        return best;
+    }
+
+    /** @brief Threshold in the valley + safety checks */
+    static void finish(Split& s, const uint32_t* counts, uint32_t accepted, uint32_t minMs, uint32_t maxMs) {
+        if (s.noiseUs && (float)s.realUs < SEPARATION * (float)s.noiseUs) return;
+        uint32_t thresholdUs = s.noiseUs ? (uint32_t)sqrtf((float)s.noiseUs * (float)s.realUs) : s.realUs / 2;
+        s.thresholdMs = (thresholdUs + 999) / 1000;
+        if (s.thresholdMs < minMs) s.thresholdMs = minMs;
+        if (s.thresholdMs > maxMs) return;
+
+        // Samples that would pass the new threshold (bins fully above it)
+        uint32_t above = 0;
+        for (uint8_t b = EdgeHistogram::BINS; b-- > 0;) {
+            if (EdgeHistogram::binLowerUs(b) < s.thresholdMs * 1000) break;
+            above += counts[b];
+        }
+        s.valid = above >= accepted;
+    }
+};
+
+#endif // WATER_METER_EDGE_STATS_H
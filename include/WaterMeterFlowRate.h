@@ -0,0 +1,171 @@
+#ifndef WATER_METER_FLOW_RATE_H
+#define WATER_METER_FLOW_RATE_H
+
+#include <Arduino.h>
+#include <math.h>
+
+/**
+ * @brief Fixed-memory sliding pulse counter (Buckets x BucketMs window)
+ *
+ * The window slides one bucket at a time; the current (partial) bucket is
+ * included, so the window covers between (Buckets-1) and Buckets periods.
+ * coveredMs() returns the span actually covered so averages are not biased
+ * low by the partial bucket (or right after reset).
+ */
+template <uint8_t Buckets, uint32_t BucketMs>
+class PulseWindow {
+public:
+    void add(uint32_t pulses, uint32_t nowMs) {
+        roll(nowMs);
+        counts[index] += pulses;
+        total += pulses;
+    }
+
+    void roll(uint32_t nowMs) {
+        lastNowMs = nowMs;
+        uint32_t elapsed = (nowMs - bucketStartMs) / BucketMs;
+        if (elapsed == 0) return;
+        if (elapsed > Buckets) elapsed = Buckets;
+        for (uint32_t i = 0; i < elapsed; i++) {
+            index = (index + 1) % Buckets;
+            total -= counts[index];
+            counts[index] = 0;
+        }
+        bucketStartMs = nowMs - (nowMs - bucketStartMs) % BucketMs;
+    }
+
+    void reset(uint32_t nowMs) {
+        for (uint8_t i = 0; i < Buckets; i++) counts[i] = 0;
+        total = 0;
+        index = 0;
+        bucketStartMs = nowMs;
+        lastNowMs = nowMs;
+        startMs = nowMs;
+    }
+
+    uint32_t pulses() const { return total; }
+
+    uint32_t coveredMs() const {
+        uint32_t span = (uint32_t)(Buckets - 1) * BucketMs + (lastNowMs - bucketStartMs);
+        uint32_t sinceReset = lastNowMs - startMs;
+        if (sinceReset < span) span = sinceReset;
+        return span < BucketMs ? BucketMs : span;
+    }
+
+private:
+    uint32_t counts[Buckets] = {};
+    uint32_t total = 0;
+    uint8_t index = 0;
+    uint32_t bucketStartMs = 0;
+    uint32_t lastNowMs = 0;
+    uint32_t startMs = 0;
+};
+
+/**
+ * @brief Flow rate engine (L/min) fed by drained pulse timestamps
+ *
+ * - Instantaneous: litersPerPulse / last inter-pulse interval. While no pulse
+ *   arrives the rate decays as litersPerPulse / time-since-last-pulse (the
+ *   flow cannot be higher than that), and drops to 0 after zeroFlowTimeoutMs.
+ * - EWMA: time-constant based exponential average of the instantaneous rate.
+ * - 1 min / 15 min: pulse counts over sliding bucketed windows.
+ *
+ * Constant memory, no allocation. update() is meant to be called at a low
+ * cadence (~1 s) from loop(); onPulse() once per drained pulse.
+ */
+class FlowRateEstimator {
+public:
+    void configure(float litersPerPulse, uint32_t zeroFlowTimeoutMs, uint32_t ewmaTauMs) {
+        lpp = litersPerPulse;
+        zeroTimeoutMs = zeroFlowTimeoutMs;
+        tauMs = ewmaTauMs ? ewmaTauMs : 1;
+    }
+
+    void reset(uint32_t nowMs) {
+        window1m.reset(nowMs);
+        window15m.reset(nowMs);
+        instant = 0;
+        ewma = 0;
+        lastIntervalMs = 0;
+        hasLastPulse = false;
+        lastUpdateMs = nowMs;
+    }
+
+    /**
+     * @brief Account one pulse
+     * @param intervalUs Time since previous pulse (0 = unknown, e.g. first pulse or queue overflow)
+     */
+    void onPulse(uint32_t intervalUs, uint32_t nowMs) {
+        window1m.add(1, nowMs);
+        window15m.add(1, nowMs);
+
+        uint32_t intervalMs = intervalUs / 1000;
+        if (intervalUs > 0 && intervalMs < zeroTimeoutMs) {
+            instant = lpp * 60000000.0f / (float)intervalUs;
+            lastIntervalMs = intervalMs ? intervalMs : 1;
+        } else {
+            lastIntervalMs = 0;  // Flow (re)starting - rate known from next pulse
+        }
+        lastPulseMs = nowMs;
+        hasLastPulse = true;
+    }
+
+    /**
+     * @brief Account pulses without timing (ISR queue overflow)
+     */
+    void onUntimedPulses(uint32_t pulses, uint32_t nowMs) {
+        window1m.add(pulses, nowMs);
+        window15m.add(pulses, nowMs);
+        lastPulseMs = nowMs;
+        hasLastPulse = true;
+    }
+
+    /**
+     * @brief Zero-flow decay, EWMA step and window roll
+     */
+    void update(uint32_t nowMs) {
+        window1m.roll(nowMs);
+        window15m.roll(nowMs);
+
+        if (hasLastPulse) {
+            uint32_t sinceLast = nowMs - lastPulseMs;
+            if (sinceLast >= zeroTimeoutMs) {
+                instant = 0;
+                hasLastPulse = false;
+            } else if (lastIntervalMs && sinceLast > lastIntervalMs) {
+                instant = lpp * 60000.0f / (float)sinceLast;
+            }
+        }
+
+        uint32_t dt = nowMs - lastUpdateMs;
+        lastUpdateMs = nowMs;
+        float alpha = 1.0f - expf(-(float)dt / (float)tauMs);
+        ewma += alpha * (instant - ewma);
+        if (ewma < 0.001f) ewma = 0;
+    }
+
+    float instantLpm() const { return instant; }
+    float ewmaLpm() const { return ewma; }
+    float avg1mLpm() const { return window1m.pulses() * lpp * 60000.0f / window1m.coveredMs(); }
+    float avg15mLpm() const { return window15m.pulses() * lpp * 60000.0f / window15m.coveredMs(); }
+
+private:
+    typedef PulseWindow<6, 10000> Window1m;    // 6 x 10 s
+    typedef PulseWindow<15, 60000> Window15m;  // 15 x 1 min
+
+    float lpp = 1.0f;
+    uint32_t zeroTimeoutMs = 120000;
+    uint32_t tauMs = 30000;
+
+    float instant = 0;
+    float ewma = 0;
+    uint32_t lastIntervalMs = 0;
+    uint32_t lastPulseMs = 0;
+    uint32_t lastUpdateMs = 0;
+    bool hasLastPulse = false;
+
+    Window1m window1m;
+    Window15m window15m;
+};
+
+#endif // WATER_METER_FLOW_RATE_H
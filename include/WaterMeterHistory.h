@@ -0,0 +1,407 @@
+#ifndef WATER_METER_HISTORY_H
+#define WATER_METER_HISTORY_H
+
+#include <Arduino.h>
+#include <DomoticsCore/Storage.h>
+#include <stdarg.h>
+#include <string.h>
+#include "WaterMeterConfig.h"
+
+/**
+ * @brief On-device consumption history (hourly for N days, daily for a year)
+ *
+ * Layout (fixed, no allocation):
+ * - hourly: WATER_METER_HISTORY_HOURLY_DAYS rows of 24 x uint16_t liters,
+ *   each row tagged with its day number (days since 1970-01-01, local date)
+ * - daily:  WATER_METER_HISTORY_DAILY_DAYS x uint16_t liters, slot = day % N
+ * Buckets saturate at 65535 L.
+ *
+ * Persistence is incremental: each hourly row and each DAILY_CHUNK-day slice
+ * of the daily ring is its own Storage blob, and only slices touched since
+ * the last flush are written (normally one hourly row + one daily chunk).
+ *
+ * loop() task only: readers on other tasks (async web server) get the
+ * copy WaterMeterComponent::getHistory() publishes through a SeqLock.
+ */
+class ConsumptionHistory {
+public:
+    static constexpr uint16_t HOURLY_DAYS = WATER_METER_HISTORY_HOURLY_DAYS;
+    static constexpr uint16_t DAILY_DAYS = WATER_METER_HISTORY_DAILY_DAYS;
+    static constexpr uint16_t DAILY_CHUNK = 30;
+    static constexpr uint16_t DAILY_CHUNKS = (DAILY_DAYS + DAILY_CHUNK - 1) / DAILY_CHUNK;
+    static constexpr int32_t NO_DAY = INT32_MIN;
+
+    static_assert(HOURLY_DAYS <= 32, "hourly dirty mask is 32 bits");
+    static_assert(DAILY_CHUNKS <= 32, "daily dirty mask is 32 bits");
+
+    ConsumptionHistory() {
+        for (uint16_t row = 0; row < HOURLY_DAYS; row++) rowDay[row] = NO_DAY;
+    }
+
+    /** @brief Storage + channel (0 = legacy "wm_*" keys, N = "wmN_*") */
+    void attach(DomoticsCore::Components::StorageComponent* s, uint8_t ch = 0) {
+        storage = s;
+        channel = ch;
+    }
+
+    /**
+     * @brief Move the write cursor to a local day/hour (from CalendarScheduler)
+     *
+     * Advancing the day clears the daily slots of skipped days and recycles
+     * the oldest hourly row. Liters recorded before the first valid time are
+     * credited to the first cursor position.
+     */
+    void setCursor(uint32_t dayKey, uint8_t hour) {
+        int32_t day = dayNumber(dayKey);
+        if (currentDay == NO_DAY) {
+            currentDay = day;  // Fresh ring, already zeroed
+        } else if (day > currentDay) {
+            int32_t from = (day - currentDay > DAILY_DAYS) ? day - DAILY_DAYS + 1 : currentDay + 1;
+            for (int32_t d = from; d <= day; d++) {
+                uint16_t slot = dailySlot(d);
+                daily[slot] = 0;
+                dailyDirty |= 1UL << (slot / DAILY_CHUNK);
+            }
+            currentDay = day;
+        }
+
+        uint16_t row = hourlyRow(day);
+        if (rowDay[row] != day) {
+            rowDay[row] = day;
+            memset(hourly[row], 0, sizeof(hourly[row]));
+            hourlyDirty |= 1UL << row;
+        }
+
+        cursorDay = day;
+        cursorHour = hour < 24 ? hour : 23;
+
+        if (pendingLiters) {
+            uint32_t pending = pendingLiters;
+            pendingLiters = 0;
+            add(pending);
+        }
+    }
+
+    /** @brief Credit liters to the current hour and day */
+    void add(uint32_t liters) {
+        if (cursorDay == NO_DAY) {
+            pendingLiters += liters;
+            return;
+        }
+        // Cursor may lag behind currentDay if the clock stepped back: drop what is out of range
+        if (currentDay - cursorDay >= DAILY_DAYS) return;
+
+        uint16_t slot = dailySlot(cursorDay);
+        daily[slot] = saturatingAdd(daily[slot], liters);
+        dailyDirty |= 1UL << (slot / DAILY_CHUNK);
+
+        uint16_t row = hourlyRow(cursorDay);
+        if (rowDay[row] == cursorDay) {
+            hourly[row][cursorHour] = saturatingAdd(hourly[row][cursorHour], liters);
+            hourlyDirty |= 1UL << row;
+        }
+    }
+
+    /** @brief Liters for a day's hour (0 if not in the hourly window) */
+    uint16_t hourlyLiters(int32_t day, uint8_t hour) const {
+        uint16_t row = hourlyRow(day);
+        return (rowDay[row] == day && hour < 24) ? hourly[row][hour] : 0;
+    }
+
+    bool hasHourly(int32_t day) const { return day != NO_DAY && rowDay[hourlyRow(day)] == day; }
+
+    /** @brief Liters for a day (0 if older than the daily window) */
+    uint16_t dailyLiters(int32_t day) const {
+        if (currentDay == NO_DAY || day > currentDay || currentDay - day >= DAILY_DAYS) return 0;
+        return daily[dailySlot(day)];
+    }
+
+    int32_t getCurrentDay() const { return currentDay; }
+    uint32_t getWrites() const { return writes; }
+
+    /**
+     * @brief Write dirty rows/chunks
+     * @return Number of blobs written
+     */
+    uint8_t flush() {
+        if (!storage) return 0;
+        uint8_t written = 0;
+
+        for (uint16_t row = 0; row < HOURLY_DAYS && hourlyDirty; row++) {
+            if (!(hourlyDirty & (1UL << row))) continue;
+            HourlyBlob blob;
+            blob.day = rowDay[row];
+            memcpy(blob.liters, hourly[row], sizeof(blob.liters));
+            if (storage->putBlob(key('h', row), reinterpret_cast<const uint8_t*>(&blob), sizeof(blob))) {
+                hourlyDirty &= ~(1UL << row);
+                written++;
+            }
+        }
+
+        for (uint16_t chunk = 0; chunk < DAILY_CHUNKS && dailyDirty; chunk++) {
+            if (!(dailyDirty & (1UL << chunk))) continue;
+            DailyBlob blob;
+            blob.lastDay = currentDay;
+            memset(blob.liters, 0, sizeof(blob.liters));
+            uint16_t first = chunk * DAILY_CHUNK;
+            uint16_t count = (first + DAILY_CHUNK <= DAILY_DAYS) ? DAILY_CHUNK : DAILY_DAYS - first;
+            memcpy(blob.liters, &daily[first], count * sizeof(uint16_t));
+            if (storage->putBlob(key('d', chunk), reinterpret_cast<const uint8_t*>(&blob), sizeof(blob))) {
+                dailyDirty &= ~(1UL << chunk);
+                written++;
+            }
+        }
+
+        writes += written;
+        return written;
+    }
+
+    void load() {
+        if (!storage) return;
+
+        for (uint16_t row = 0; row < HOURLY_DAYS; row++) {
+            HourlyBlob blob;
+            if (storage->getBlob(key('h', row), reinterpret_cast<uint8_t*>(&blob), sizeof(blob)) == sizeof(blob) &&
+                hourlyRow(blob.day) == row) {
+                rowDay[row] = blob.day;
+                memcpy(hourly[row], blob.liters, sizeof(blob.liters));
+            }
+        }
+
+        int32_t chunkLastDay[DAILY_CHUNKS];
+        for (uint16_t chunk = 0; chunk < DAILY_CHUNKS; chunk++) {
+            DailyBlob blob;
+            chunkLastDay[chunk] = NO_DAY;
+            if (storage->getBlob(key('d', chunk), reinterpret_cast<uint8_t*>(&blob), sizeof(blob)) != sizeof(blob)) {
+                continue;
+            }
+            uint16_t first = chunk * DAILY_CHUNK;
+            uint16_t count = (first + DAILY_CHUNK <= DAILY_DAYS) ? DAILY_CHUNK : DAILY_DAYS - first;
+            memcpy(&daily[first], blob.liters, count * sizeof(uint16_t));
+            chunkLastDay[chunk] = blob.lastDay;
+            if (currentDay == NO_DAY || blob.lastDay > currentDay) currentDay = blob.lastDay;
+        }
+        if (currentDay == NO_DAY) return;
+
+        // A chunk saved before later day advances may still hold values of
+        // days that were cleared in RAM but not flushed before power loss
+        for (uint16_t chunk = 0; chunk < DAILY_CHUNKS; chunk++) {
+            int32_t from = chunkLastDay[chunk] == NO_DAY ? currentDay - DAILY_DAYS + 1 : chunkLastDay[chunk] + 1;
+            if (from < currentDay - DAILY_DAYS + 1) from = currentDay - DAILY_DAYS + 1;
+            for (int32_t d = from; d <= currentDay; d++) {
+                uint16_t slot = dailySlot(d);
+                if (slot / DAILY_CHUNK == chunk) daily[slot] = 0;
+            }
+        }
+    }
+
+    /** @brief Days since 1970-01-01 for a YYYYMMDD key (proleptic Gregorian) */
+    static int32_t dayNumber(uint32_t dayKey) {
+        int32_t y = (int32_t)(dayKey / 10000);
+        uint32_t m = (dayKey / 100) % 100;
+        uint32_t d = dayKey % 100;
+        y -= m <= 2;
+        int32_t era = (y >= 0 ? y : y - 399) / 400;
+        uint32_t yoe = (uint32_t)(y - era * 400);
+        uint32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+        uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + (int32_t)doe - 719468;
+    }
+
+    /** @brief Inverse of dayNumber() */
+    static uint32_t dayKeyOf(int32_t day) {
+        int32_t z = day + 719468;
+        int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+        uint32_t doe = (uint32_t)(z - era * 146097);
+        uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        int32_t y = (int32_t)yoe + era * 400;
+        uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        uint32_t mp = (5 * doy + 2) / 153;
+        uint32_t d = doy - (153 * mp + 2) / 5 + 1;
+        uint32_t m = mp < 10 ? mp + 3 : mp - 9;
+        y += m <= 2;
+        return (uint32_t)y * 10000 + m * 100 + d;
+    }
+
+private:
+    struct __attribute__((packed)) HourlyBlob {
+        int32_t day;
+        uint16_t liters[24];
+    };
+    struct __attribute__((packed)) DailyBlob {
+        int32_t lastDay;  // currentDay when written (stale-slot detection on load)
+        uint16_t liters[DAILY_CHUNK];
+    };
+
+    static uint16_t hourlyRow(int32_t day) { return (uint16_t)(((day % HOURLY_DAYS) + HOURLY_DAYS) % HOURLY_DAYS); }
+    static uint16_t dailySlot(int32_t day) { return (uint16_t)(((day % DAILY_DAYS) + DAILY_DAYS) % DAILY_DAYS); }
+
+    static uint16_t saturatingAdd(uint16_t a, uint32_t b) {
+        uint32_t sum = (uint32_t)a + b;
+        return sum > 0xFFFF ? 0xFFFF : (uint16_t)sum;
+    }
+
+    String key(char kind, uint16_t index) const {
+        char buf[14];
+        if (channel == 0) {
+            snprintf(buf, sizeof(buf), "wm_%c%u", kind, (unsigned)index);
+        } else {
+            snprintf(buf, sizeof(buf), "wm%u_%c%u", (unsigned)channel, kind, (unsigned)index);
+        }
+        return String(buf);
+    }
+
+    DomoticsCore::Components::StorageComponent* storage = nullptr;
+    uint8_t channel = 0;
+
+    uint16_t hourly[HOURLY_DAYS][24] = {};
+    int32_t rowDay[HOURLY_DAYS];
+    uint16_t daily[DAILY_DAYS] = {};
+
+    int32_t currentDay = NO_DAY;   // Newest day seen (daily ring head)
+    int32_t cursorDay = NO_DAY;    // Day being written
+    uint8_t cursorHour = 0;
+    uint32_t pendingLiters = 0;    // Recorded before first valid time
+
+    uint32_t hourlyDirty = 0;      // Bit per hourly row
+    uint32_t dailyDirty = 0;       // Bit per daily chunk
+    uint32_t writes = 0;
+};
+
+/**
+ * @brief Pull-based JSON renderer for ConsumptionHistory
+ *
+ * Produces the document piece by piece into caller buffers, matching the
+ * AsyncWebServer chunked-response callback, so the response never exists as
+ * one String/JsonDocument in heap:
+ *
+ *   {"today":"2026-10-16","hourly":[{"date":"2026-10-16","liters":[0,12,...]},...],
+ *    "daily":[{"date":"2026-10-16","liters":240},...]}
+ *
+ * Both arrays are newest first. Only days inside each window are listed.
+ */
+class HistoryJsonWriter {
+public:
+    HistoryJsonWriter(const ConsumptionHistory& h, uint16_t dailyDays = ConsumptionHistory::DAILY_DAYS)
+        : history(h),
+          dailyCount(dailyDays < ConsumptionHistory::DAILY_DAYS ? dailyDays : ConsumptionHistory::DAILY_DAYS) {}
+
+    /**
+     * @brief Fill up to maxLen bytes of the document
+     * @return Bytes written, 0 when the document is complete
+     */
+    size_t read(uint8_t* out, size_t maxLen) {
+        size_t total = 0;
+        while (total < maxLen) {
+            if (pos == len && !renderNext()) break;
+            size_t n = len - pos;
+            if (n > maxLen - total) n = maxLen - total;
+            memcpy(out + total, scratch + pos, n);
+            pos += n;
+            total += n;
+        }
+        return total;
+    }
+
+private:
+    enum class Stage : uint8_t { Header, Hourly, DailyOpen, Daily, Footer, Done };
+
+    bool renderNext() {
+        pos = 0;
+        len = 0;
+        int32_t today = history.getCurrentDay();
+        char date[16];
+
+        switch (stage) {
+            case Stage::Header:
+                if (today == ConsumptionHistory::NO_DAY) {
+                    append("{\"today\":null,\"hourly\":[");
+                } else {
+                    formatDate(today, date);
+                    append("{\"today\":\"%s\",\"hourly\":[", date);
+                }
+                stage = Stage::Hourly;
+                index = 0;
+                return true;
+
+            case Stage::Hourly:
+                // Skip days without a valid hourly row
+                while (index < ConsumptionHistory::HOURLY_DAYS &&
+                       (today == ConsumptionHistory::NO_DAY || !history.hasHourly(today - (int32_t)index))) {
+                    index++;
+                }
+                if (index >= ConsumptionHistory::HOURLY_DAYS) {
+                    stage = Stage::DailyOpen;
+                    return renderNext();
+                }
+                {
+                    int32_t day = today - (int32_t)index;
+                    formatDate(day, date);
+                    append("%s{\"date\":\"%s\",\"liters\":[", first ? "" : ",", date);
+                    for (uint8_t h = 0; h < 24; h++) {
+                        append(h ? ",%u" : "%u", (unsigned)history.hourlyLiters(day, h));
+                    }
+                    append("]}");
+                    first = false;
+                    index++;
+                }
+                return true;
+
+            case Stage::DailyOpen:
+                append("],\"daily\":[");
+                stage = Stage::Daily;
+                index = 0;
+                first = true;
+                return true;
+
+            case Stage::Daily:
+                if (today == ConsumptionHistory::NO_DAY || index >= dailyCount) {
+                    stage = Stage::Footer;
+                    return renderNext();
+                }
+                // Several days per chunk keeps callback count low
+                for (uint8_t i = 0; i < 8 && index < dailyCount; i++, index++) {
+                    int32_t day = today - (int32_t)index;
+                    formatDate(day, date);
+                    append("%s{\"date\":\"%s\",\"liters\":%u}", first ? "" : ",", date,
+                           (unsigned)history.dailyLiters(day));
+                    first = false;
+                }
+                return true;
+
+            case Stage::Footer:
+                append("]}");
+                stage = Stage::Done;
+                return true;
+
+            case Stage::Done:
+                return false;
+        }
+        return false;
+    }
+
+    void append(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(scratch + len, sizeof(scratch) - len, fmt, args);
+        va_end(args);
+        if (n > 0) len += ((size_t)n < sizeof(scratch) - len) ? (size_t)n : sizeof(scratch) - len - 1;
+    }
+
+    static void formatDate(int32_t day, char* out) {
+        uint32_t key = ConsumptionHistory::dayKeyOf(day);
+        snprintf(out, 16, "%04lu-%02lu-%02lu", (unsigned long)(key / 10000),
+                 (unsigned long)((key / 100) % 100), (unsigned long)(key % 100));
+    }
+
+    ConsumptionHistory history;  // Own copy: the response outlives many loop() updates
+    uint16_t dailyCount;
+    Stage stage = Stage::Header;
+    uint16_t index = 0;
+    bool first = true;
+    char scratch[384];
+    size_t pos = 0;
+    size_t len = 0;
+};
+
+#endif // WATER_METER_HISTORY_H
@@ -0,0 +1,90 @@
+#ifndef WATER_METER_ISR_STATS_H
+#define WATER_METER_ISR_STATS_H
+
+#include <Arduino.h>
+#include "WaterMeterConfig.h"
+
+/**
+ * @brief Per-channel pulse acquisition counters and ISR execution time
+ *
+ * Written by exactly one producer per channel (the channel's ISR, or
+ * service() for polled backends), read by loop(): plain 32-bit stores, so
+ * every counter is consistent on its own (no lock needed); a reader may see
+ * one counter already bumped for an edge and another not yet.
+ *
+ * Every edge lands in exactly one of: bootDropped, accepted (falling),
+ * rejectedDebounce (falling, too close to the last pulse), rejectedStable
+ * (falling, debounce ok but HIGH too short), or neither (rising edge).
+ *
+ * ISR time is measured with the CPU cycle counter (CCOUNT on ESP32) from
+ * entry to exit of the edge handler: min/max/total plus a log2 histogram
+ * (bin b = [2^(b+6), 2^(b+7)) cycles, bin 0 also holds anything faster).
+ */
+struct IsrStats {
+    static constexpr uint8_t CYCLE_BINS = 16;
+    static constexpr uint8_t CYCLE_FIRST_OCTAVE = 6;  // Bin 0 = < 128 cycles
+
+    volatile uint32_t edges;             // Interrupts / counter edges seen
+    volatile uint32_t accepted;
+    volatile uint32_t rejectedDebounce;
+    volatile uint32_t rejectedStable;
+    volatile uint32_t bootDropped;
+    volatile uint32_t cyclesMin;         // 0 = no sample yet
+    volatile uint32_t cyclesMax;
+    volatile uint64_t cyclesTotal;       // Two 32-bit halves: a reader may rarely see a torn value
+    volatile uint32_t cycleBins[CYCLE_BINS];
+
+    /** @brief Account one ISR execution (forced inline: runs in the IRAM ISR body) */
+    inline __attribute__((always_inline)) void recordCycles(uint32_t cycles) {
+        if (cyclesMin == 0 || cycles < cyclesMin) cyclesMin = cycles;
+        if (cycles > cyclesMax) cyclesMax = cycles;
+        cyclesTotal += cycles;
+        uint32_t octave = cycles ? 31 - __builtin_clz(cycles) : 0;
+        uint32_t bin = octave > CYCLE_FIRST_OCTAVE ? octave - CYCLE_FIRST_OCTAVE : 0;
+        cycleBins[bin < CYCLE_BINS ? bin : CYCLE_BINS - 1]++;
+    }
+
+    /** @brief Lower bound of a cycle bin (0 for bin 0) */
+    static uint32_t cycleBinLower(uint8_t bin) {
+        return bin ? 1UL << (bin + CYCLE_FIRST_OCTAVE) : 0;
+    }
+
+    /**
+     * @brief Plain copy for loop()/console/WebUI use
+     */
+    struct Snapshot {
+        uint32_t edges = 0;
+        uint32_t accepted = 0;
+        uint32_t rejectedDebounce = 0;
+        uint32_t rejectedStable = 0;
+        uint32_t bootDropped = 0;
+        uint32_t cyclesMin = 0;
+        uint32_t cyclesMax = 0;
+        uint32_t cyclesAvg = 0;
+        uint32_t timedEdges = 0;         // Edges with a cycle measurement (ISR source only)
+        uint32_t cycleBins[CYCLE_BINS] = {};
+        uint32_t cpuMhz = 240;           // For cycles -> µs
+
+        float cyclesToUs(uint32_t cycles) const { return cpuMhz ? (float)cycles / cpuMhz : 0.0f; }
+    };
+
+    Snapshot snapshot() const {
+        Snapshot s;
+        s.edges = edges;
+        s.accepted = accepted;
+        s.rejectedDebounce = rejectedDebounce;
+        s.rejectedStable = rejectedStable;
+        s.bootDropped = bootDropped;
+        s.cyclesMin = cyclesMin;
+        s.cyclesMax = cyclesMax;
+        for (uint8_t b = 0; b < CYCLE_BINS; b++) {
+            s.cycleBins[b] = cycleBins[b];
+            s.timedEdges += s.cycleBins[b];
+        }
+        s.cyclesAvg = s.timedEdges ? (uint32_t)(cyclesTotal / s.timedEdges) : 0;
+        s.cpuMhz = getCpuFrequencyMhz();
+        return s;
+    }
+};
+
+#endif // WATER_METER_ISR_STATS_H
@@ -0,0 +1,204 @@
+#ifndef WATER_METER_JOURNAL_H
+#define WATER_METER_JOURNAL_H
+
+#include <Arduino.h>
+#include <DomoticsCore/Storage.h>
+#include <stddef.h>
+#include <string.h>
+#include "WaterMeterConfig.h"
+#include "WaterMeterPersistence.h"
+
+#ifndef RTC_NOINIT_ATTR
+#define RTC_NOINIT_ATTR  // Host builds: plain RAM
+#endif
+
+/**
+ * @brief Journal state: pulses credited since full snapshot #snapshotSeq
+ */
+struct __attribute__((packed)) JournalEntry {
+    uint32_t magic;
+    uint32_t snapshotSeq;  // CounterStore sequence this journal extends
+    uint32_t pulses;       // Pulses credited since that snapshot
+    uint32_t entrySeq;     // Flash log ordering
+    uint32_t crc;          // Over the fields above
+};
+
+namespace {
+    // RTC slow memory: survives software/watchdog/brownout resets, garbage
+    // after power-on (rejected by magic + CRC). Global for the same IRAM/DRAM
+    // placement reasons as the ISR state.
+    RTC_NOINIT_ATTR JournalEntry g_rtcJournal[WATER_METER_MAX_CHANNELS];
+}
+
+/**
+ * @brief Power-loss-safe pulse journal between full counter snapshots
+ *
+ * Every credited pulse bumps a counter relative to the last full snapshot
+ * (CounterStore record sequence):
+ * - RTC slow memory copy, updated on every pulse (a RAM write): warm resets
+ *   lose nothing
+ * - small sequenced flash log (WATER_METER_JOURNAL_SLOTS rotating 20-byte
+ *   blobs "wm_j0".., "wmN_j0".. for channel N), written at most every
+ *   flushMs while pulses are pending: cold power loss loses at most flushMs
+ *
+ * At boot, recover() returns the pulses journaled on top of the loaded
+ * snapshot (newest of RTC / flash for that snapshot); after each successful
+ * full save rebase() starts over from the new snapshot, which also makes
+ * all older flash entries stale without erasing them.
+ */
+class PulseJournal {
+public:
+    static constexpr uint32_t MAGIC = 0x4A4D5721;  // "!WMJ"
+
+    enum class Source : uint8_t { None, Rtc, Flash };
+
+    struct Stats {
+        uint32_t flashWrites = 0;
+        uint32_t flashFailures = 0;
+        uint32_t recoveredPulses = 0;
+        Source recoveredFrom = Source::None;
+    };
+
+    void attach(DomoticsCore::Components::StorageComponent* s, uint8_t ch, uint32_t flushIntervalMs) {
+        storage = s;
+        channel = ch < WATER_METER_MAX_CHANNELS ? ch : 0;
+        flushMs = flushIntervalMs;
+    }
+
+    void setFlushInterval(uint32_t flushIntervalMs) { flushMs = flushIntervalMs; }
+
+    /**
+     * @brief Pulses journaled on top of snapshot #snapshotSeq (call once after load)
+     *
+     * Also re-bases the journal on that snapshot, keeping the recovered
+     * pulses as pending until the caller folds them into a new full save.
+     */
+    uint32_t recover(uint32_t snapshotSeq) {
+        uint32_t rtcPulses = 0, flashPulses = 0;
+        bool rtcValid = isValid(g_rtcJournal[channel]) && g_rtcJournal[channel].snapshotSeq == snapshotSeq;
+        if (rtcValid) rtcPulses = g_rtcJournal[channel].pulses;
+
+        JournalEntry newest = {};
+        if (readNewestFlash(snapshotSeq, newest)) flashPulses = newest.pulses;
+
+        // Both only ever grow for a given snapshot: the larger one is the most recent
+        uint32_t pulses = rtcPulses > flashPulses ? rtcPulses : flashPulses;
+        stats.recoveredPulses = pulses;
+        stats.recoveredFrom = pulses == 0 ? Source::None : (rtcPulses >= flashPulses ? Source::Rtc : Source::Flash);
+
+        baseSeq = snapshotSeq;
+        pending = pulses;
+        flushedPulses = flashPulses;
+        writeRtc();
+        return pulses;
+    }
+
+    /** @brief Account pulses credited to the totals (hot path: RAM only) */
+    void record(uint32_t pulses) {
+        pending += pulses;
+        g_rtcJournal[channel].pulses = pending;
+        g_rtcJournal[channel].crc = entryCrc(g_rtcJournal[channel]);
+    }
+
+    /**
+     * @brief Flush to the flash log when due
+     * @return true if a flash entry was written
+     */
+    bool service(uint32_t nowMs) {
+        if (!storage || pending == flushedPulses) return false;
+        if (flushMs && (uint32_t)(nowMs - lastFlushMs) < flushMs) return false;
+        lastFlushMs = nowMs;
+        return writeFlash();
+    }
+
+    /** @brief A full snapshot #snapshotSeq now contains every credited pulse */
+    void rebase(uint32_t snapshotSeq) {
+        baseSeq = snapshotSeq;
+        pending = 0;
+        flushedPulses = 0;
+        writeRtc();
+    }
+
+    uint32_t getPendingPulses() const { return pending; }
+    const Stats& getStats() const { return stats; }
+
+private:
+    static uint32_t entryCrc(const JournalEntry& e) {
+        return CounterStore::crc32(reinterpret_cast<const uint8_t*>(&e), offsetof(JournalEntry, crc));
+    }
+
+    static bool isValid(const JournalEntry& e) {
+        return e.magic == MAGIC && e.crc == entryCrc(e);
+    }
+
+    void writeRtc() {
+        JournalEntry& e = g_rtcJournal[channel];
+        e.magic = MAGIC;
+        e.snapshotSeq = baseSeq;
+        e.pulses = pending;
+        e.entrySeq = entrySeq;
+        e.crc = entryCrc(e);
+    }
+
+    String slotKey(uint8_t slot) const {
+        char key[12];
+        if (channel == 0) {
+            snprintf(key, sizeof(key), "wm_j%u", (unsigned)slot);
+        } else {
+            snprintf(key, sizeof(key), "wm%u_j%u", (unsigned)channel, (unsigned)slot);
+        }
+        return String(key);
+    }
+
+    bool readNewestFlash(uint32_t snapshotSeq, JournalEntry& out) {
+        if (!storage) return false;
+        bool found = false;
+        for (uint8_t slot = 0; slot < WATER_METER_JOURNAL_SLOTS; slot++) {
+            JournalEntry e;
+            if (storage->getBlob(slotKey(slot), reinterpret_cast<uint8_t*>(&e), sizeof(e)) != sizeof(e)) continue;
+            if (!isValid(e)) continue;
+            // Track the highest sequence even for stale entries so new writes sort after them
+            if ((int32_t)(e.entrySeq - entrySeq) >= 0) {
+                entrySeq = e.entrySeq;
+                nextSlot = (slot + 1) % WATER_METER_JOURNAL_SLOTS;
+            }
+            if (e.snapshotSeq != snapshotSeq) continue;
+            if (!found || (int32_t)(e.entrySeq - out.entrySeq) > 0) {
+                out = e;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    bool writeFlash() {
+        JournalEntry e;
+        e.magic = MAGIC;
+        e.snapshotSeq = baseSeq;
+        e.pulses = pending;
+        e.entrySeq = entrySeq + 1;
+        e.crc = entryCrc(e);
+        if (!storage->putBlob(slotKey(nextSlot), reinterpret_cast<const uint8_t*>(&e), sizeof(e))) {
+            stats.flashFailures++;
+            return false;
+        }
+        entrySeq = e.entrySeq;
+        nextSlot = (nextSlot + 1) % WATER_METER_JOURNAL_SLOTS;
+        flushedPulses = pending;
+        stats.flashWrites++;
+        return true;
+    }
+
+    DomoticsCore::Components::StorageComponent* storage = nullptr;
+    uint8_t channel = 0;
+    uint8_t nextSlot = 0;
+    uint32_t flushMs = 30000;
+    uint32_t lastFlushMs = 0;
+    uint32_t baseSeq = 0;
+    uint32_t pending = 0;        // Pulses since snapshot baseSeq
+    uint32_t flushedPulses = 0;  // Value of pending in the newest flash entry
+    uint32_t entrySeq = 0;
+    Stats stats;
+};
+
+#endif // WATER_METER_JOURNAL_H
@@ -0,0 +1,145 @@
+#ifndef WATER_METER_LEAK_H
+#define WATER_METER_LEAK_H
+
+#include <Arduino.h>
+
+/**
+ * @brief Alarm transition published as "watermeter.alarm"
+ */
+struct WaterMeterAlarm {
+    enum Type : uint8_t { Leak = 0, Burst = 1 };
+
+    Type type;
+    uint8_t channel;      // Meter channel (set by the component)
+    bool active;          // true = raised, false = cleared
+    uint32_t durationS;   // Continuous flow (Leak) or high flow (Burst) duration so far
+    float flowLpm;        // Flow rate when the transition happened
+};
+
+/**
+ * @brief Incremental leak / burst detector (O(1) per pulse and per tick)
+ *
+ * - Leak (dripping tap, running toilet): water never stopped for at least
+ *   leakGapMs during the last leakWindowMs. Only the end of the last such
+ *   quiet gap is kept: a pulse after a long enough gap, or an ongoing idle
+ *   period of that length, re-arms it. Clears on the next qualifying gap.
+ * - Burst (broken pipe): flow above burstFlowLpm continuously for burstMs.
+ *   Clears as soon as the flow drops below the threshold.
+ *
+ * Before the first full window after boot nothing is known about earlier
+ * gaps, so a leak can only be raised leakWindowMs after begin().
+ */
+class LeakDetector {
+public:
+    enum : uint8_t {
+        CHANGED_NONE = 0,
+        CHANGED_LEAK = 1 << 0,
+        CHANGED_BURST = 1 << 1
+    };
+
+    void configure(uint32_t leakGapMinutes, uint32_t leakWindowHours,
+                   float burstFlowLpm, uint32_t burstMinutes) {
+        leakGapMs = leakGapMinutes * 60000UL;
+        leakWindowMs = leakWindowHours * 3600000UL;
+        burstLpm = burstFlowLpm;
+        burstMs = burstMinutes * 60000UL;
+    }
+
+    void reset(uint32_t nowMs) {
+        quietGapEndMs = nowMs;
+        lastPulseMs = nowMs;
+        burstStartMs = 0;
+        inBurst = false;
+        leak = false;
+        burst = false;
+        quietSeen = false;
+    }
+
+    /** @brief Account one drained pulse */
+    void onPulse(uint32_t nowMs) {
+        if (nowMs - lastPulseMs >= leakGapMs) {
+            quietGapEndMs = nowMs;  // Water was off long enough before this pulse
+            quietSeen = true;
+        }
+        lastPulseMs = nowMs;
+    }
+
+    /**
+     * @brief Periodic evaluation (idle tick, ~1 s)
+     * @param flowLpm Current (smoothed) flow rate
+     * @return CHANGED_* flags for alarms that were raised or cleared
+     */
+    uint8_t update(uint32_t nowMs, float flowLpm) {
+        uint8_t changed = CHANGED_NONE;
+        lastFlowLpm = flowLpm;
+
+        if (leakGapMs && leakWindowMs) {
+            bool quiet = quietSeen || (nowMs - lastPulseMs >= leakGapMs);
+            quietSeen = false;
+            if (quiet) {
+                quietGapEndMs = nowMs;
+            }
+            // Sticky until the next quiet gap (survives millis() wrap on very long leaks)
+            bool active = !quiet && (leak || (nowMs - quietGapEndMs) >= leakWindowMs);
+            if (active != leak) {
+                leak = active;
+                changed |= CHANGED_LEAK;
+            }
+        }
+
+        if (burstLpm > 0 && burstMs) {
+            if (flowLpm >= burstLpm) {
+                if (!inBurst) {
+                    inBurst = true;
+                    burstStartMs = nowMs;
+                }
+            } else {
+                inBurst = false;
+            }
+            bool active = inBurst && (burst || (nowMs - burstStartMs) >= burstMs);
+            if (active != burst) {
+                burst = active;
+                changed |= CHANGED_BURST;
+            }
+        }
+        lastUpdateMs = nowMs;
+        return changed;
+    }
+
+    bool isLeak() const { return leak; }
+    bool isBurst() const { return burst; }
+
+    /** @brief Time since water last stopped for a full leak gap */
+    uint32_t continuousFlowMs() const { return lastUpdateMs - quietGapEndMs; }
+
+    /** @brief Time the flow has been above the burst threshold (0 = below) */
+    uint32_t highFlowMs() const { return inBurst ? lastUpdateMs - burstStartMs : 0; }
+
+    WaterMeterAlarm makeAlarm(WaterMeterAlarm::Type type) const {
+        WaterMeterAlarm alarm;
+        alarm.type = type;
+        alarm.channel = 0;
+        alarm.active = (type == WaterMeterAlarm::Leak) ? leak : burst;
+        alarm.durationS = ((type == WaterMeterAlarm::Leak) ? continuousFlowMs() : highFlowMs()) / 1000;
+        alarm.flowLpm = lastFlowLpm;
+        return alarm;
+    }
+
+private:
+    uint32_t leakGapMs = 30UL * 60000UL;
+    uint32_t leakWindowMs = 24UL * 3600000UL;
+    float burstLpm = 20.0f;
+    uint32_t burstMs = 30UL * 60000UL;
+
+    uint32_t quietGapEndMs = 0;
+    uint32_t lastPulseMs = 0;
+    uint32_t burstStartMs = 0;
+    uint32_t lastUpdateMs = 0;
+    float lastFlowLpm = 0;
+    bool inBurst = false;
+    bool quietSeen = false;
+    bool leak = false;
+    bool burst = false;
+};
+
+#endif // WATER_METER_LEAK_H
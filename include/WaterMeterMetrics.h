@@ -0,0 +1,242 @@
+#ifndef WATER_METER_METRICS_H
+#define WATER_METER_METRICS_H
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include "WaterMeterConfig.h"
+#include "WaterMeterComponent.h"
+
+// OpenMetrics 1.0 text exposition (Prometheus scrapers negotiate it)
+#define WATER_METER_METRICS_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/**
+ * @brief OpenMetrics text writer over a caller-owned fixed buffer
+ *
+ * family() emits the TYPE/UNIT/HELP lines, the sample calls that follow
+ * belong to it (name = family name + suffix, e.g. "_total"). Everything is
+ * formatted with snprintf straight into the buffer: no String, no heap.
+ *
+ * finish() always has room for the closing "# EOF" line. From the first
+ * line that does not fit on, lines are left out whole and counted in
+ * dropped(), so an undersized WATER_METER_METRICS_BYTES gives a shorter but
+ * still valid exposition (a prefix of the full one).
+ */
+class MetricsWriter {
+public:
+    MetricsWriter(char* buffer, size_t capacity) : buf(buffer), cap(capacity) {
+        if (cap) buf[0] = '\0';
+    }
+
+    /**
+     * @brief Start a metric family
+     * @param type "counter", "gauge", "info", "summary"...
+     * @param unit Unit suffix the name ends with ("liters", "seconds"), nullptr = none
+     */
+    void family(const char* familyName, const char* type, const char* help, const char* unit = nullptr) {
+        name = familyName;
+        line("# TYPE %s %s\n", name, type);
+        if (unit) line("# UNIT %s %s\n", name, unit);
+        line("# HELP %s %s\n", name, help);
+    }
+
+    /** @brief Integer sample; labels without braces ("meter=\"hot\"") or nullptr */
+    void sample(const char* labels, uint64_t value, const char* suffix = "") {
+        line("%s%s%s%s%s %llu\n", name, suffix, labels ? "{" : "", labels ? labels : "", labels ? "}" : "",
+             (unsigned long long)value);
+    }
+
+    /** @brief Exact decimal sample: units / 10^decimals (mL -> L with 3, µs -> s with 6, max 9) */
+    void sampleFixed(const char* labels, uint64_t units, uint8_t decimals, const char* suffix = "") {
+        if (decimals == 0 || decimals > 9) {
+            sample(labels, units, suffix);
+            return;
+        }
+        uint32_t scale = 1;
+        for (uint8_t i = 0; i < decimals; i++) scale *= 10;
+        line("%s%s%s%s%s %llu.%0*lu\n", name, suffix, labels ? "{" : "", labels ? labels : "", labels ? "}" : "",
+             (unsigned long long)(units / scale), (int)decimals, (unsigned long)(units % scale));
+    }
+
+    void sampleFloat(const char* labels, float value, const char* suffix = "") {
+        line("%s%s%s%s%s %.3f\n", name, suffix, labels ? "{" : "", labels ? labels : "", labels ? "}" : "",
+             (double)value);
+    }
+
+    /** @brief Close the exposition, returns its length */
+    size_t finish() {
+        if (cap >= len + EOF_LEN + 1) {
+            memcpy(buf + len, "# EOF\n", EOF_LEN + 1);
+            len += EOF_LEN;
+        }
+        return len;
+    }
+
+    const char* text() const { return buf; }
+    size_t length() const { return len; }
+    uint32_t samples() const { return lines; }
+    uint32_t dropped() const { return droppedLines; }
+
+private:
+    static constexpr size_t EOF_LEN = 6;  // "# EOF\n"
+
+    void line(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+        size_t room = cap > len + EOF_LEN && !droppedLines ? cap - len - EOF_LEN : 0;
+        va_list args;
+        va_start(args, fmt);
+        int n = room ? vsnprintf(buf + len, room, fmt, args) : -1;
+        va_end(args);
+        if (n < 0 || (size_t)n >= room) {
+            if (room) buf[len] = '\0';  // Drop the partial line
+            droppedLines++;
+            return;
+        }
+        len += (size_t)n;
+        lines++;
+    }
+
+    char* buf;
+    size_t cap;
+    size_t len = 0;
+    uint32_t lines = 0;
+    uint32_t droppedLines = 0;
+    const char* name = "";
+};
+
+/**
+ * @brief Statically allocated /metrics response body
+ *
+ * Rendered by the request handler and sent from this memory without a
+ * copy; busy from rendering until the client disconnects, a scrape that
+ * arrives meanwhile is told to retry (503) instead of allocating a second
+ * buffer or overwriting the one being sent.
+ */
+struct MetricsPage {
+    char text[WATER_METER_METRICS_BYTES];
+    volatile bool busy = false;
+};
+
+/**
+ * @brief Duration of the main loop, recorded by loop() and read by the web server task
+ *
+ * 32-bit fields are consistent on their own; totalUs is two 32-bit halves
+ * and may rarely be read torn (as IsrStats::cyclesTotal).
+ */
+struct LoopTiming {
+    volatile uint32_t count = 0;
+    volatile uint32_t lastUs = 0;
+    volatile uint32_t maxUs = 0;
+    volatile uint64_t totalUs = 0;
+
+    void record(uint32_t us) {
+        count++;
+        lastUs = us;
+        if (us > maxUs) maxUs = us;
+        totalUs += us;
+    }
+};
+
+/** @brief meter="x",name="value" into buf (meter labels are at most 39 chars) */
+inline void waterMeterLabel(char* buf, size_t size, const char* meter, const char* name, const char* value) {
+    snprintf(buf, size, "%.39s,%s=\"%s\"", meter, name, value);
+}
+
+/**
+ * @brief Per-meter families for /metrics, every meter's samples grouped under one family
+ *
+ * Samples carry meter="<name>" (names[i], or the channel index when empty).
+ * Only getters that copy plain structs or return references are used: a
+ * scrape allocates nothing.
+ */
+inline void waterMeterWriteMetrics(MetricsWriter& w, WaterMeterComponent* const* meters, const char* const* names,
+                                   uint8_t count) {
+    char meterLabels[WATER_METER_MAX_CHANNELS][40];
+    WaterMeterData data[WATER_METER_MAX_CHANNELS];
+    IsrStats::Snapshot isr[WATER_METER_MAX_CHANNELS];
+    if (count > WATER_METER_MAX_CHANNELS) count = WATER_METER_MAX_CHANNELS;
+    for (uint8_t i = 0; i < count; i++) {
+        if (names && names[i] && names[i][0]) {
+            snprintf(meterLabels[i], sizeof(meterLabels[i]), "meter=\"%s\"", names[i]);
+        } else {
+            snprintf(meterLabels[i], sizeof(meterLabels[i]), "meter=\"%u\"", (unsigned)meters[i]->getChannel());
+        }
+        data[i] = meters[i]->getData();
+        isr[i] = meters[i]->getIsrStats();
+    }
+    char labels[80];
+
+    w.family("watermeter_pulses", "counter", "Meter pulses credited to the totals");
+    for (uint8_t i = 0; i < count; i++) w.sample(meterLabels[i], data[i].pulseCount, "_total");
+
+    w.family("watermeter_volume_liters", "counter", "Total volume", "liters");
+    for (uint8_t i = 0; i < count; i++) w.sampleFixed(meterLabels[i], data[i].totalMl, 3, "_total");
+
+    w.family("watermeter_period_volume_liters", "gauge", "Volume of the running calendar period", "liters");
+    for (uint8_t i = 0; i < count; i++) {
+        for (uint8_t p = 0; p < WATER_PERIOD_COUNT; p++) {
+            waterMeterLabel(labels, sizeof(labels), meterLabels[i], "period", PeriodAccumulators::name((WaterPeriod)p));
+            w.sampleFixed(labels, data[i].periodMl[p], 3);
+        }
+    }
+
+    w.family("watermeter_flow_liters_per_minute", "gauge", "Flow rate", "liters_per_minute");
+    for (uint8_t i = 0; i < count; i++) {
+        static const char* const WINDOWS[] = {"instant", "ewma", "1m", "15m"};
+        const float values[] = {data[i].flowRateLpm, data[i].flowRateAvgLpm, data[i].flow1mLpm, data[i].flow15mLpm};
+        for (uint8_t k = 0; k < 4; k++) {
+            waterMeterLabel(labels, sizeof(labels), meterLabels[i], "window", WINDOWS[k]);
+            w.sampleFloat(labels, values[k]);
+        }
+    }
+
+    w.family("watermeter_alarm", "gauge", "Leak / burst alarm active (1)");
+    for (uint8_t i = 0; i < count; i++) {
+        waterMeterLabel(labels, sizeof(labels), meterLabels[i], "type", "leak");
+        w.sample(labels, data[i].leakAlarm ? 1 : 0);
+        waterMeterLabel(labels, sizeof(labels), meterLabels[i], "type", "burst");
+        w.sample(labels, data[i].burstAlarm ? 1 : 0);
+    }
+
+    w.family("watermeter_hour_anomaly_score", "gauge", "Last closed hour vs its hour-of-week baseline (deviations)");
+    for (uint8_t i = 0; i < count; i++) w.sampleFloat(meterLabels[i], data[i].anomalyScore);
+
+    CounterStore::Stats saves[WATER_METER_MAX_CHANNELS];
+    for (uint8_t i = 0; i < count; i++) saves[i] = meters[i]->getPersistenceStats();
+
+    w.family("watermeter_saves", "counter", "Counter record saves by outcome");
+    for (uint8_t i = 0; i < count; i++) {
+        const CounterStore::Stats& s = saves[i];
+        waterMeterLabel(labels, sizeof(labels), meterLabels[i], "result", "written");
+        w.sample(labels, s.writes, "_total");
+        waterMeterLabel(labels, sizeof(labels), meterLabels[i], "result", "unchanged");
+        w.sample(labels, s.skipped, "_total");
+        waterMeterLabel(labels, sizeof(labels), meterLabels[i], "result", "failed");
+        w.sample(labels, s.failures, "_total");
+    }
+
+    w.family("watermeter_save_duration_max_seconds", "gauge", "Longest counter record write", "seconds");
+    for (uint8_t i = 0; i < count; i++) w.sampleFixed(meterLabels[i], saves[i].maxLatencyUs, 6);
+
+    w.family("watermeter_isr_edges", "counter", "Edges seen by the pulse source");
+    for (uint8_t i = 0; i < count; i++) w.sample(meterLabels[i], isr[i].edges, "_total");
+
+    w.family("watermeter_isr_falling_edges", "counter", "Falling edges by outcome");
+    for (uint8_t i = 0; i < count; i++) {
+        static const char* const OUTCOMES[] = {"accepted", "debounce", "stable", "boot"};
+        const uint32_t values[] = {isr[i].accepted, isr[i].rejectedDebounce, isr[i].rejectedStable, isr[i].bootDropped};
+        for (uint8_t k = 0; k < 4; k++) {
+            waterMeterLabel(labels, sizeof(labels), meterLabels[i], "outcome", OUTCOMES[k]);
+            w.sample(labels, values[k], "_total");
+        }
+    }
+
+    w.family("watermeter_isr_duration_max_seconds", "gauge", "Longest ISR run (ISR source only)", "seconds");
+    for (uint8_t i = 0; i < count; i++) {
+        uint64_t ns = isr[i].cpuMhz ? (uint64_t)isr[i].cyclesMax * 1000 / isr[i].cpuMhz : 0;
+        w.sampleFixed(meterLabels[i], ns, 9);
+    }
+
+    w.family("watermeter_untimed_pulses", "counter", "Pulses counted without timestamp (queue full)");
+    for (uint8_t i = 0; i < count; i++) w.sample(meterLabels[i], meters[i]->getQueueOverflowCount(), "_total");
+}
+
+#endif // WATER_METER_METRICS_H
@@ -0,0 +1,126 @@
+#ifndef WATER_METER_PERIODS_H
+#define WATER_METER_PERIODS_H
+
+#include <Arduino.h>
+#include <time.h>
+
+/**
+ * @brief Calendar periods tracked by PeriodAccumulators
+ */
+enum class WaterPeriod : uint8_t { Hour, Day, Week, Month, Billing, Year };
+static constexpr uint8_t WATER_PERIOD_COUNT = 6;
+
+/**
+ * @brief Persisted accumulator state (part of the counter record, v4)
+ *
+ * key identifies the period the current total belongs to (0 = unknown,
+ * adopted without rollover): YYYYMMDDHH, YYYYMMDD, ISO YYYYWW, YYYYMM,
+ * YYYYMM of the billing period start, YYYY.
+ */
+struct __attribute__((packed)) PeriodTotals {
+    uint32_t key[WATER_PERIOD_COUNT];
+    uint64_t currentMl[WATER_PERIOD_COUNT];
+    uint64_t previousMl[WATER_PERIOD_COUNT];  // Closing value of the last period that rolled over
+};
+
+/**
+ * @brief Hour / day / ISO week / month / billing cycle / year consumption
+ *
+ * add() is the per-pulse path: one add per period, no calendar work.
+ * roll() runs from the calendar deadline (at most once a minute, every
+ * local hour boundary): it derives each period's key from local time and,
+ * where it changed, moves the total to previousMl and starts from zero.
+ * Periods missed while powered off roll on the first valid time after boot,
+ * so previousMl is the last period that saw data, not necessarily the one
+ * right before now.
+ */
+class PeriodAccumulators {
+public:
+    static const char* name(WaterPeriod p) {
+        static const char* const NAMES[WATER_PERIOD_COUNT] = { "hour", "day", "week", "month", "billing", "year" };
+        return NAMES[(uint8_t)p];
+    }
+
+    /** @brief Billing cycle start day of month (clamped to 1-28) */
+    void setBillingStartDay(uint8_t day) {
+        billingDay = day < 1 ? 1 : (day > 28 ? 28 : day);
+    }
+    uint8_t getBillingStartDay() const { return billingDay; }
+
+    inline void add(uint32_t ml) {
+        for (uint8_t p = 0; p < WATER_PERIOD_COUNT; p++) totals.currentMl[p] += ml;
+    }
+
+    /**
+     * @brief Roll periods whose key changed
+     * @return Bit mask (1 << WaterPeriod) of periods that rolled over
+     */
+    uint8_t roll(const struct tm& local) {
+        uint32_t keys[WATER_PERIOD_COUNT];
+        computeKeys(local, billingDay, keys);
+        uint8_t rolled = 0;
+        for (uint8_t p = 0; p < WATER_PERIOD_COUNT; p++) {
+            // Only forward moves roll; a clock stepping back (or unknown key) just re-anchors
+            if (totals.key[p] != 0 && keys[p] > totals.key[p]) {
+                totals.previousMl[p] = totals.currentMl[p];
+                totals.currentMl[p] = 0;
+                rolled |= 1 << p;
+            }
+            totals.key[p] = keys[p];
+        }
+        return rolled;
+    }
+
+    /** @brief Manual reset of one period's running total (previous value kept) */
+    void reset(WaterPeriod p) { totals.currentMl[(uint8_t)p] = 0; }
+    void set(WaterPeriod p, uint64_t ml) { totals.currentMl[(uint8_t)p] = ml; }
+
+    uint64_t current(WaterPeriod p) const { return totals.currentMl[(uint8_t)p]; }
+    uint64_t previous(WaterPeriod p) const { return totals.previousMl[(uint8_t)p]; }
+    uint32_t key(WaterPeriod p) const { return totals.key[(uint8_t)p]; }
+
+    const PeriodTotals& getTotals() const { return totals; }
+    void restore(const PeriodTotals& t) { totals = t; }
+
+    static void computeKeys(const struct tm& t, uint8_t billingStartDay, uint32_t* keys) {
+        uint32_t year = (uint32_t)(t.tm_year + 1900);
+        uint32_t month = (uint32_t)(t.tm_mon + 1);
+        uint32_t day = year * 10000 + month * 100 + (uint32_t)t.tm_mday;
+        keys[(uint8_t)WaterPeriod::Hour] = day * 100 + (uint32_t)t.tm_hour;
+        keys[(uint8_t)WaterPeriod::Day] = day;
+        keys[(uint8_t)WaterPeriod::Week] = isoWeekKey(t);
+        keys[(uint8_t)WaterPeriod::Month] = year * 100 + month;
+        if ((uint8_t)t.tm_mday >= billingStartDay) {
+            keys[(uint8_t)WaterPeriod::Billing] = year * 100 + month;
+        } else {
+            keys[(uint8_t)WaterPeriod::Billing] = month == 1 ? (year - 1) * 100 + 12 : year * 100 + month - 1;
+        }
+        keys[(uint8_t)WaterPeriod::Year] = year;
+    }
+
+    /** @brief ISO 8601 week as YYYYWW (weeks start Monday, week 1 holds the first Thursday) */
+    static uint32_t isoWeekKey(const struct tm& t) {
+        int year = t.tm_year + 1900;
+        int weekday = (t.tm_wday + 6) % 7;  // Monday = 0
+        int week = (t.tm_yday - weekday + 10) / 7;
+        if (week < 1) {
+            year--;
+            week = isoWeeksInYear(year);
+        } else if (week > isoWeeksInYear(year)) {
+            year++;
+            week = 1;
+        }
+        return (uint32_t)year * 100 + (uint32_t)week;
+    }
+
+    static int isoWeeksInYear(int year) {
+        auto p = [](int y) { return (y + y / 4 - y / 100 + y / 400) % 7; };
+        return (p(year) == 4 || p(year - 1) == 3) ? 53 : 52;
+    }
+
+private:
+    PeriodTotals totals = {};
+    uint8_t billingDay = 1;
+};
+
+#endif // WATER_METER_PERIODS_H
@@ -0,0 +1,213 @@
+#ifndef WATER_METER_PERSISTENCE_H
+#define WATER_METER_PERSISTENCE_H
+
+#include <Arduino.h>
+#include <DomoticsCore/Storage.h>
+#include <string.h>
+#include "WaterMeterConfig.h"
+#include "WaterMeterPeriods.h"
+
+/**
+ * @brief Persisted counter state (record payload)
+ *
+ * Append new fields at the end only and bump RECORD_VERSION: older records
+ * load with the missing tail zero-filled. Unit changes of existing fields
+ * are converted in CounterStore::load() by record version.
+ */
+struct __attribute__((packed)) WaterMeterState {
+    uint64_t pulseCount;
+    uint64_t dailyMl;       // v3: milliliters (liters in v1/v2 records, scaled on load)
+    uint64_t yearlyMl;
+    uint32_t periodDayKey;  // v2: local day (YYYYMMDD) the daily/yearly totals belong to (0 = unknown)
+    PeriodTotals periods;   // v4: hour/day/week/month/billing/year totals (day/year mirror the fields above)
+};
+
+/**
+ * @brief Dirty-tracked, CRC-protected, slot-rotating counter persistence
+ *
+ * The whole state is written as ONE blob per save (header + payload) instead
+ * of one NVS key per counter. Saves go round-robin over WATER_METER_PERSIST_SLOTS
+ * keys: "wm_rec0".."wm_recN" on channel 0, "wm%u_rec%u" on channel > 0
+ * ("wm1_rec0".. for channel 1). Each record carries a sequence number; load() picks
+ * the newest slot with a valid magic/CRC, so a torn write falls back to the
+ * previous record. save() is a no-op when the state is unchanged since the
+ * last successful write.
+ */
+class CounterStore {
+public:
+    static constexpr uint16_t RECORD_MAGIC = 0x574D;  // "WM"
+    static constexpr uint8_t RECORD_VERSION = 4;
+
+    struct Stats {
+        uint32_t writes = 0;         // Successful blob writes
+        uint32_t skipped = 0;        // save() calls with unchanged state
+        uint32_t failures = 0;       // Storage write errors
+        uint32_t lastLatencyUs = 0;  // Duration of last write
+        uint32_t maxLatencyUs = 0;
+        uint64_t totalLatencyUs = 0;
+
+        uint32_t avgLatencyUs() const { return writes ? (uint32_t)(totalLatencyUs / writes) : 0; }
+    };
+
+    enum class SaveResult { Written, Unchanged, Failed, NoStorage };
+
+    /** @brief Storage + channel (0 = legacy "wm_rec*" keys, N = "wmN_rec*") */
+    void attach(DomoticsCore::Components::StorageComponent* s, uint8_t ch = 0) {
+        storage = s;
+        channel = ch;
+    }
+    bool isAttached() const { return storage != nullptr; }
+
+    /**
+     * @brief Load newest valid record
+     * @return false if no valid record exists (fresh device or legacy keys only)
+     */
+    bool load(WaterMeterState& out) {
+        if (!storage) return false;
+
+        bool found = false;
+        uint32_t bestSeq = 0;
+        uint8_t bestVersion = 0;
+        for (uint8_t slot = 0; slot < WATER_METER_PERSIST_SLOTS; slot++) {
+            WaterMeterState state;
+            uint32_t seq;
+            uint8_t version;
+            if (!readSlot(slot, state, seq, version)) continue;
+            if (!found || (int32_t)(seq - bestSeq) > 0) {
+                found = true;
+                bestSeq = seq;
+                bestVersion = version;
+                out = state;
+                nextSlot = (slot + 1) % WATER_METER_PERSIST_SLOTS;
+            }
+        }
+        if (found) {
+            if (bestVersion < 3) {
+                // v1/v2 stored whole liters
+                out.dailyMl *= 1000;
+                out.yearlyMl *= 1000;
+            }
+            if (bestVersion < 4) {
+                // Seed the period set from the day/year totals, other periods start now
+                out.periods.currentMl[(uint8_t)WaterPeriod::Day] = out.dailyMl;
+                out.periods.currentMl[(uint8_t)WaterPeriod::Year] = out.yearlyMl;
+                out.periods.key[(uint8_t)WaterPeriod::Day] = out.periodDayKey;
+                out.periods.key[(uint8_t)WaterPeriod::Year] = out.periodDayKey / 10000;
+            }
+            sequence = bestSeq;
+            lastSaved = out;
+            hasLastSaved = bestVersion == RECORD_VERSION;  // Older records get rewritten on the next save
+        }
+        return found;
+    }
+
+    /**
+     * @brief Write state if it differs from the last persisted one
+     * @param force Write even when unchanged (e.g. after migration)
+     */
+    SaveResult save(const WaterMeterState& state, bool force = false) {
+        if (!storage) return SaveResult::NoStorage;
+        if (!force && hasLastSaved && memcmp(&state, &lastSaved, sizeof(state)) == 0) {
+            stats.skipped++;
+            return SaveResult::Unchanged;
+        }
+
+        Record rec;
+        rec.magic = RECORD_MAGIC;
+        rec.version = RECORD_VERSION;
+        memset(rec.reserved, 0, sizeof(rec.reserved));
+        rec.payloadSize = sizeof(WaterMeterState);
+        rec.sequence = sequence + 1;
+        rec.payload = state;
+        rec.crc = crc32(reinterpret_cast<const uint8_t*>(&rec.payload), sizeof(rec.payload), rec.sequence);
+
+        uint32_t start = micros();
+        bool ok = storage->putBlob(slotKey(nextSlot), reinterpret_cast<const uint8_t*>(&rec), sizeof(rec));
+        uint32_t elapsed = micros() - start;
+
+        if (!ok) {
+            stats.failures++;
+            return SaveResult::Failed;
+        }
+        sequence = rec.sequence;
+        nextSlot = (nextSlot + 1) % WATER_METER_PERSIST_SLOTS;
+        lastSaved = state;
+        hasLastSaved = true;
+
+        stats.writes++;
+        stats.lastLatencyUs = elapsed;
+        stats.totalLatencyUs += elapsed;
+        if (elapsed > stats.maxLatencyUs) stats.maxLatencyUs = elapsed;
+        return SaveResult::Written;
+    }
+
+    const Stats& getStats() const { return stats; }
+    uint32_t getSequence() const { return sequence; }
+
+    static uint32_t crc32(const uint8_t* data, size_t len, uint32_t seed = 0) {
+        // Nibble-table CRC-32 (IEEE): 64-byte table, fast enough for a ~32-byte record
+        static const uint32_t table[16] = {
+            0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+            0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+        };
+        uint32_t crc = ~seed;
+        for (size_t i = 0; i < len; i++) {
+            crc = table[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+            crc = table[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+        }
+        return ~crc;
+    }
+
+private:
+    struct __attribute__((packed)) Record {
+        uint16_t magic;
+        uint16_t payloadSize;
+        uint8_t version;
+        uint8_t reserved[3];
+        uint32_t sequence;
+        uint32_t crc;  // Over payload, seeded with sequence
+        WaterMeterState payload;
+    };
+    static constexpr size_t HEADER_SIZE = sizeof(Record) - sizeof(WaterMeterState);
+    static constexpr size_t MAX_PAYLOAD_SIZE = 512;
+    static_assert(sizeof(WaterMeterState) <= MAX_PAYLOAD_SIZE, "WaterMeterState too large for a record");
+
+    String slotKey(uint8_t slot) const {
+        char key[16];
+        if (channel == 0) {
+            snprintf(key, sizeof(key), "wm_rec%u", (unsigned)slot);
+        } else {
+            snprintf(key, sizeof(key), "wm%u_rec%u", (unsigned)channel, (unsigned)slot);
+        }
+        return String(key);
+    }
+
+    bool readSlot(uint8_t slot, WaterMeterState& state, uint32_t& seq, uint8_t& version) {
+        Record rec;
+        // Buffer sized for records written by newer firmware (larger payload)
+        uint8_t buf[HEADER_SIZE + MAX_PAYLOAD_SIZE];
+        size_t len = storage->getBlob(slotKey(slot), buf, sizeof(buf));
+        if (len < HEADER_SIZE) return false;
+
+        memcpy(&rec, buf, HEADER_SIZE);
+        if (rec.magic != RECORD_MAGIC || len != HEADER_SIZE + rec.payloadSize) return false;
+        if (crc32(buf + HEADER_SIZE, rec.payloadSize, rec.sequence) != rec.crc) return false;
+
+        // Older/shorter payloads: missing tail fields default to zero
+        memset(&state, 0, sizeof(state));
+        memcpy(&state, buf + HEADER_SIZE, rec.payloadSize < sizeof(state) ? rec.payloadSize : sizeof(state));
+        seq = rec.sequence;
+        version = rec.version;
+        return true;
+    }
+
+    DomoticsCore::Components::StorageComponent* storage = nullptr;
+    uint8_t channel = 0;
+    uint32_t sequence = 0;
+    uint8_t nextSlot = 0;
+    WaterMeterState lastSaved = {};
+    bool hasLastSaved = false;
+    Stats stats;
+};
+
+#endif // WATER_METER_PERSISTENCE_H
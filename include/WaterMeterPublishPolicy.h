@@ -0,0 +1,206 @@
+#ifndef WATER_METER_PUBLISH_POLICY_H
+#define WATER_METER_PUBLISH_POLICY_H
+
+#include <Arduino.h>
+#include <math.h>
+#include <string.h>
+#include "WaterMeterConfig.h"
+
+// Maximum number of sensors tracked by the publish policy (27 per meter with diagnostics + 2 system)
+#ifndef WATER_METER_PUBLISH_MAX_SENSORS
+#define WATER_METER_PUBLISH_MAX_SENSORS (WATER_METER_MAX_CHANNELS * 27 + 2)
+#endif
+static_assert(WATER_METER_PUBLISH_MAX_SENSORS <= 255,
+              "PublishPolicy handles are uint8_t: lower WATER_METER_MAX_CHANNELS (9 max) or WATER_METER_PUBLISH_MAX_SENSORS");
+
+/**
+ * @brief Change-driven, adaptive-cadence state publishing policy
+ *
+ * Decides which sensor values are worth sending instead of republishing
+ * everything on a fixed timer:
+ * - evaluation cadence: activeIntervalMs while water flows, idleIntervalMs otherwise
+ * - a sensor is sent when it moved by >= its threshold since the last sent
+ *   value, crossed zero, was never sent, or its heartbeat (heartbeatMs) expired
+ * - a token bucket (burstTokens, refilled at tokensPerMinute) caps bursts;
+ *   a change that finds no token stays pending and goes out on a later tick
+ *
+ * Per sensor (offer(): one message per due value) or batched (dueAll() /
+ * commitAll(): one message with every value as soon as any of them is due,
+ * committed only once the transport accepted it).
+ * Transport agnostic: the caller does the actual publish when told so.
+ */
+class PublishPolicy {
+public:
+    struct Timing {
+        uint32_t activeIntervalMs = 5000;   // Evaluation cadence while flowing
+        uint32_t idleIntervalMs = 60000;    // Evaluation cadence when idle
+        uint32_t heartbeatMs = 900000;      // Republish unchanged values at least this often
+        uint8_t burstTokens = 20;           // Max messages in a burst
+        uint16_t tokensPerMinute = 60;      // Sustained message rate
+    };
+
+    struct Stats {
+        uint32_t published = 0;     // Values sent
+        uint32_t suppressed = 0;    // Values unchanged, not sent
+        uint32_t rateLimited = 0;   // Changes deferred for lack of tokens
+        uint32_t messages = 0;      // Publishes requested (one per value, or one per committed batch)
+        uint32_t failed = 0;        // Batches the transport did not accept (retried)
+    };
+
+    /** @brief Register a sensor (id is copied), returns its handle (-1 if full) */
+    int addSensor(const char* id, float threshold) {
+        if (count >= WATER_METER_PUBLISH_MAX_SENSORS) return -1;
+        Sensor& s = sensors[count];
+        strncpy(s.id, id, sizeof(s.id) - 1);
+        s.id[sizeof(s.id) - 1] = '\0';
+        s.threshold = threshold;
+        s.sent = false;
+        return count++;
+    }
+
+    void setTiming(const Timing& t) {
+        timing = t;
+        if (tokens > (float)timing.burstTokens) tokens = timing.burstTokens;
+    }
+    const Timing& getTiming() const { return timing; }
+
+    /**
+     * @brief Cadence gate, call every loop()
+     * @param flowing Water currently flowing (selects the fast cadence)
+     * @return true when sensors should be offered this tick
+     */
+    bool tick(uint32_t nowMs, bool flowing) {
+        refill(nowMs);
+        // Flow start must not wait out a long idle interval
+        if (flowing && !wasFlowing) nextEvalMs = nowMs;
+        wasFlowing = flowing;
+        if (started && (int32_t)(nowMs - nextEvalMs) < 0) return false;
+        started = true;
+        nextEvalMs = nowMs + (flowing ? timing.activeIntervalMs : timing.idleIntervalMs);
+        currentMs = nowMs;
+        return true;
+    }
+
+    /**
+     * @brief Offer a value, true if the caller should publish it now
+     */
+    bool offer(int handle, float value) {
+        if (handle < 0 || handle >= count) return false;
+        Sensor& s = sensors[handle];
+
+        if (!isDue(s, value)) {
+            stats.suppressed++;
+            return false;
+        }
+        if (tokens < 1.0f) {
+            stats.rateLimited++;
+            return false;
+        }
+        tokens -= 1.0f;
+        markSent(s, value);
+        stats.published++;
+        stats.messages++;
+        return true;
+    }
+
+    /**
+     * @brief Every sensor at once (values indexed by handle), true if one message with all of them should go out now
+     *
+     * Due as soon as one sensor is due by the offer() rules and a token is
+     * left. Nothing is spent or marked sent: call commitAll() once the
+     * message was accepted, or sendFailed() if it was not.
+     */
+    bool dueAll(const float* values) {
+        bool due = false;
+        for (uint8_t i = 0; i < count && !due; i++) {
+            due = isDue(sensors[i], values[i]);
+        }
+        if (!due) {
+            stats.suppressed += count;
+            return false;
+        }
+        if (tokens < 1.0f) {
+            stats.rateLimited++;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief The dueAll() message went out: it costs one token and every
+     * sensor counts as sent with its value, so the receiver always gets one consistent set
+     */
+    void commitAll(const float* values) {
+        if (tokens >= 1.0f) tokens -= 1.0f;
+        for (uint8_t i = 0; i < count; i++) {
+            markSent(sensors[i], values[i]);
+        }
+        stats.published += count;
+        stats.messages++;
+    }
+
+    /** @brief The dueAll() message was not accepted: nothing marked sent, retried at the fast cadence */
+    void sendFailed() {
+        stats.failed++;
+        nextEvalMs = currentMs + timing.activeIntervalMs;
+    }
+
+    /** @brief Force every sensor out on the next offer (e.g. HA/MQTT reconnect) */
+    void invalidate() {
+        for (uint8_t i = 0; i < count; i++) sensors[i].sent = false;
+        started = false;
+    }
+
+    const char* getId(int handle) const { return (handle >= 0 && handle < count) ? sensors[handle].id : ""; }
+    uint8_t size() const { return count; }
+    const Stats& getStats() const { return stats; }
+
+private:
+    struct Sensor {
+        char id[40] = "";  // Longest: "isr_rejected_stability" + "_" + channel name
+        float threshold = 0;
+        float lastValue = 0;
+        uint32_t lastSentMs = 0;
+        bool sent = false;
+    };
+
+    bool isDue(const Sensor& s, float value) const {
+        return !s.sent ||
+               fabsf(value - s.lastValue) >= s.threshold ||
+               ((value == 0.0f) != (s.lastValue == 0.0f)) ||
+               (uint32_t)(currentMs - s.lastSentMs) >= timing.heartbeatMs;
+    }
+
+    void markSent(Sensor& s, float value) {
+        s.lastValue = value;
+        s.lastSentMs = currentMs;
+        s.sent = true;
+    }
+
+    void refill(uint32_t nowMs) {
+        if (!refillInit) {
+            refillInit = true;
+            lastRefillMs = nowMs;
+            tokens = timing.burstTokens;
+            return;
+        }
+        uint32_t dt = nowMs - lastRefillMs;
+        lastRefillMs = nowMs;
+        tokens += (float)dt * timing.tokensPerMinute / 60000.0f;
+        if (tokens > (float)timing.burstTokens) tokens = timing.burstTokens;
+    }
+
+    Sensor sensors[WATER_METER_PUBLISH_MAX_SENSORS];
+    uint8_t count = 0;
+    Timing timing;
+    Stats stats;
+    float tokens = 0;
+    uint32_t lastRefillMs = 0;
+    uint32_t nextEvalMs = 0;
+    uint32_t currentMs = 0;
+    bool refillInit = false;
+    bool started = false;
+    bool wasFlowing = false;
+};
+
+#endif // WATER_METER_PUBLISH_POLICY_H
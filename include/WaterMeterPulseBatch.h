@@ -0,0 +1,73 @@
+#ifndef WATER_METER_PULSE_BATCH_H
+#define WATER_METER_PULSE_BATCH_H
+
+#include <Arduino.h>
+#include "WaterMeterConfig.h"
+
+/**
+ * @brief Pulse timestamps published as "watermeter.pulses"
+ *
+ * One event per batch instead of one per pulse. count + untimed is the
+ * number of pulses credited since the previous batch; sequence gaps mean
+ * batches were not built (no subscriber at the time).
+ */
+struct WaterMeterPulseBatch {
+    uint8_t channel;                                         // Meter channel (set by the component)
+    uint8_t count;                                           // Valid entries in timestampsUs
+    uint32_t untimed;                                        // Pulses counted without timestamp (queue overflow)
+    uint32_t sequence;                                       // Batch number, starts at 1
+    uint32_t timestampsUs[WATER_METER_PULSE_BATCH_SIZE];     // micros() of each pulse, oldest first
+};
+
+/**
+ * @brief Collects drained pulse timestamps until the batch is full or old enough
+ *
+ * add() is O(1) and returns true when the batch just filled up; due() is
+ * the loop() check for a partial batch older than maxAgeMs (0 = every
+ * loop() that saw a pulse). The caller emits finish() and then calls clear().
+ */
+class PulseBatcher {
+public:
+    void setMaxAge(uint32_t ms) { maxAgeMs = ms; }
+
+    inline bool add(uint32_t timestampUs, uint32_t nowMs) {
+        open(nowMs);
+        batch.timestampsUs[batch.count++] = timestampUs;
+        return batch.count >= WATER_METER_PULSE_BATCH_SIZE;
+    }
+
+    void addUntimed(uint32_t pulses, uint32_t nowMs) {
+        open(nowMs);
+        batch.untimed += pulses;
+    }
+
+    bool due(uint32_t nowMs) const {
+        return pending() && (uint32_t)(nowMs - openedMs) >= maxAgeMs;
+    }
+
+    bool pending() const { return batch.count > 0 || batch.untimed > 0; }
+
+    /** @brief Finished batch (channel and next sequence number filled in) */
+    const WaterMeterPulseBatch& finish(uint8_t channel) {
+        batch.channel = channel;
+        batch.sequence = ++sequence;
+        return batch;
+    }
+
+    void clear() {
+        batch.count = 0;
+        batch.untimed = 0;
+    }
+
+private:
+    inline void open(uint32_t nowMs) {
+        if (!pending()) openedMs = nowMs;
+    }
+
+    WaterMeterPulseBatch batch = {};
+    uint32_t sequence = 0;
+    uint32_t openedMs = 0;
+    uint32_t maxAgeMs = 1000;
+};
+
+#endif // WATER_METER_PULSE_BATCH_H
@@ -0,0 +1,584 @@
+#ifndef WATER_METER_PULSE_LOG_H
+#define WATER_METER_PULSE_LOG_H
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <mutex>
+#include <vector>
+#include "WaterMeterConfig.h"
+#include "WaterMeterPersistence.h"
+
+#if defined(ESP32)
+#include <esp_partition.h>
+#endif
+
+/**
+ * @brief Raw flash area holding the pulse log (4 KB erase sectors)
+ *
+ * ESP32: the data partition labelled WATER_METER_PULSE_LOG_PARTITION
+ * ("spiffs" in min_spiffs.csv, unused by the firmware otherwise), accessed
+ * without a filesystem. Host: WATER_METER_PULSE_LOG_HOST_BYTES of RAM with
+ * NOR semantics (writes only clear bits, erase sets 0xFF).
+ */
+class PulseLogRegion {
+public:
+    static constexpr uint32_t SECTOR = 4096;
+
+#if defined(ESP32)
+    bool begin() {
+        part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, WATER_METER_PULSE_LOG_PARTITION);
+        return part != nullptr;
+    }
+    uint32_t size() const { return part ? part->size : 0; }
+    bool read(uint32_t offset, void* out, size_t len) const {
+        return part && esp_partition_read(part, offset, out, len) == ESP_OK;
+    }
+    bool write(uint32_t offset, const void* data, size_t len) {
+        return part && esp_partition_write(part, offset, data, len) == ESP_OK;
+    }
+    bool erase(uint32_t offset) {
+        return part && esp_partition_erase_range(part, offset, SECTOR) == ESP_OK;
+    }
+
+private:
+    const esp_partition_t* part = nullptr;
+#else
+    /** @brief The emulated partition outlives PulseLog instances, like flash outlives a reboot */
+    static std::vector<uint8_t>& memory() {
+        static std::vector<uint8_t> mem(WATER_METER_PULSE_LOG_HOST_BYTES, 0xFF);
+        return mem;
+    }
+    /** @brief Host tests: blank partition */
+    void clear() { memory().assign(WATER_METER_PULSE_LOG_HOST_BYTES, 0xFF); }
+    bool begin() { return true; }
+    uint32_t size() const { return (uint32_t)memory().size(); }
+    bool read(uint32_t offset, void* out, size_t len) const {
+        if (offset + len > memory().size()) return false;
+        memcpy(out, memory().data() + offset, len);
+        return true;
+    }
+    bool write(uint32_t offset, const void* data, size_t len) {
+        if (offset + len > memory().size()) return false;
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < len; i++) memory()[offset + i] &= p[i];
+        return true;
+    }
+    bool erase(uint32_t offset) {
+        if (offset + SECTOR > memory().size()) return false;
+        memset(memory().data() + offset, 0xFF, SECTOR);
+        return true;
+    }
+#endif
+};
+
+/**
+ * @brief Page header: sparse time index + prefix-sum volume of one 4 KB page
+ *
+ * baseMs/pulsesBefore are each channel's state at the moment the page was
+ * opened: time of its last logged pulse (0 = none yet) and how many pulses
+ * were logged before this page. Both only grow from page to page, which is
+ * what the binary search in PulseLog relies on.
+ */
+struct __attribute__((packed)) PulseLogPageHeader {
+    uint32_t magic;
+    uint32_t seq;
+    uint64_t baseMs[WATER_METER_MAX_CHANNELS];
+    uint64_t pulsesBefore[WATER_METER_MAX_CHANNELS];
+    uint32_t crc;
+};
+
+/**
+ * @brief Append-only, full-resolution pulse timestamp log on raw flash
+ *
+ * Each accepted pulse is stored as the LEB128 varint of the milliseconds
+ * since the previous pulse of the same channel (1-3 bytes at household
+ * flow, ~2.5 bytes per liter on average). Varints collect in a per-channel
+ * RAM record of up to RECORD_MAX bytes, written as [len][channel][payload]
+ * when full or flushMs old (payload first, len last: a torn write reads as
+ * the end of the page). Pages form a ring over the region; the oldest page
+ * is erased when the ring wraps.
+ *
+ * Queries never scan the log: pulsesBefore() binary-searches the page
+ * headers (O(log pages) header reads), then decodes at most one page.
+ * Timestamps are UTC epoch ms; pulses arriving before NTP sync are not
+ * logged (counted in Stats::unsynced).
+ *
+ * Written from loop(), queried from the web server task: append(),
+ * service(), flush() and the queries take one mutex, so a query never sees
+ * a RAM record against a stale flashed cursor or a page being erased.
+ * readHeader()/readRecord()/physical()/pages() do not lock: the caller
+ * holds the mutex (PulseLogExportWriter) or is the loop task.
+ */
+class PulseLog {
+public:
+    static constexpr uint32_t MAGIC = 0x474C5057;  // "WPLG"
+    static constexpr uint32_t PAGE = PulseLogRegion::SECTOR;
+    static constexpr uint32_t HEADER = sizeof(PulseLogPageHeader);
+    static constexpr uint8_t RECORD_MAX = 64;
+    static constexpr uint8_t CHANNELS = WATER_METER_MAX_CHANNELS;
+
+    struct Stats {
+        uint32_t logged = 0;         // Pulses appended since boot
+        uint32_t unsynced = 0;       // Pulses skipped: clock not set yet
+        uint32_t records = 0;        // Records written
+        uint32_t pagesOpened = 0;    // Pages erased + started (oldest page lost once the ring is full)
+        uint32_t writeFailures = 0;
+    };
+
+    /**
+     * @brief Find the region and the newest page; resume appending after its last record
+     */
+    bool begin(uint32_t flushIntervalMs) {
+        flushMs = flushIntervalMs;
+        if (!region.begin() || region.size() < 2 * PAGE) return false;
+        pageCount = region.size() / PAGE;
+
+        bool found = false;
+        uint32_t newestSeq = 0, oldestSeq = 0;
+        for (uint32_t p = 0; p < pageCount; p++) {
+            PulseLogPageHeader h;
+            if (!readHeaderAt(p, h)) continue;
+            if (!found || (int32_t)(h.seq - newestSeq) > 0) { newestSeq = h.seq; currentPage = p; }
+            if (!found || (int32_t)(h.seq - oldestSeq) < 0) { oldestSeq = h.seq; }
+            found = true;
+        }
+        ready = true;
+        if (!found) {
+            return openPage(0, 0);
+        }
+        currentSeq = newestSeq;
+        usedPages = newestSeq - oldestSeq + 1;
+        if (usedPages > pageCount) usedPages = pageCount;
+
+        // Rebuild the per-channel state from the newest page
+        PulseLogPageHeader h;
+        readHeaderAt(currentPage, h);
+        for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+            flashed[ch].lastMs = h.baseMs[ch];
+            flashed[ch].pulses = h.pulsesBefore[ch];
+        }
+        uint32_t end = scanPage(currentPage, flashed);
+        writeOffset = end;
+        for (uint8_t ch = 0; ch < CHANNELS; ch++) pending[ch].state = flashed[ch];
+        if (!tailErased(currentPage, end)) {
+            return openPage(currentPage + 1, currentSeq + 1);  // Torn record: start clean
+        }
+        return true;
+    }
+
+    bool isReady() const { return ready; }
+
+    /** @brief Log one pulse (epochMs = 0: clock not synced, only counted) */
+    void append(uint8_t ch, uint64_t epochMs, uint32_t nowMs) {
+        if (!ready || ch >= CHANNELS) return;
+        if (epochMs == 0) {
+            stats.unsynced++;
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        Pending& p = pending[ch];
+        uint64_t delta = epochMs > p.state.lastMs ? epochMs - p.state.lastMs : 0;  // Clock stepped back: same ms
+        if (p.state.lastMs == 0) delta = epochMs;  // First pulse ever: absolute time
+        if (p.len + 10 > RECORD_MAX) {
+            flushChannel(ch);
+            if (p.len + 10 > RECORD_MAX) return;  // Flash write failed: pulse not logged
+        }
+        if (p.len == 0) p.openedMs = nowMs;
+        p.len += encodeVarint(delta, p.buf + p.len);
+        p.state.lastMs += delta;
+        p.state.pulses++;
+        stats.logged++;
+    }
+
+    /** @brief Write records older than flushMs (call from loop()) */
+    void service(uint32_t nowMs) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+            if (pending[ch].len && (uint32_t)(nowMs - pending[ch].openedMs) >= flushMs) flushChannel(ch);
+        }
+    }
+
+    void flush() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (uint8_t ch = 0; ch < CHANNELS; ch++) flushChannel(ch);
+    }
+
+    /**
+     * @brief Pulses of channel ch logged strictly before tMs (RAM records included)
+     *
+     * Before the oldest page still in flash this is that page's prefix count:
+     * the difference of two calls is exact inside the covered range.
+     */
+    uint64_t pulsesBefore(uint8_t ch, uint64_t tMs) const {
+        if (!ready || ch >= CHANNELS) return 0;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (usedPages == 0) return 0;
+        // Last page whose base time is before tMs (headers are monotonic per channel)
+        uint32_t lo = 0, hi = usedPages;  // Answer in [lo, hi)
+        PulseLogPageHeader h;
+        if (!readHeader(0, h)) return 0;
+        if (h.baseMs[ch] != 0 && h.baseMs[ch] >= tMs) return h.pulsesBefore[ch];
+        while (hi - lo > 1) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (readHeader(mid, h) && (h.baseMs[ch] == 0 || h.baseMs[ch] < tMs)) lo = mid;
+            else hi = mid;
+        }
+        readHeader(lo, h);
+        Cursor state[CHANNELS];
+        for (uint8_t c = 0; c < CHANNELS; c++) {
+            state[c].lastMs = h.baseMs[c];
+            state[c].pulses = h.pulsesBefore[c];
+        }
+        uint64_t count = state[ch].pulses;
+        scanPage(physical(lo), state, ch, tMs, &count);
+        if (lo == usedPages - 1) {
+            // Newest page: continue into the record still in RAM
+            const Pending& p = pending[ch];
+            Cursor c = flashed[ch];
+            decodeRecord(p.buf, p.len, c, tMs, &count);
+        }
+        return count;
+    }
+
+    /** @brief Time of the oldest pulse still answerable (0 = empty log) */
+    uint64_t coveredFromMs(uint8_t ch) const {
+        if (!ready || ch >= CHANNELS) return 0;
+        std::lock_guard<std::mutex> lock(mutex);
+        PulseLogPageHeader h;
+        return readHeader(0, h) ? h.baseMs[ch] : 0;
+    }
+
+    /** @brief Header of page i, 0 = oldest ... pages()-1 = newest */
+    bool readHeader(uint32_t logicalIndex, PulseLogPageHeader& h) const {
+        if (logicalIndex >= usedPages) return false;
+        return readHeaderAt(physical(logicalIndex), h) && h.seq == currentSeq - (usedPages - 1 - logicalIndex);
+    }
+
+    uint32_t pages() const { return usedPages; }
+    uint32_t capacityPages() const { return pageCount; }
+    uint32_t physical(uint32_t logicalIndex) const {
+        return (currentPage + pageCount - (usedPages - 1 - logicalIndex)) % pageCount;
+    }
+    const PulseLogRegion& getRegion() const { return region; }
+    const Stats& getStats() const { return stats; }
+
+    /** @brief Running decode state of one channel */
+    struct Cursor {
+        uint64_t lastMs = 0;
+        uint64_t pulses = 0;
+    };
+
+    static uint8_t encodeVarint(uint64_t v, uint8_t* out) {
+        uint8_t n = 0;
+        while (v >= 0x80) {
+            out[n++] = (uint8_t)(v | 0x80);
+            v >>= 7;
+        }
+        out[n++] = (uint8_t)v;
+        return n;
+    }
+
+    /**
+     * @brief Decode a record payload, counting pulses before tMs into *count
+     * @return false once a pulse at or after tMs is reached (later ones are not counted)
+     */
+    static bool decodeRecord(const uint8_t* buf, uint8_t len, Cursor& c, uint64_t tMs = UINT64_MAX, uint64_t* count = nullptr) {
+        uint8_t i = 0;
+        while (i < len) {
+            uint64_t delta = 0;
+            uint8_t shift = 0;
+            while (i < len) {
+                uint8_t b = buf[i++];
+                delta |= (uint64_t)(b & 0x7F) << shift;
+                shift += 7;
+                if (!(b & 0x80)) break;
+            }
+            c.lastMs += delta;
+            c.pulses++;
+            if (c.lastMs >= tMs) return false;
+            if (count) *count = c.pulses;
+        }
+        return true;
+    }
+
+    /** @brief Record [len][channel] at offset of physical page p (false = end of page) */
+    bool readRecord(uint32_t p, uint32_t offset, uint8_t& channel, uint8_t* payload, uint8_t& len) const {
+        uint8_t hdr[2];
+        if (offset + 2 > PAGE || !region.read(p * PAGE + offset, hdr, 2)) return false;
+        if (hdr[0] == 0xFF || hdr[0] == 0 || hdr[0] > RECORD_MAX || hdr[1] >= CHANNELS) return false;
+        if (offset + 2 + hdr[0] > PAGE) return false;
+        len = hdr[0];
+        channel = hdr[1];
+        return region.read(p * PAGE + offset + 2, payload, len);
+    }
+
+private:
+    friend class PulseLogExportWriter;  // Locks mutex around each page/record read
+
+    struct Pending {
+        uint8_t buf[RECORD_MAX];
+        uint8_t len = 0;
+        uint32_t openedMs = 0;
+        Cursor state;  // After the last pulse in buf
+    };
+
+    static uint32_t headerCrc(const PulseLogPageHeader& h) {
+        return CounterStore::crc32(reinterpret_cast<const uint8_t*>(&h), offsetof(PulseLogPageHeader, crc));
+    }
+
+    bool readHeaderAt(uint32_t p, PulseLogPageHeader& h) const {
+        return region.read(p * PAGE, &h, sizeof(h)) && h.magic == MAGIC && h.crc == headerCrc(h);
+    }
+
+    /**
+     * @brief Walk the records of page p, updating state; optionally count channel ch before tMs
+     * @return Offset after the last valid record
+     */
+    uint32_t scanPage(uint32_t p, Cursor* state, int16_t ch = -1, uint64_t tMs = UINT64_MAX, uint64_t* count = nullptr) const {
+        uint32_t offset = HEADER;
+        uint8_t payload[RECORD_MAX];
+        uint8_t channel, len;
+        while (readRecord(p, offset, channel, payload, len)) {
+            offset += 2 + len;
+            if (ch < 0) {
+                decodeRecord(payload, len, state[channel]);
+            } else if (channel == ch && !decodeRecord(payload, len, state[channel], tMs, count)) {
+                break;  // Later records of this channel are later in time
+            }
+        }
+        return offset;
+    }
+
+    bool tailErased(uint32_t p, uint32_t offset) const {
+        uint8_t buf[64];
+        while (offset < PAGE) {
+            uint32_t n = PAGE - offset < sizeof(buf) ? PAGE - offset : sizeof(buf);
+            if (!region.read(p * PAGE + offset, buf, n)) return false;
+            for (uint32_t i = 0; i < n; i++) {
+                if (buf[i] != 0xFF) return false;
+            }
+            offset += n;
+        }
+        return true;
+    }
+
+    /** @brief Erase physical page p and start it with the current flashed state */
+    bool openPage(uint32_t p, uint32_t seq) {
+        p %= pageCount;
+        PulseLogPageHeader h;
+        h.magic = MAGIC;
+        h.seq = seq;
+        for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+            h.baseMs[ch] = flashed[ch].lastMs;
+            h.pulsesBefore[ch] = flashed[ch].pulses;
+        }
+        h.crc = headerCrc(h);
+        if (!region.erase(p * PAGE) || !region.write(p * PAGE, &h, sizeof(h))) {
+            stats.writeFailures++;
+            return false;
+        }
+        currentPage = p;
+        currentSeq = seq;
+        writeOffset = HEADER;
+        usedPages = usedPages < pageCount ? usedPages + 1 : pageCount;
+        stats.pagesOpened++;
+        return true;
+    }
+
+    void flushChannel(uint8_t ch) {
+        Pending& p = pending[ch];
+        if (p.len == 0) return;
+        if (writeOffset + 2 + p.len > PAGE && !openPage(currentPage + 1, currentSeq + 1)) return;
+        uint32_t at = currentPage * PAGE + writeOffset;
+        uint8_t hdr[2] = { p.len, ch };
+        // Payload first: until the length byte lands the record reads as end of page
+        if (!region.write(at + 2, p.buf, p.len) || !region.write(at, hdr, 2)) {
+            stats.writeFailures++;
+            openPage(currentPage + 1, currentSeq + 1);  // Never append after a half-written record
+            return;
+        }
+        writeOffset += 2 + p.len;
+        flashed[ch] = p.state;
+        p.len = 0;
+        stats.records++;
+    }
+
+    PulseLogRegion region;
+    bool ready = false;
+    uint32_t flushMs = 60000;
+    uint32_t pageCount = 0;
+    uint32_t usedPages = 0;
+    uint32_t currentPage = 0;
+    uint32_t currentSeq = 0;
+    uint32_t writeOffset = HEADER;
+    Cursor flashed[CHANNELS];  // State after the last record in flash
+    Pending pending[CHANNELS];
+    Stats stats;
+    mutable std::mutex mutex;  // Loop-task writes vs web-task queries and exports
+};
+
+/**
+ * @brief Chunked CSV / NDJSON export of pulses in [fromMs, toMs), read page by page from flash
+ *
+ * Same read(buffer, maxLen) contract as HistoryJsonWriter: a few hundred
+ * bytes of state, one record decoded at a time. Call PulseLog::flush() first
+ * so the export includes the last pulses. Each header/record read holds the
+ * log's mutex, so a record is never read while loop() erases its page; if
+ * the ring wraps over a page between two reads, the export stops there.
+ *
+ * CSV:    meter,time_ms,pulse      (pulse = running count since the log started)
+ * NDJSON: {"meter":0,"t":1760000000123,"pulse":4242}
+ */
+class PulseLogExportWriter {
+public:
+    PulseLogExportWriter(const PulseLog& l, int8_t meterChannel, uint64_t from, uint64_t to, bool asNdjson)
+        : log(l), channel(meterChannel), fromMs(from), toMs(to), ndjson(asNdjson) {
+        page = firstPage();
+    }
+
+    /**
+     * @brief Fill up to maxLen bytes
+     * @return Bytes written, 0 when the export is complete
+     */
+    size_t read(uint8_t* out, size_t maxLen) {
+        size_t total = 0;
+        while (total < maxLen) {
+            if (pos == len && !renderNext()) break;
+            size_t n = len - pos;
+            if (n > maxLen - total) n = maxLen - total;
+            memcpy(out + total, scratch + pos, n);
+            pos += n;
+            total += n;
+        }
+        return total;
+    }
+
+private:
+    /** @brief First page that can hold a pulse >= fromMs on a selected channel */
+    uint32_t firstPage() const {
+        std::lock_guard<std::mutex> lock(log.mutex);
+        uint32_t lo = 0, hi = log.pages();
+        PulseLogPageHeader h;
+        while (hi - lo > 1) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (log.readHeader(mid, h) && allBefore(h, fromMs)) lo = mid;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    bool allBefore(const PulseLogPageHeader& h, uint64_t tMs) const {
+        for (uint8_t ch = 0; ch < PulseLog::CHANNELS; ch++) {
+            if ((channel < 0 || channel == ch) && h.baseMs[ch] != 0 && h.baseMs[ch] >= tMs) return false;
+        }
+        return true;
+    }
+
+    bool renderNext() {
+        pos = 0;
+        len = 0;
+        if (!headerDone) {
+            if (!ndjson) append("meter,time_ms,pulse\n");
+            headerDone = true;
+            return true;
+        }
+        while (true) {
+            // Rest of the current record, a few pulses per chunk
+            if (recPos < recLen) {
+                renderPulses();
+                if (len) return true;
+                continue;
+            }
+            if (!nextRecord()) return false;
+        }
+    }
+
+    void renderPulses() {
+        PulseLog::Cursor& c = state[recChannel];
+        for (uint8_t n = 0; n < 8 && recPos < recLen; n++) {
+            uint64_t delta = 0;
+            uint8_t shift = 0;
+            while (recPos < recLen) {
+                uint8_t b = rec[recPos++];
+                delta |= (uint64_t)(b & 0x7F) << shift;
+                shift += 7;
+                if (!(b & 0x80)) break;
+            }
+            c.lastMs += delta;
+            c.pulses++;
+            if (channel >= 0 && recChannel != channel) continue;
+            if (c.lastMs < fromMs || c.lastMs >= toMs) continue;
+            if (ndjson) {
+                append("{\"meter\":%u,\"t\":%llu,\"pulse\":%llu}\n", (unsigned)recChannel,
+                       (unsigned long long)c.lastMs, (unsigned long long)c.pulses);
+            } else {
+                append("%u,%llu,%llu\n", (unsigned)recChannel, (unsigned long long)c.lastMs, (unsigned long long)c.pulses);
+            }
+        }
+    }
+
+    bool nextRecord() {
+        recPos = recLen = 0;
+        std::lock_guard<std::mutex> lock(log.mutex);
+        while (page < log.pages()) {
+            if (!pageOpen) {
+                PulseLogPageHeader h;
+                // Stop at pages entirely after toMs, or overwritten since the export started
+                if (!log.readHeader(page, h) || (pageStarted && !anySelectedBefore(h, toMs))) return false;
+                for (uint8_t ch = 0; ch < PulseLog::CHANNELS; ch++) {
+                    state[ch].lastMs = h.baseMs[ch];
+                    state[ch].pulses = h.pulsesBefore[ch];
+                }
+                pageOpen = pageStarted = true;
+                offset = PulseLog::HEADER;
+            }
+            uint8_t ch;
+            if (log.readRecord(log.physical(page), offset, ch, rec, recLen)) {
+                offset += 2 + recLen;
+                recChannel = ch;
+                return true;
+            }
+            pageOpen = false;
+            page++;
+        }
+        return false;
+    }
+
+    bool anySelectedBefore(const PulseLogPageHeader& h, uint64_t tMs) const {
+        for (uint8_t ch = 0; ch < PulseLog::CHANNELS; ch++) {
+            if ((channel < 0 || channel == ch) && h.baseMs[ch] < tMs) return true;
+        }
+        return false;
+    }
+
+    void append(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(scratch + len, sizeof(scratch) - len, fmt, args);
+        va_end(args);
+        if (n > 0) len += ((size_t)n < sizeof(scratch) - len) ? (size_t)n : sizeof(scratch) - len - 1;
+    }
+
+    const PulseLog& log;
+    int8_t channel;
+    uint64_t fromMs;
+    uint64_t toMs;
+    bool ndjson;
+    bool headerDone = false;
+    uint32_t page = 0;
+    bool pageOpen = false;
+    bool pageStarted = false;
+    uint32_t offset = 0;
+    PulseLog::Cursor state[PulseLog::CHANNELS];
+    uint8_t rec[PulseLog::RECORD_MAX];
+    uint8_t recLen = 0;
+    uint8_t recPos = 0;
+    uint8_t recChannel = 0;
+    char scratch[512];
+    size_t pos = 0;
+    size_t len = 0;
+};
+
+#endif // WATER_METER_PULSE_LOG_H
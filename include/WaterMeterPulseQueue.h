@@ -0,0 +1,80 @@
+#ifndef WATER_METER_PULSE_QUEUE_H
+#define WATER_METER_PULSE_QUEUE_H
+
+#include <Arduino.h>
+#include <atomic>
+
+/**
+ * @brief Lock-free single-producer/single-consumer queue of pulse timestamps
+ *
+ * Producer: waterMeterPulseISR() pushes the micros() timestamp of every
+ * accepted pulse. Consumer: WaterMeterComponent::loop() drains in batches.
+ *
+ * Each index is written by exactly one side, so no lock or critical section
+ * is needed. When the queue is full the timestamp is dropped and the overflow
+ * counter incremented; loop() still credits the pulse (the overflow count
+ * tells it how many) to the totals, without timing information.
+ *
+ * push() is forced inline so it ends up inside the IRAM ISR body
+ * (no out-of-line template code called from interrupt context).
+ *
+ * @tparam Capacity Number of slots (power of two)
+ */
+template <uint32_t Capacity>
+class PulseQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "PulseQueue capacity must be a power of two");
+
+public:
+    /**
+     * @brief Enqueue a pulse timestamp (ISR side)
+     * @return false if the queue was full (timestamp dropped, overflow counted)
+     */
+    inline __attribute__((always_inline)) bool push(uint32_t timestampUs) {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        uint32_t t = tail.load(std::memory_order_acquire);
+        if (h - t >= Capacity) {
+            overflows.store(overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+        buffer[h & (Capacity - 1)] = timestampUs;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Dequeue up to maxCount timestamps, oldest first (loop side)
+     * @return Number of timestamps copied to out
+     */
+    uint32_t drain(uint32_t* out, uint32_t maxCount) {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        uint32_t h = head.load(std::memory_order_acquire);
+        uint32_t n = h - t;
+        if (n > maxCount) n = maxCount;
+        for (uint32_t i = 0; i < n; i++) {
+            out[i] = buffer[(t + i) & (Capacity - 1)];
+        }
+        tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+
+    /** @brief Number of timestamps waiting to be drained */
+    uint32_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed);
+    }
+
+    /** @brief Total timestamps dropped because the queue was full (monotonic) */
+    uint32_t overflowCount() const {
+        return overflows.load(std::memory_order_relaxed);
+    }
+
+    static constexpr uint32_t capacity() { return Capacity; }
+
+private:
+    uint32_t buffer[Capacity] = {};
+    std::atomic<uint32_t> head{0};       // Written by producer only
+    std::atomic<uint32_t> tail{0};       // Written by consumer only
+    std::atomic<uint32_t> overflows{0};  // Written by producer only
+};
+
+#endif // WATER_METER_PULSE_QUEUE_H
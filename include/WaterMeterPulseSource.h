@@ -0,0 +1,450 @@
+#ifndef WATER_METER_PULSE_SOURCE_H
+#define WATER_METER_PULSE_SOURCE_H
+
+#include <Arduino.h>
+#include <DomoticsCore/Logger.h>
+#include <memory>
+#include "WaterMeterConfig.h"
+#include "WaterMeterPulseQueue.h"
+#include "WaterMeterEdgeStats.h"
+#include "WaterMeterIsrStats.h"
+#include "WaterMeterPulseTask.h"
+
+#if defined(ESP32)
+#include <driver/pcnt.h>
+#endif
+
+/**
+ * @brief Per-channel ISR state, one slot per meter (struct of arrays)
+ *
+ * The ISR of channel N only touches index N of each array: adding meters
+ * adds no per-pulse work (no scan, channel index comes from the interrupt
+ * argument). A plain global like the former g_* variables, so it lands in
+ * internal DRAM .bss, never flash or PSRAM. Must be outside any class to
+ * avoid ESP32 IRAM linker issues (see docs/ARCHITECTURE.md).
+ */
+struct PulseChannelTable {
+    static constexpr uint8_t SIZE = WATER_METER_MAX_CHANNELS;
+
+    volatile uint32_t lastPulseTime[SIZE];
+    volatile uint32_t lastRisingTime[SIZE];     // Last time signal went HIGH
+    volatile uint32_t lastIgnoredTimeDiff[SIZE];
+    volatile uint32_t bootTime[SIZE];           // Boot timestamp for initialization delay
+    PulseQueue<WATER_METER_PULSE_QUEUE_SIZE> queue[SIZE];  // Accepted pulse timestamps (µs) for loop()
+    void* volatile pulseTask[SIZE];             // PulseTask::notifyHandle() to wake per pulse (nullptr = loop() drains)
+#if WATER_METER_EDGE_STATS
+    EdgeStats edges[SIZE];                      // Edge timing histograms (ISR source only)
+#endif
+    IsrStats isr[SIZE];                         // Per-reason edge counters + ISR cycle timing
+
+    // Config values used by ISR (set by the channel's component during begin())
+    volatile uint32_t debounceMs[SIZE];
+    volatile uint32_t highStableMs[SIZE];
+    volatile uint32_t bootInitDelayMs[SIZE];
+    volatile uint8_t pin[SIZE];                 // Pin number for digitalRead in ISR
+
+    volatile bool pulseIgnored[SIZE];
+    volatile bool initializationComplete[SIZE]; // ISR enabled after delay
+    volatile bool initJustCompleted[SIZE];      // Flag to log init completion (non-ISR)
+};
+
+namespace {
+    PulseChannelTable g_channels;
+}
+
+/**
+ * @brief Edge handler body (forced inline into waterMeterPulseISR's IRAM code)
+ */
+static inline __attribute__((always_inline)) void waterMeterHandleEdge(uint8_t ch) {
+    PulseChannelTable& c = g_channels;
+    IsrStats& stats = c.isr[ch];
+    uint32_t currentTime = millis();
+    uint32_t currentTimeUs = micros();
+    int pinState = digitalRead(c.pin[ch]);
+    stats.edges++;
+    
+    // Ignore pulses during initialization period (prevents boot false positives)
+    if (!c.initializationComplete[ch]) {
+        if (currentTime - c.bootTime[ch] < c.bootInitDelayMs[ch]) {
+            stats.bootDropped++;
+            return;  // Silent ignore during boot
+        }
+        c.initializationComplete[ch] = true;
+        c.initJustCompleted[ch] = true;  // Flag for logging in loop()
+        // Initialize lastRisingTime to now to avoid immediate false trigger if we start LOW
+        c.lastRisingTime[ch] = currentTime;
+#if WATER_METER_EDGE_STATS
+        c.edges[ch].clear(currentTimeUs, currentTime);
+#endif
+    }
+    
+    if (pinState == LOW) { // FALLING EDGE (Potential Pulse)
+        uint32_t timeDiff = currentTime - c.lastPulseTime[ch];
+        uint32_t stableHighDiff = currentTime - c.lastRisingTime[ch];
+        bool stableHigh = stableHighDiff > c.highStableMs[ch];
+#if WATER_METER_EDGE_STATS
+        EdgeStats& e = c.edges[ch];
+        e.fallInterval.record(currentTimeUs - e.lastFallUs, currentTime - e.lastFallMs);
+        e.highTime.record(currentTimeUs - e.lastRiseUs, stableHighDiff);
+        if (stableHigh) {
+            e.pulseInterval.record(currentTimeUs - e.lastPulseUs, timeDiff);
+        }
+        e.lastFallUs = currentTimeUs;
+        e.lastFallMs = currentTime;
+#endif
+        
+        // Valid pulse requires:
+        // 1. Enough time since last pulse (Debounce)
+        // 2. Signal was HIGH for enough time before this FALLING edge (Stability)
+        if (timeDiff > c.debounceMs[ch] && stableHigh) {
+            c.lastPulseTime[ch] = currentTime;
+            c.queue[ch].push(currentTimeUs);  // Full queue → counted as overflow, pulse still credited
+            stats.accepted++;
+            void* task = c.pulseTask[ch];
+            if (task) PulseTask::notifyFromIsr(task);
+#if WATER_METER_EDGE_STATS
+            e.lastPulseUs = currentTimeUs;
+            e.accepted++;
+#endif
+        } else {
+            c.pulseIgnored[ch] = true;
+            c.lastIgnoredTimeDiff[ch] = timeDiff;
+            // Debounce takes precedence when both checks fail
+            if (timeDiff <= c.debounceMs[ch]) {
+                stats.rejectedDebounce++;
+            } else {
+                stats.rejectedStable++;
+            }
+        }
+    } else { // RISING EDGE (Magnet leaving)
+        c.lastRisingTime[ch] = currentTime;
+#if WATER_METER_EDGE_STATS
+        EdgeStats& e = c.edges[ch];
+        e.lowTime.record(currentTimeUs - e.lastFallUs, currentTime - e.lastFallMs);
+        e.lastRiseUs = currentTimeUs;
+#endif
+    }
+}
+
+/**
+ * @brief Per-channel pulse ISR (attachInterruptArg, arg = channel index)
+ */
+void IRAM_ATTR waterMeterPulseISR(void* arg) {
+    const uint8_t ch = (uint8_t)(uintptr_t)arg;
+#if WATER_METER_ISR_TIMING
+    uint32_t startCycles = ESP.getCycleCount();
+    waterMeterHandleEdge(ch);
+    g_channels.isr[ch].recordCycles(ESP.getCycleCount() - startCycles);
+#else
+    waterMeterHandleEdge(ch);
+#endif
+}
+
+/**
+ * @brief Where accepted pulses come from (GPIO interrupt, PCNT hardware, mock)
+ *
+ * Contract for every backend:
+ * - drain() hands out the timestamps (micros()) of accepted pulses
+ * - untimedCount() is a running total of accepted pulses whose timestamp
+ *   was lost; the component credits the difference without timing
+ * - drained + untimed pulses are the whole count: the 64-bit total is owned
+ *   by the component in loop(), backends never touch it (no torn 64-bit
+ *   read-modify-write between interrupt and task context)
+ * - service() is called once per loop() before draining (polled backends)
+ * - g_channels.isr[channel] counters are kept by the backend (timing: ISR only)
+ */
+class PulseSource {
+public:
+    virtual ~PulseSource() {}
+
+    virtual const char* name() const = 0;
+    virtual bool begin(const WaterMeterConfig& cfg) = 0;
+    virtual void end() = 0;
+
+    /** @brief Apply runtime config changes (debounce, stability) */
+    virtual void configure(const WaterMeterConfig& cfg) = 0;
+
+    virtual void service(uint32_t nowMs) { (void)nowMs; }
+    virtual uint32_t drain(uint32_t* timestampsUs, uint32_t maxCount) = 0;
+    virtual uint32_t untimedCount() const = 0;
+};
+
+/**
+ * @brief Current behaviour: CHANGE interrupt on the pulse pin, debounce +
+ * HIGH-stability check in waterMeterPulseISR(), timestamps via g_channels.queue[channel]
+ */
+class IsrPulseSource : public PulseSource {
+public:
+    const char* name() const override { return "isr"; }
+
+    bool begin(const WaterMeterConfig& cfg) override {
+        ch = cfg.channel;
+        pin = cfg.pulseInputPin;
+        g_channels.pin[ch] = cfg.pulseInputPin;
+        g_channels.bootInitDelayMs[ch] = cfg.bootInitDelayMs;
+        configure(cfg);
+        // CHANGE to detect both edges for stability check; channel index as ISR argument
+        attachInterruptArg(digitalPinToInterrupt(pin), waterMeterPulseISR, (void*)(uintptr_t)ch, CHANGE);
+        attached = true;
+        return true;
+    }
+
+    void end() override {
+        if (attached) {
+            detachInterrupt(digitalPinToInterrupt(pin));
+            attached = false;
+        }
+    }
+
+    void configure(const WaterMeterConfig& cfg) override {
+        g_channels.debounceMs[cfg.channel] = cfg.pulseDebounceMs;
+        g_channels.highStableMs[cfg.channel] = cfg.pulseHighStableMs;
+    }
+
+    uint32_t drain(uint32_t* timestampsUs, uint32_t maxCount) override {
+        return g_channels.queue[ch].drain(timestampsUs, maxCount);
+    }
+
+    uint32_t untimedCount() const override {
+        return g_channels.queue[ch].overflowCount();
+    }
+
+private:
+    uint8_t ch = 0;
+    uint8_t pin = 0;
+    bool attached = false;
+};
+
+/**
+ * @brief Base for backends that learn about pulses by polling a counter
+ *
+ * Turns "N new pulses since last poll" into accepted, timestamped pulses:
+ * - boot protection: pulses during bootInitDelayMs are discarded
+ * - software debounce at poll granularity: at most one pulse per
+ *   pulseDebounceMs since the last accepted one (excess = rejected)
+ * - timestamps spread evenly over the poll interval (timing resolution
+ *   = poll period, good enough for flow rate)
+ */
+class PolledPulseSource : public PulseSource {
+public:
+    void configure(const WaterMeterConfig& cfg) override {
+        debounceUs = cfg.pulseDebounceMs * 1000UL;
+        pollMs = cfg.pcntPollMs ? cfg.pcntPollMs : 1;
+    }
+
+    uint32_t drain(uint32_t* timestampsUs, uint32_t maxCount) override {
+        return queue.drain(timestampsUs, maxCount);
+    }
+
+    uint32_t untimedCount() const override {
+        return queue.overflowCount();
+    }
+
+    /** @brief Counter edges discarded by the poll-level debounce */
+    uint32_t rejectedCount() const { return rejected; }
+
+protected:
+    void startPolling(const WaterMeterConfig& cfg) {
+        ch = cfg.channel;
+        configure(cfg);
+        bootDelayMs = cfg.bootInitDelayMs;
+        lastPollUs = micros();
+        lastAcceptedUs = lastPollUs - debounceUs;
+        nextPollMs = millis();
+    }
+
+    bool pollDue(uint32_t nowMs) {
+        if ((int32_t)(nowMs - nextPollMs) < 0) return false;
+        nextPollMs = nowMs + pollMs;
+        return true;
+    }
+
+    /** @brief Account counter delta observed at this poll */
+    void accept(uint32_t delta, uint32_t nowMs) {
+        uint32_t nowUs = micros();
+        uint32_t spanUs = nowUs - lastPollUs;
+        lastPollUs = nowUs;
+        if (delta == 0) return;
+        IsrStats& stats = g_channels.isr[ch];
+        stats.edges += delta;
+
+        if (!g_channels.initializationComplete[ch]) {
+            if (nowMs - g_channels.bootTime[ch] < bootDelayMs) {
+                stats.bootDropped += delta;
+                return;  // Boot protection, same as the ISR
+            }
+            g_channels.initializationComplete[ch] = true;
+            g_channels.initJustCompleted[ch] = true;
+        }
+
+        uint32_t allowed = delta;
+        if (debounceUs > 0) {
+            uint32_t sinceAccepted = nowUs - lastAcceptedUs;
+            allowed = sinceAccepted / debounceUs;
+            if (allowed > delta) allowed = delta;
+        }
+        rejected += delta - allowed;
+        stats.rejectedDebounce += delta - allowed;
+        stats.accepted += allowed;
+        if (allowed == 0) {
+            g_channels.pulseIgnored[ch] = true;
+            g_channels.lastIgnoredTimeDiff[ch] = (nowUs - lastAcceptedUs) / 1000;
+            return;
+        }
+
+        for (uint32_t i = 1; i <= allowed; i++) {
+            queue.push(nowUs - spanUs + (uint32_t)((uint64_t)spanUs * i / allowed));
+        }
+        g_channels.lastPulseTime[ch] = nowMs;
+        lastAcceptedUs = nowUs;
+    }
+
+    uint8_t ch = 0;
+
+private:
+    PulseQueue<WATER_METER_PULSE_QUEUE_SIZE> queue;
+    uint32_t debounceUs = 0;
+    uint32_t pollMs = 50;
+    uint32_t bootDelayMs = 0;
+    uint32_t nextPollMs = 0;
+    uint32_t lastPollUs = 0;
+    uint32_t lastAcceptedUs = 0;
+    uint32_t rejected = 0;
+};
+
+#if defined(ESP32)
+/**
+ * @brief ESP32 PCNT hardware counter: no CPU interrupt per edge
+ *
+ * Counts FALLING edges (magnet leaving, like the ISR) with the PCNT glitch
+ * filter (pcntFilterTicks APB cycles, max 1023 = 12.8 µs) and is polled
+ * every pcntPollMs from loop(). The hardware filter only removes µs
+ * glitches: ms-range reed bounce is handled by the poll-level debounce,
+ * and the ISR's HIGH-stability check has no equivalent here, so this
+ * backend suits clean (open collector / hall) outputs or RC-filtered reeds.
+ */
+class PcntPulseSource : public PolledPulseSource {
+public:
+    static constexpr int16_t COUNTER_LIMIT = 32767;  // Counter wraps to 0 here
+
+    const char* name() const override { return "pcnt"; }
+
+    bool begin(const WaterMeterConfig& cfg) override {
+        pcnt_config_t pc = {};
+        pc.pulse_gpio_num = cfg.pulseInputPin;
+        pc.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+        pc.channel = PCNT_CHANNEL_0;
+        unit = (pcnt_unit_t)(PCNT_UNIT_0 + cfg.channel);  // One PCNT unit per channel (8 on ESP32)
+        pc.unit = unit;
+        pc.pos_mode = PCNT_COUNT_DIS;   // Rising: magnet arriving (ignored)
+        pc.neg_mode = PCNT_COUNT_INC;   // Falling: magnet leaving = 1 pulse
+        pc.lctrl_mode = PCNT_MODE_KEEP;
+        pc.hctrl_mode = PCNT_MODE_KEEP;
+        pc.counter_h_lim = COUNTER_LIMIT;
+        pc.counter_l_lim = 0;
+        if (pcnt_unit_config(&pc) != ESP_OK) {
+            DLOG_E(LOG_SENSOR, "PCNT unit config failed on GPIO %d", cfg.pulseInputPin);
+            return false;
+        }
+        pcnt_set_filter_value(unit, cfg.pcntFilterTicks > 1023 ? 1023 : cfg.pcntFilterTicks);
+        pcnt_filter_enable(unit);
+        pcnt_counter_pause(unit);
+        pcnt_counter_clear(unit);
+        pcnt_counter_resume(unit);
+        lastCount = 0;
+        startPolling(cfg);
+        running = true;
+        return true;
+    }
+
+    void end() override {
+        if (running) {
+            pcnt_counter_pause(unit);
+            running = false;
+        }
+    }
+
+    void service(uint32_t nowMs) override {
+        if (!running || !pollDue(nowMs)) return;
+        int16_t count = 0;
+        if (pcnt_get_counter_value(unit, &count) != ESP_OK) return;
+        // Never cleared while running (clear would race with edges): diff modulo the limit
+        int32_t delta = (int32_t)count - lastCount;
+        if (delta < 0) delta += COUNTER_LIMIT;
+        lastCount = count;
+        accept((uint32_t)delta, nowMs);
+    }
+
+private:
+    pcnt_unit_t unit = PCNT_UNIT_0;
+    int16_t lastCount = 0;
+    bool running = false;
+};
+#endif
+
+/**
+ * @brief Host/test backend: pulses are injected by the test, no GPIO at all
+ *
+ * inject() behaves like an accepted ISR pulse (counted + timestamp queued);
+ * injectUntimed() simulates pulses whose timestamp was lost.
+ */
+class MockPulseSource : public PulseSource {
+public:
+    const char* name() const override { return "mock"; }
+    bool begin(const WaterMeterConfig& cfg) override { ch = cfg.channel; return true; }
+    void end() override {}
+    void configure(const WaterMeterConfig&) override {}
+
+    void inject(uint32_t timestampUs) {
+        g_channels.isr[ch].edges++;
+        g_channels.isr[ch].accepted++;
+        queue.push(timestampUs);
+        notifyTask();
+    }
+
+    void injectUntimed(uint32_t pulses) {
+        g_channels.isr[ch].edges += pulses;
+        g_channels.isr[ch].accepted += pulses;
+        untimed += pulses;
+        notifyTask();
+    }
+
+    uint32_t drain(uint32_t* timestampsUs, uint32_t maxCount) override {
+        return queue.drain(timestampsUs, maxCount);
+    }
+
+    uint32_t untimedCount() const override {
+        return untimed + queue.overflowCount();
+    }
+
+private:
+    void notifyTask() {
+        void* task = g_channels.pulseTask[ch];
+        if (task) PulseTask::notifyFromIsr(task);
+    }
+
+    PulseQueue<WATER_METER_PULSE_QUEUE_SIZE> queue;
+    std::atomic<uint32_t> untimed{0};  // Injector thread vs pulse task (host)
+    uint8_t ch = 0;
+};
+
+/**
+ * @brief Backend for the configured type (PCNT falls back to ISR off-ESP32)
+ */
+inline std::unique_ptr<PulseSource> createPulseSource(PulseSourceType type) {
+    switch (type) {
+#if defined(ESP32)
+        case PulseSourceType::Pcnt:
+            return std::unique_ptr<PulseSource>(new PcntPulseSource());
+#endif
+        case PulseSourceType::Mock:
+            return std::unique_ptr<PulseSource>(new MockPulseSource());
+        default:
+            if (type != PulseSourceType::Interrupt) {
+                DLOG_W(LOG_SENSOR, "Pulse source %u not available on this target, using ISR", (unsigned)type);
+            }
+            return std::unique_ptr<PulseSource>(new IsrPulseSource());
+    }
+}
+
+#endif // WATER_METER_PULSE_SOURCE_H
@@ -0,0 +1,199 @@
+#ifndef WATER_METER_PULSE_TASK_H
+#define WATER_METER_PULSE_TASK_H
+
+#include <Arduino.h>
+
+#if defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+#else
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+/**
+ * @brief Worker that runs pulse processing outside loop(), woken by the ISR
+ *
+ * ESP32: a FreeRTOS task pinned to one core. The ISR wakes it with a task
+ * notification (notifyFromIsr(), forced inline so it stays in the IRAM ISR
+ * body); it also wakes every tickMs for timers (LED, flow, polled sources).
+ * Host: a std::thread with a condition variable standing in for the
+ * notification, so the replay can run the same code concurrently with
+ * loop(). Core and priority only mean something on the ESP32.
+ *
+ * The work function runs in the task only. Stats are 32-bit words written
+ * by the task and read anywhere.
+ */
+class PulseTask {
+public:
+    typedef void (*Work)(void* arg, uint32_t nowMs);
+
+    struct Stats {
+        volatile uint32_t runs = 0;        // Work calls (notifications + ticks)
+        volatile uint32_t lastRunUs = 0;
+        volatile uint32_t maxRunUs = 0;    // Longest work call: bound on pulse-to-state latency after wake-up
+    };
+
+    ~PulseTask() {
+        stop();
+    }
+
+    /**
+     * @brief Start the task (no-op returning true when already running)
+     * @param name Task name (ESP32, max 15 chars)
+     */
+    bool start(const char* name, Work fn, void* fnArg, uint8_t core, uint8_t priority, uint32_t tickIntervalMs) {
+        if (running()) return true;
+        work = fn;
+        arg = fnArg;
+        tickMs = tickIntervalMs ? tickIntervalMs : 1;
+        stopRequested = false;
+        stats.runs = 0;
+        stats.lastRunUs = 0;
+        stats.maxRunUs = 0;
+#if defined(ESP32)
+        exited = false;
+        if (xTaskCreatePinnedToCore(entry, name, STACK_BYTES, this, priority, &handle,
+                                    core < portNUM_PROCESSORS ? core : tskNO_AFFINITY) != pdPASS) {
+            handle = nullptr;
+            return false;
+        }
+#else
+        (void)name;
+        (void)core;
+        (void)priority;
+        pending = false;
+        thread = std::thread(entry, this);
+        started = true;
+#endif
+        return true;
+    }
+
+    /** @brief Ask the task to finish its current run and wait until it has exited */
+    void stop() {
+        if (!running()) return;
+        stopRequested = true;
+#if defined(ESP32)
+        xTaskNotifyGive(handle);
+        while (!exited) {
+            vTaskDelay(1);
+        }
+        handle = nullptr;
+#else
+        notify();
+        thread.join();
+        started = false;
+#endif
+    }
+
+    bool running() const {
+#if defined(ESP32)
+        return handle != nullptr;
+#else
+        return started;
+#endif
+    }
+
+    /** @brief Value the ISR passes to notifyFromIsr() (nullptr when not running) */
+    void* notifyHandle() {
+#if defined(ESP32)
+        return (void*)handle;
+#else
+        return started ? this : nullptr;
+#endif
+    }
+
+    /** @brief Wake the task from interrupt context */
+    static inline __attribute__((always_inline)) void notifyFromIsr(void* h) {
+#if defined(ESP32)
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR((TaskHandle_t)h, &woken);
+        if (woken == pdTRUE) portYIELD_FROM_ISR();
+#else
+        static_cast<PulseTask*>(h)->notify();
+#endif
+    }
+
+    /** @brief Wake the task from task context */
+    void notify() {
+#if defined(ESP32)
+        if (handle) xTaskNotifyGive(handle);
+#else
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending = true;
+        }
+        wake.notify_one();
+#endif
+    }
+
+    const Stats& getStats() const { return stats; }
+
+private:
+    static constexpr uint32_t STACK_BYTES = 4096;
+
+    void runOnce() {
+        uint64_t t0 = nowUs();
+        work(arg, millis());
+        uint32_t us = (uint32_t)(nowUs() - t0);
+        stats.runs++;
+        stats.lastRunUs = us;
+        if (us > stats.maxRunUs) stats.maxRunUs = us;
+    }
+
+#if defined(ESP32)
+    static uint64_t nowUs() { return (uint64_t)esp_timer_get_time(); }
+
+    static void entry(void* p) {
+        PulseTask* self = static_cast<PulseTask*>(p);
+        while (!self->stopRequested) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(self->tickMs));
+            if (self->stopRequested) break;
+            self->runOnce();
+        }
+        self->exited = true;
+        vTaskDelete(nullptr);
+    }
+
+    TaskHandle_t handle = nullptr;
+    volatile bool stopRequested = false;
+    volatile bool exited = true;
+#else
+    // Real time, not the replay's virtual clock: measures the work itself
+    static uint64_t nowUs() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static void entry(PulseTask* self) {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(self->mutex);
+                self->wake.wait_for(lock, std::chrono::milliseconds(self->tickMs),
+                                    [self]() { return self->pending || self->stopRequested.load(); });
+                self->pending = false;
+            }
+            if (self->stopRequested) break;
+            self->runOnce();
+        }
+    }
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool pending = false;
+    bool started = false;
+    std::atomic<bool> stopRequested{false};
+#endif
+
+    Work work = nullptr;
+    void* arg = nullptr;
+    uint32_t tickMs = 10;
+    Stats stats;
+};
+
+#endif // WATER_METER_PULSE_TASK_H
@@ -0,0 +1,91 @@
+#ifndef WATER_METER_SEQLOCK_H
+#define WATER_METER_SEQLOCK_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <string.h>
+#include <type_traits>
+
+/**
+ * @brief Single-writer sequence lock: tear-free copies of a plain struct on any core
+ *
+ * The writer makes the sequence odd, stores the value, then makes it even
+ * again. A reader copies the value between two loads of the sequence and
+ * retries when they differ or the first one was odd (write in progress).
+ * Readers never block the writer and nothing disables interrupts: a reader
+ * only retries while one write() of sizeof(T) bytes is under way.
+ *
+ * The value is held as 32-bit words with relaxed atomic accesses, so a copy
+ * racing a write is well-defined (and thrown away); the fences order those
+ * words against the sequence (write: release after the odd store, read:
+ * acquire before the second load).
+ *
+ * Exactly one writer task; any number of readers on either core. Values
+ * move word by word, with no full-size staging copy on the stack, so
+ * kilobyte payloads (ConsumptionHistory) can be read from small task stacks.
+ *
+ * @tparam T Trivially copyable payload
+ */
+template <typename T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock payload must be trivially copyable");
+
+public:
+    SeqLock() {
+        write(T());
+    }
+
+    /** @brief Publish a new value (writer task only) */
+    void write(const T& value) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+        uint32_t s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; i++) {
+            uint32_t word = 0;  // Tail padding
+            memcpy(&word, bytes + i * 4, wordBytes(i));
+            data[i].store(word, std::memory_order_relaxed);
+        }
+        seq.store(s + 2, std::memory_order_release);
+    }
+
+    /** @brief Consistent copy of the last published value (any task/core) */
+    T read() const {
+        T value;
+        read(value);
+        return value;
+    }
+
+    /** @brief Same, into caller storage */
+    void read(T& value) const {
+        uint8_t* bytes = reinterpret_cast<uint8_t*>(&value);
+        uint32_t before;
+        uint32_t after;
+        do {
+            before = seq.load(std::memory_order_acquire);
+            for (size_t i = 0; i < WORDS; i++) {
+                uint32_t word = data[i].load(std::memory_order_relaxed);
+                memcpy(bytes + i * 4, &word, wordBytes(i));
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = seq.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+    }
+
+    /** @brief Writes so far (each write adds 2) */
+    uint32_t sequence() const {
+        return seq.load(std::memory_order_acquire);
+    }
+
+private:
+    static constexpr size_t WORDS = (sizeof(T) + 3) / 4;
+
+    static size_t wordBytes(size_t i) {
+        return i + 1 < WORDS ? 4 : sizeof(T) - i * 4;
+    }
+
+    std::atomic<uint32_t> seq{0};
+    std::atomic<uint32_t> data[WORDS];
+};
+
+#endif // WATER_METER_SEQLOCK_H
@@ -0,0 +1,63 @@
+#ifndef WATER_METER_VOLUME_H
+#define WATER_METER_VOLUME_H
+
+#include <Arduino.h>
+#include <math.h>
+#include "WaterMeterConfig.h"
+
+/**
+ * @brief Pulse → volume conversion in integer milliliters
+ *
+ * All totals are kept in mL, so sub-liter meters (0.5, 0.25, 0.1 L/pulse)
+ * accumulate exactly and the hot path is one 32-bit multiply + 64-bit add.
+ * With WATER_METER_ML_PER_PULSE set at build time the factor is a constant
+ * (1000 = shifts/adds, no multiply) and litersPerPulse is ignored.
+ */
+class PulseVolume {
+public:
+    /** @brief litersPerPulse rounded to whole mL (at least 1) */
+    static uint32_t mlFromLiters(float litersPerPulse) {
+        long ml = lroundf(litersPerPulse * 1000.0f);
+        return ml > 0 ? (uint32_t)ml : 1;
+    }
+
+    void configure(float litersPerPulse) {
+        ml = WATER_METER_ML_PER_PULSE ? WATER_METER_ML_PER_PULSE : mlFromLiters(litersPerPulse);
+    }
+
+    uint32_t mlPerPulse() const {
+        return WATER_METER_ML_PER_PULSE ? WATER_METER_ML_PER_PULSE : ml;
+    }
+
+    /** @brief Volume of a loop() batch (fits 32 bits: < 4.2 m³ per call) */
+    inline uint32_t toMl(uint32_t pulses) const {
+        return mlPerPulse() * pulses;
+    }
+
+    inline uint64_t toMl(uint64_t pulses) const {
+        return (uint64_t)mlPerPulse() * pulses;
+    }
+
+private:
+    uint32_t ml = 1000;
+};
+
+// Output-edge conversions: the only place totals leave integer mL
+
+/** @brief Whole liters (truncated) */
+inline uint64_t waterMeterMlToLiters(uint64_t ml) {
+    return ml / 1000;
+}
+
+/** @brief m³ as float for HA/MQTT (exact to the liter up to 16 777 m³) */
+inline float waterMeterMlToM3(uint64_t ml) {
+    return (float)(ml / 1000) / 1000.0f;
+}
+
+/** @brief "12.345" (m³, liter resolution) without floating point */
+inline int waterMeterFormatM3(char* buf, size_t len, uint64_t ml) {
+    uint64_t liters = ml / 1000;
+    return snprintf(buf, len, "%llu.%03u", (unsigned long long)(liters / 1000), (unsigned)(liters % 1000));
+}
+
+#endif // WATER_METER_VOLUME_H
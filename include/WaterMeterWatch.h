@@ -0,0 +1,102 @@
+#ifndef WATER_METER_WATCH_H
+#define WATER_METER_WATCH_H
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include "WaterMeterConfig.h"
+
+/**
+ * @brief Bounded line queue behind the `water watch` console stream
+ *
+ * Lines are formatted straight into one of WATER_METER_WATCH_LINES fixed
+ * slots (no heap). drain() hands at most LINES_PER_LOOP of them to the
+ * console sink per loop(); a sink returning false (client busy) keeps the
+ * line for the next loop(). When the queue is full new lines are dropped
+ * and counted, and the next drain() reports the count first, so a slow or
+ * stalled telnet client costs fixed RAM and never holds up loop().
+ *
+ * Producers (event handlers, loop ticks) and the consumer all run in the
+ * main loop: no locking.
+ */
+class WatchStream {
+public:
+    enum class Mode : uint8_t { Off, Pulse, Second };
+
+    static constexpr uint8_t LINES = WATER_METER_WATCH_LINES;
+    static constexpr uint8_t LINE_LEN = 96;
+    static constexpr uint8_t LINES_PER_LOOP = 4;
+
+    typedef bool (*Sink)(const char* line);
+
+    void start(Mode m, int8_t meterIndex) {
+        clear();
+        mode = m;
+        meter = meterIndex;
+    }
+
+    void stop() {
+        mode = Mode::Off;
+        clear();
+    }
+
+    Mode getMode() const { return mode; }
+    bool active() const { return mode != Mode::Off; }
+
+    /** @brief Meter selected with the command (-1 = all) */
+    bool watches(uint8_t meterIndex) const {
+        return mode != Mode::Off && (meter < 0 || meter == (int8_t)meterIndex);
+    }
+
+    /** @brief Queue one formatted line; false (and counted) when the queue is full */
+    bool printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+        if (count >= LINES) {
+            dropped++;
+            return false;
+        }
+        va_list args;
+        va_start(args, fmt);
+        vsnprintf(lines[(head + count) % LINES], LINE_LEN, fmt, args);
+        va_end(args);
+        count++;
+        return true;
+    }
+
+    /** @brief Pass queued lines to the sink (bounded per call) */
+    uint8_t drain(Sink sink) {
+        if (dropped != reportedDropped) {
+            char note[48];
+            snprintf(note, sizeof(note), "... %lu lines dropped (client too slow)",
+                     (unsigned long)(dropped - reportedDropped));
+            if (!sink(note)) return 0;
+            reportedDropped = dropped;
+        }
+        uint8_t sent = 0;
+        while (count > 0 && sent < LINES_PER_LOOP) {
+            if (!sink(lines[head])) break;
+            head = (head + 1) % LINES;
+            count--;
+            sent++;
+        }
+        return sent;
+    }
+
+    uint8_t pending() const { return count; }
+    uint32_t droppedCount() const { return dropped; }
+
+private:
+    void clear() {
+        head = 0;
+        count = 0;
+        reportedDropped = dropped;
+    }
+
+    char lines[LINES][LINE_LEN];
+    uint8_t head = 0;
+    uint8_t count = 0;
+    uint32_t dropped = 0;          // Since boot
+    uint32_t reportedDropped = 0;  // Already announced by drain()
+    Mode mode = Mode::Off;
+    int8_t meter = -1;
+};
+
+#endif // WATER_METER_WATCH_H
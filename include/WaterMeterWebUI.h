@@ -5,20 +5,69 @@
 #include <DomoticsCore/WebUI.h>
 #include <DomoticsCore/BaseWebUIComponents.h>
 #include <ArduinoJson.h>
+#include <memory>
+#include <mutex>
 #include "WaterMeterComponent.h"
+#include "WaterMeterPulseLog.h"
+#include "WaterMeterMetrics.h"
 
 using namespace DomoticsCore;
 using namespace DomoticsCore::Components::WebUI;
 
+/**
+ * @brief API base path of a meter: "/api/watermeter" or "/api/watermeter/<channel>"
+ */
+inline String waterMeterApiBase(const WaterMeterComponent* waterMeter) {
+    String suffix = waterMeter->getEntitySuffix();
+    return suffix.length() ? String("/api/watermeter/") + suffix.substring(1) : String("/api/watermeter");
+}
+
 /**
  * @brief WebUI Provider for WaterMeter Component
+ * 
+ * One provider per meter; context ids carry the channel suffix
+ * ("watermeter_dashboard_hot"). Context payloads are serialized once per component state version
+ * (WaterMeterComponent::getStateVersion()) and kept; polls in between reuse
+ * the cached JSON, and the raw snapshot routes answer If-None-Match with 304.
+ *
+ * The WebUI provider calls and the raw routes (async_tcp task) share the
+ * cache: rendering and copying out happen under one mutex, callers only ever
+ * get copies. ETags carry a per-boot nonce, since state versions restart at 1
+ * on every boot.
  */
 class WaterMeterWebUIProvider : public IWebUIProvider {
+public:
+    static constexpr size_t ETAG_SIZE = 24;
+    
+    /** @brief Preserialized context payload */
+    struct Snapshot {
+        uint32_t version = 0;   // Component state version it was built from (0 = never)
+        String json;
+        char etag[ETAG_SIZE] = "";
+    };
+    
+    enum class SnapshotRead : uint8_t { Unknown, NotModified, Copied };
+
 private:
     WaterMeterComponent* waterMeter;
+    String dashboardId;
+    String settingsId;
+    String titleSuffix;
+    Snapshot dashboardSnapshot;
+    Snapshot settingsSnapshot;
+    std::mutex snapshotMutex;   // Cache shared by the provider calls and the raw routes
+    uint32_t bootNonce;         // ETag prefix: versions of different boots never match
     
 public:
-    explicit WaterMeterWebUIProvider(WaterMeterComponent* wm) : waterMeter(wm) {}
+    explicit WaterMeterWebUIProvider(WaterMeterComponent* wm) : waterMeter(wm), bootNonce(esp_random()) {
+        String suffix = wm ? wm->getEntitySuffix() : String("");
+        dashboardId = String("watermeter_dashboard") + suffix;
+        settingsId = String("watermeter_settings") + suffix;
+        titleSuffix = suffix.length() ? String(" (") + suffix.substring(1) + ")" : String("");
+    }
+    
+    const String& getDashboardContextId() const { return dashboardId; }
+    const String& getSettingsContextId() const { return settingsId; }
     
     String getWebUIName() const override { 
         return waterMeter ? waterMeter->metadata.name : String("WaterMeter"); 
@@ -29,62 +78,142 @@ public:
     }
     
     String getWebUIData(const String& contextId) override {
-        if (!waterMeter) return "{}";
+        String json;
+        char etag[ETAG_SIZE];
+        if (readSnapshot(contextId.c_str(), nullptr, json, etag) == SnapshotRead::Unknown) return String("{}");
+        return json;
+    }
+    
+    /**
+     * @brief Copy of the up-to-date cached payload for a context
+     * 
+     * Rebuilds only when the component state version moved. When ifNoneMatch
+     * equals the current ETag, only the ETag is copied (NotModified).
+     * @param etag Receives the ETag (ETAG_SIZE bytes)
+     */
+    SnapshotRead readSnapshot(const char* contextId, const char* ifNoneMatch, String& json, char* etag) {
+        if (!waterMeter) return SnapshotRead::Unknown;
         
+        Snapshot* snapshot;
+        if (strcmp(contextId, dashboardId.c_str()) == 0) {
+            snapshot = &dashboardSnapshot;
+        } else if (strcmp(contextId, settingsId.c_str()) == 0) {
+            snapshot = &settingsSnapshot;
+        } else {
+            return SnapshotRead::Unknown;
+        }
+        
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        uint32_t version = waterMeter->getStateVersion();
+        if (snapshot->version != version) {
+            render(snapshot == &dashboardSnapshot, snapshot->json);
+            snapshot->version = version;
+            snprintf(snapshot->etag, sizeof(snapshot->etag), "\"%c%08lx%08lx\"",
+                     snapshot == &dashboardSnapshot ? 'd' : 's', (unsigned long)bootNonce, (unsigned long)version);
+        }
+        memcpy(etag, snapshot->etag, ETAG_SIZE);
+        if (ifNoneMatch && strcmp(ifNoneMatch, snapshot->etag) == 0) {
+            return SnapshotRead::NotModified;
+        }
+        json = snapshot->json;
+        return SnapshotRead::Copied;
+    }
+    
+private:
+    void render(bool dashboard, String& output) {
         WaterMeterData data = waterMeter->getData();
         JsonDocument doc;
         
-        if (contextId == "watermeter_dashboard") {
+        if (dashboard) {
             // Real-time dashboard updates (called every 60s)
             // Use char buffers to avoid String allocations/concatenations
             char totalBuf[32];
             char dailyBuf[64];
             char yearlyBuf[64];
+            char flowBuf[64];
+            char alarmBuf[64];
+            char usageBuf[64];
+            char m3Buf[24];
             
-            snprintf(totalBuf, sizeof(totalBuf), "%.3f m³", data.totalM3);
-            snprintf(dailyBuf, sizeof(dailyBuf), "%llu L (%.3f m³)", data.dailyLiters, data.dailyM3);
-            snprintf(yearlyBuf, sizeof(yearlyBuf), "%llu L (%.3f m³)", data.yearlyLiters, data.yearlyM3);
+            waterMeterFormatM3(m3Buf, sizeof(m3Buf), data.totalMl);
+            snprintf(totalBuf, sizeof(totalBuf), "%s m³", m3Buf);
+            waterMeterFormatM3(m3Buf, sizeof(m3Buf), data.dailyMl);
+            snprintf(dailyBuf, sizeof(dailyBuf), "%llu L (%s m³)", (unsigned long long)data.dailyLiters(), m3Buf);
+            waterMeterFormatM3(m3Buf, sizeof(m3Buf), data.yearlyMl);
+            snprintf(yearlyBuf, sizeof(yearlyBuf), "%llu L (%s m³)", (unsigned long long)data.yearlyLiters(), m3Buf);
+            
+            // "<current> L (previous <closing> L)" per period
+            static const char* const PERIOD_FIELDS[WATER_PERIOD_COUNT] = {
+                "hour_liters", nullptr, "week_liters", "month_liters", "billing_liters", nullptr
+            };
+            char periodBuf[WATER_PERIOD_COUNT][48];
+            for (uint8_t p = 0; p < WATER_PERIOD_COUNT; p++) {
+                snprintf(periodBuf[p], sizeof(periodBuf[p]), "%llu L (previous %llu L)",
+                         (unsigned long long)data.periodLiters((WaterPeriod)p), (unsigned long long)data.previousLiters((WaterPeriod)p));
+                if (PERIOD_FIELDS[p]) doc[PERIOD_FIELDS[p]] = periodBuf[p];
+            }
+            snprintf(flowBuf, sizeof(flowBuf), "%.2f L/min (1m %.2f, 15m %.2f)",
+                     data.flowRateLpm, data.flow1mLpm, data.flow15mLpm);
+            if (data.leakAlarm || data.burstAlarm) {
+                snprintf(alarmBuf, sizeof(alarmBuf), "%s%s%s", data.leakAlarm ? "LEAK" : "",
+                         (data.leakAlarm && data.burstAlarm) ? " + " : "", data.burstAlarm ? "BURST" : "");
+            } else {
+                snprintf(alarmBuf, sizeof(alarmBuf), "OK (continuous flow %lu min)",
+                         (unsigned long)(data.continuousFlowS / 60));
+            }
+            snprintf(usageBuf, sizeof(usageBuf), "%s%llu L (usual %.0f L, score %.1f)", data.anomaly ? "UNUSUAL: " : "",
+                     (unsigned long long)data.previousLiters(WaterPeriod::Hour), data.usualHourL, data.anomalyScore);
             
             doc["pulse_count"] = data.pulseCount;
             doc["total_m3"] = totalBuf;
             doc["daily_liters"] = dailyBuf;
             doc["yearly_liters"] = yearlyBuf;
+            doc["yesterday_liters"] = data.previousLiters(WaterPeriod::Day);
+            doc["flow_rate"] = flowBuf;
+            doc["alarms"] = alarmBuf;
+            doc["hour_usage"] = usageBuf;
         }
-        else if (contextId == "watermeter_settings") {
+        else {
             // Update all input fields with current values
             doc["total_pulses"] = data.pulseCount;
-            doc["daily_liters"] = data.dailyLiters;
-            doc["yearly_liters"] = data.yearlyLiters;
+            doc["daily_liters"] = data.dailyLiters();
+            doc["yearly_liters"] = data.yearlyLiters();
         }
         
-        String output;
+        output = "";  // Keeps the String's buffer: no reallocation once sized
         serializeJson(doc, output);
-        return output;
     }
     
+public:
     std::vector<WebUIContext> getWebUIContexts() override {
         std::vector<WebUIContext> contexts;
         if (!waterMeter) return contexts;
         
-        WaterMeterData data = waterMeter->getData();
-        
         // Dashboard - Current Values (read-only display)
-        WebUIContext dashboard = WebUIContext::dashboard("watermeter_dashboard", "Water Consumption");
+        WebUIContext dashboard = WebUIContext::dashboard(dashboardId, "Water Consumption" + titleSuffix);
         dashboard.withField(WebUIField("pulse_count", "Total Pulses", WebUIFieldType::Display, "", "", true))
                  .withField(WebUIField("total_m3", "Total Volume", WebUIFieldType::Display, "", "", true))
+                 .withField(WebUIField("hour_liters", "This Hour", WebUIFieldType::Display, "", "", true))
                  .withField(WebUIField("daily_liters", "Today", WebUIFieldType::Display, "", "", true))
+                 .withField(WebUIField("yesterday_liters", "Yesterday (L)", WebUIFieldType::Display, "", "", true))
+                 .withField(WebUIField("week_liters", "This Week", WebUIFieldType::Display, "", "", true))
+                 .withField(WebUIField("month_liters", "This Month", WebUIFieldType::Display, "", "", true))
+                 .withField(WebUIField("billing_liters", "Billing Period", WebUIFieldType::Display, "", "", true))
                  .withField(WebUIField("yearly_liters", "This Year", WebUIFieldType::Display, "", "", true))
+                 .withField(WebUIField("flow_rate", "Flow Rate", WebUIFieldType::Display, "", "", true))
+                 .withField(WebUIField("alarms", "Leak / Burst", WebUIFieldType::Display, "", "", true))
+                 .withField(WebUIField("hour_usage", "Last Hour vs Usual", WebUIFieldType::Display, "", "", true))
                  .withRealTime(60000)  // Update every 60s (water consumption changes slowly)
-                 .withAPI("/api/watermeter/dashboard");
+                 .withAPI(waterMeterApiBase(waterMeter) + "/dashboard");
         contexts.push_back(dashboard);
         
         // Settings/Controls - Edit all counters
-        WebUIContext settings = WebUIContext::settings("watermeter_settings", "Water Meter Controls");
+        WebUIContext settings = WebUIContext::settings(settingsId, "Water Meter Controls" + titleSuffix);
         settings.withField(WebUIField("total_pulses", "Total Pulses", WebUIFieldType::Number, ""))
                 .withField(WebUIField("daily_liters", "Daily Liters", WebUIFieldType::Number, ""))
                 .withField(WebUIField("yearly_liters", "Yearly Liters", WebUIFieldType::Number, ""))
                 .withRealTime(60000)  // Sync input fields every 60s
-                .withAPI("/api/watermeter/settings");
+                .withAPI(waterMeterApiBase(waterMeter) + "/settings");
         contexts.push_back(settings);
         
         return contexts;
@@ -102,7 +231,7 @@ public:
         }
         
         // POST requests - handle actions
-        if (method == "POST" && contextId == "watermeter_settings") {
+        if (method == "POST" && contextId == settingsId) {
             auto fieldIt = params.find("field");
             auto valueIt = params.find("value");
             
@@ -135,4 +264,260 @@ public:
     }
 };
 
+/**
+ * @brief Serve a cached provider snapshot with ETag / 304 Not Modified
+ */
+inline void sendWaterMeterSnapshot(AsyncWebServerRequest* request, WaterMeterWebUIProvider* provider,
+                                   const char* contextId) {
+    const AsyncWebHeader* ifNoneMatch = request->getHeader("If-None-Match");
+    String json;
+    char etag[WaterMeterWebUIProvider::ETAG_SIZE];
+    WaterMeterWebUIProvider::SnapshotRead result =
+        provider->readSnapshot(contextId, ifNoneMatch ? ifNoneMatch->value().c_str() : nullptr, json, etag);
+    if (result == WaterMeterWebUIProvider::SnapshotRead::Unknown) {
+        request->send(404);
+        return;
+    }
+    
+    if (result == WaterMeterWebUIProvider::SnapshotRead::NotModified) {
+        AsyncWebServerResponse* response = request->beginResponse(304);
+        response->addHeader("ETag", etag);
+        request->send(response);
+        return;
+    }
+    
+    AsyncWebServerResponse* response = request->beginResponse(200, "application/json", json);
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", "no-cache");  // Always revalidate, 304 when unchanged
+    request->send(response);
+}
+
+/**
+ * @brief ISR counters + execution time as JSON (built on request)
+ *
+ * {"edges":N,"accepted":N,"rejectedDebounce":N,"rejectedStable":N,"bootDropped":N,
+ *  "cpuMhz":N,"cycles":{"min":N,"avg":N,"max":N,"timed":N,"binLower":[...],"bins":[...]}}
+ */
+inline String waterMeterIsrStatsJson(const WaterMeterComponent* waterMeter) {
+    IsrStats::Snapshot s = waterMeter->getIsrStats();
+    
+    String json;
+    json.reserve(512);
+    char buf[320];
+    snprintf(buf, sizeof(buf),
+             "{\"edges\":%lu,\"accepted\":%lu,\"rejectedDebounce\":%lu,\"rejectedStable\":%lu,"
+             "\"bootDropped\":%lu,\"cpuMhz\":%lu,\"cycles\":{\"min\":%lu,\"avg\":%lu,\"max\":%lu,\"timed\":%lu,",
+             (unsigned long)s.edges, (unsigned long)s.accepted, (unsigned long)s.rejectedDebounce,
+             (unsigned long)s.rejectedStable, (unsigned long)s.bootDropped, (unsigned long)s.cpuMhz,
+             (unsigned long)s.cyclesMin, (unsigned long)s.cyclesAvg, (unsigned long)s.cyclesMax,
+             (unsigned long)s.timedEdges);
+    json += buf;
+    json += "\"binLower\":[";
+    for (uint8_t b = 0; b < IsrStats::CYCLE_BINS; b++) {
+        if (b) json += ',';
+        json += String((unsigned long)IsrStats::cycleBinLower(b));
+    }
+    json += "],\"bins\":[";
+    for (uint8_t b = 0; b < IsrStats::CYCLE_BINS; b++) {
+        if (b) json += ',';
+        json += String((unsigned long)s.cycleBins[b]);
+    }
+    json += "]}}";
+    return json;
+}
+
+#if WATER_METER_EDGE_STATS
+/**
+ * @brief Edge timing histograms + tuner proposal as JSON (~2 KB, built on request)
+ *
+ * {"binLowerUs":[...],"fall":[...],"pulse":[...],"low":[...],"high":[...],
+ *  "accepted":N,"autoTune":bool,"debounceMs":N,"highStableMs":N,
+ *  "tuner":{"debounce":{"valid":bool,"noiseUs":N,"realUs":N,"ms":N},"stable":{...}}}
+ */
+inline String waterMeterEdgeStatsJson(const WaterMeterComponent* waterMeter) {
+    const EdgeStats& stats = waterMeter->getEdgeStats();
+    DebounceTuner::Result tuner = waterMeter->evaluateDebounce();
+    WaterMeterConfig cfg = waterMeter->getConfig();
+    
+    String json;
+    json.reserve(2048);
+    auto appendBins = [&json](const char* key, const EdgeHistogram* h) {
+        json += "\"";
+        json += key;
+        json += "\":[";
+        for (uint8_t b = 0; b < EdgeHistogram::BINS; b++) {
+            if (b) json += ',';
+            json += String((unsigned long)(h ? h->bins[b] : EdgeHistogram::binLowerUs(b)));
+        }
+        json += "],";
+    };
+    auto appendSplit = [&json](const char* key, const DebounceTuner::Split& split) {
+        char buf[96];
+        snprintf(buf, sizeof(buf), "\"%s\":{\"valid\":%s,\"noiseUs\":%lu,\"realUs\":%lu,\"ms\":%lu}",
+                 key, split.valid ? "true" : "false", (unsigned long)split.noiseUs,
+                 (unsigned long)split.realUs, (unsigned long)split.thresholdMs);
+        json += buf;
+    };
+    
+    json += '{';
+    appendBins("binLowerUs", nullptr);
+    appendBins("fall", &stats.fallInterval);
+    appendBins("pulse", &stats.pulseInterval);
+    appendBins("low", &stats.lowTime);
+    appendBins("high", &stats.highTime);
+    json += "\"accepted\":" + String((unsigned long)stats.accepted);
+    json += ",\"autoTune\":" + String(cfg.autoTuneDebounce ? "true" : "false");
+    json += ",\"debounceMs\":" + String((unsigned long)cfg.pulseDebounceMs);
+    json += ",\"highStableMs\":" + String((unsigned long)cfg.pulseHighStableMs);
+    json += ",\"tuner\":{";
+    appendSplit("debounce", tuner.debounce);
+    json += ',';
+    appendSplit("stable", tuner.stable);
+    json += "}}";
+    return json;
+}
+#endif
+
+/**
+ * @brief Epoch-seconds query parameter as ms (def when absent)
+ */
+inline uint64_t waterMeterTimeParamMs(AsyncWebServerRequest* request, const char* name, uint64_t def) {
+    if (!request->hasParam(name)) return def;
+    uint64_t s = strtoull(request->getParam(name)->value().c_str(), nullptr, 10);
+    return s > UINT64_MAX / 1000 ? UINT64_MAX : s * 1000ULL;
+}
+
+/**
+ * @brief Pulse log range query: {"from":s,"to":s,"pulses":n,"liters":"12.345","covered_from":s}
+ */
+inline String waterMeterVolumeJson(const PulseLog& log, const WaterMeterComponent* waterMeter, uint64_t fromMs, uint64_t toMs) {
+    uint8_t ch = waterMeter->getChannel();
+    uint64_t pulses = log.pulsesBefore(ch, toMs) - log.pulsesBefore(ch, fromMs);
+    uint64_t ml = pulses * waterMeter->getMlPerPulse();
+    char buf[192];
+    snprintf(buf, sizeof(buf), "{\"from\":%llu,\"to\":%llu,\"pulses\":%llu,\"liters\":\"%llu.%03u\",\"covered_from\":%llu}",
+             (unsigned long long)(fromMs / 1000), (unsigned long long)(toMs / 1000), (unsigned long long)pulses,
+             (unsigned long long)(ml / 1000), (unsigned)(ml % 1000), (unsigned long long)(log.coveredFromMs(ch) / 1000));
+    return String(buf);
+}
+
+/**
+ * @brief Register raw HTTP routes that bypass the provider String/JSON path
+ * 
+ * Paths are relative to waterMeterApiBase() ("/api/watermeter" for a single
+ * meter, "/api/watermeter/<channel>" otherwise):
+ * - GET <base>/history[?days=N]: hourly + daily history streamed as
+ *   chunked JSON by HistoryJsonWriter (a few hundred bytes of state per
+ *   request instead of a JsonDocument holding a year of buckets)
+ * - GET <base>/snapshot/{dashboard,settings}: cached context JSON
+ *   with ETag; unchanged state is answered with 304 and no body
+ * - GET <base>/stats: edge counters by outcome and ISR execution time
+ * - GET <base>/edges: ISR edge timing histograms and debounce tuner proposal
+ * - GET <base>/volume?from=&to=: liters between two epoch seconds, from the
+ *   pulse log page index (only with a ready PulseLog)
+ * - GET <base>/pulses?from=&to=&format=csv|ndjson: raw pulse timestamps
+ *   streamed from the pulse log by PulseLogExportWriter
+ */
+inline void registerWaterMeterRoutes(AsyncWebServer* server, WaterMeterComponent* waterMeter,
+                                     WaterMeterWebUIProvider* provider, const PulseLog* pulseLog = nullptr) {
+    if (!server || !waterMeter) return;
+    
+    String base = waterMeterApiBase(waterMeter);
+    if (provider) {
+        server->on((base + "/snapshot/dashboard").c_str(), HTTP_GET, [provider](AsyncWebServerRequest* request) {
+            sendWaterMeterSnapshot(request, provider, provider->getDashboardContextId().c_str());
+        });
+        server->on((base + "/snapshot/settings").c_str(), HTTP_GET, [provider](AsyncWebServerRequest* request) {
+            sendWaterMeterSnapshot(request, provider, provider->getSettingsContextId().c_str());
+        });
+    }
+    
+    server->on((base + "/history").c_str(), HTTP_GET, [waterMeter](AsyncWebServerRequest* request) {
+        uint16_t days = ConsumptionHistory::DAILY_DAYS;
+        if (request->hasParam("days")) {
+            long requested = request->getParam("days")->value().toInt();
+            if (requested > 0 && requested < days) days = (uint16_t)requested;
+        }
+        
+        auto writer = std::make_shared<HistoryJsonWriter>(waterMeter->getHistory(), days);
+        AsyncWebServerResponse* response = request->beginChunkedResponse("application/json",
+            [writer](uint8_t* buffer, size_t maxLen, size_t) -> size_t {
+                return writer->read(buffer, maxLen);
+            });
+        request->send(response);
+    });
+    
+    server->on((base + "/stats").c_str(), HTTP_GET, [waterMeter](AsyncWebServerRequest* request) {
+        request->send(200, "application/json", waterMeterIsrStatsJson(waterMeter));
+    });
+    
+#if WATER_METER_EDGE_STATS
+    server->on((base + "/edges").c_str(), HTTP_GET, [waterMeter](AsyncWebServerRequest* request) {
+        request->send(200, "application/json", waterMeterEdgeStatsJson(waterMeter));
+    });
+#endif
+    
+    if (!pulseLog || !pulseLog->isReady()) return;
+    
+    // ?from=&to= in epoch seconds (default: everything); liters from the page prefix sums, no scan
+    server->on((base + "/volume").c_str(), HTTP_GET, [waterMeter, pulseLog](AsyncWebServerRequest* request) {
+        uint64_t fromMs = waterMeterTimeParamMs(request, "from", 0);
+        uint64_t toMs = waterMeterTimeParamMs(request, "to", UINT64_MAX);
+        request->send(200, "application/json", waterMeterVolumeJson(*pulseLog, waterMeter, fromMs, toMs));
+    });
+    
+    // ?from=&to=&format=csv|ndjson: streamed page by page from flash
+    server->on((base + "/pulses").c_str(), HTTP_GET, [waterMeter, pulseLog](AsyncWebServerRequest* request) {
+        uint64_t fromMs = waterMeterTimeParamMs(request, "from", 0);
+        uint64_t toMs = waterMeterTimeParamMs(request, "to", UINT64_MAX);
+        bool ndjson = request->hasParam("format") && request->getParam("format")->value() == "ndjson";
+        auto writer = std::make_shared<PulseLogExportWriter>(*pulseLog, (int8_t)waterMeter->getChannel(), fromMs, toMs, ndjson);
+        AsyncWebServerResponse* response = request->beginChunkedResponse(ndjson ? "application/x-ndjson" : "text/csv",
+            [writer](uint8_t* buffer, size_t maxLen, size_t) -> size_t {
+                return writer->read(buffer, maxLen);
+            });
+        request->send(response);
+    });
+}
+
+/**
+ * @brief Board-wide /metrics content (meters + system), written into the page buffer
+ */
+typedef void (*WaterMeterMetricsRenderer)(MetricsWriter& writer);
+
+/**
+ * @brief Register GET /metrics (OpenMetrics text for Prometheus-compatible scrapers)
+ *
+ * The body is rendered into one static MetricsPage and sent from it as is
+ * (no String, no JsonDocument, no per-scrape buffer): scraping every few
+ * seconds leaves the heap as it was. The page stays busy until the client
+ * disconnects; a concurrent scrape gets 503 + Retry-After and comes back.
+ */
+inline void registerWaterMeterMetricsRoute(AsyncWebServer* server, WaterMeterMetricsRenderer render) {
+    static MetricsPage page;
+    if (!server || !render) return;
+    
+    server->on("/metrics", HTTP_GET, [render](AsyncWebServerRequest* request) {
+        if (page.busy) {
+            AsyncWebServerResponse* response = request->beginResponse(503);
+            response->addHeader("Retry-After", "1");
+            request->send(response);
+            return;
+        }
+        page.busy = true;
+        request->onDisconnect([]() { page.busy = false; });
+        
+        MetricsWriter writer(page.text, sizeof(page.text));
+        render(writer);
+        size_t len = writer.finish();
+        if (writer.dropped()) {
+            DLOG_W(LOG_WATER, "/metrics: %lu lines left out, raise WATER_METER_METRICS_BYTES (%u)",
+                   (unsigned long)writer.dropped(), (unsigned)WATER_METER_METRICS_BYTES);
+        }
+        // Sent straight from the static page (memcpy_P is memcpy on ESP32)
+        request->send(request->beginResponse_P(200, WATER_METER_METRICS_CONTENT_TYPE,
+                                               reinterpret_cast<const uint8_t*>(page.text), len));
+    });
+}
+
 #endif // WATER_METER_WEBUI_H
@@ -0,0 +1,988 @@
+/**
+ * @file main.cpp (native replay)
+ * @brief Host replay engine and benchmark for the WaterMeter pulse logic
+ *
+ * Feeds synthetic or recorded GPIO edge traces through the real
+ * waterMeterPulseISR() (via the attachInterrupt shim) and the real
+ * WaterMeterComponent::loop(), then reports:
+ * - counting accuracy against ground truth (missed / extra pulses)
+ * - rejected falling edges and edges dropped in the boot window
+ * - loop-side consistency (daily total vs credited pulse count, queue overflows)
+ * - storage writes actually performed vs save attempts
+ * - ISR cost in ns per edge (separate tight replay pass)
+ * - a "mock-source" row driving the component through MockPulseSource
+ *   (pulse source plumbing, untimed pulses, queue overflow) with event bus
+ *   subscribers: every pulse in exactly one "watermeter.pulses" batch,
+ *   "watermeter.data" at most once per publishIntervalMs; the batches also
+ *   feed a PulseLog whose range counts must match its CSV export
+ * - a "multi-channel" row: the bouncy trace on every channel at once
+ *   (WATER_METER_MAX_CHANNELS components, interleaved edges, ns/edge), then
+ *   /metrics for all of them: complete OpenMetrics text, per-meter pulse
+ *   counts, zero heap allocations while rendering (counting operator new)
+ * - an "auto-tune" row: the high-flow trace with autoTuneDebounce (values
+ *   picked from the ISR edge histograms after the first minute)
+ * - a "power-loss" row: reboots without shutdown() between full saves,
+ *   warm (RTC journal kept) and cold (RTC lost, flash journal only); then
+ *   the hour-of-week baseline: weeks of synthetic hours learned, flushed,
+ *   reloaded from the copied storage and scored (usual hours low, a burst
+ *   hour flagged)
+ * - a "pulse-task" row: the bouncy trace with config.pulseTask, the pulse
+ *   task on its own thread (std::thread shim) woken by every accepted edge
+ * - a "snapshot" row: reader threads hammer getData() while the main
+ *   thread injects pulses and runs loop(); every copy must be internally
+ *   consistent (count, totals, periods) and never go backwards
+ *
+ * Build & run:
+ *   pio run -e native && .pio/build/native/program [options]
+ *
+ * Options:
+ *   --scenario NAME    clean | bouncy | late-bounce | glitchy | stalled-loop | high-flow | mock-source |
+ *                      multi-channel | auto-tune | power-loss | pulse-task | snapshot | all (default)
+ *   --pulses N         Real pulses per synthetic scenario (default 250000)
+ *   --seed N           RNG seed (default 1)
+ *   --trace FILE       Replay recorded edges ("<t_us> <level>" per line, '#' comments,
+ *                      optional "# expected <n>" line for ground truth)
+ *   --debounce-ms N    Override pulseDebounceMs
+ *   --stable-ms N      Override pulseHighStableMs
+ *   --liters-per-pulse X  Meter resolution (default 1.0; sub-liter meters must stay exact)
+ *   --loop-ms N        Main loop period (default 5)
+ *   --stall-ms N       Simulated loop stall length (WiFi/MQTT), applied every --stall-every-ms
+ *   --stall-every-ms N Stall period (default 10000)
+ *   --auto-tune        Enable autoTuneDebounce in every scenario
+ *   --verbose          Component info logs
+ *
+ * Exit code is non-zero if a scenario that must count exactly does not,
+ * or if loop() totals (mL) disagree with the credited pulse count.
+ */
+
+#include <Arduino.h>
+#include <DomoticsCore/Core.h>
+#include <DomoticsCore/Storage.h>
+#include "WaterMeterComponent.h"
+#include "WaterMeterPulseLog.h"
+#include "WaterMeterMetrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// Heap allocation counter (every thread): /metrics rendering must not move it.
+// The replaced operators pair malloc/free themselves; GCC cannot see that.
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+static std::atomic<uint64_t> g_allocations{0};
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+struct Edge {
+    uint64_t tUs;
+    uint8_t level;
+};
+
+struct Trace {
+    String name;
+    std::vector<Edge> edges;
+    uint64_t expectedPulses = 0;
+    bool hasExpected = false;
+    bool mustBeExact = false;
+};
+
+/**
+ * @brief Synthetic reed-switch signal model (GPIO level, after the inverting buffer)
+ *
+ * Idle = LOW (no magnet). A real pulse is a HIGH dwell (magnet under sensor)
+ * ending with the counted FALLING edge. Bounces and glitches are short
+ * HIGH/LOW toggles that the ISR must reject.
+ */
+struct SignalModel {
+    const char* name;
+    uint32_t gapMinMs, gapMaxMs;         // Time between end of one pulse and start of next
+    uint32_t dwellMinMs, dwellMaxMs;     // HIGH duration of a real pulse
+    uint8_t entryBouncesMax;             // Toggles on magnet arrival
+    uint8_t exitBouncesMax;              // Toggles right after magnet leaves
+    float lateBounceProb;                // Bounce >500ms after exit (slow magnet)
+    float glitchProb;                    // Short HIGH spike during idle gap
+    bool mustBeExact;
+};
+
+// Exact scenarios keep fall-to-fall spacing (gap + dwell) above the default
+// 500 ms debounce; high-flow deliberately goes below it.
+const SignalModel MODELS[] = {
+    // name           gap ms       dwell ms    entry exit late  glitch exact
+    {"clean",         400, 4000,   200, 1500,  0,    0,   0.0f, 0.0f,  true},
+    {"bouncy",        400, 4000,   200, 1500,  6,    8,   0.0f, 0.0f,  true},
+    {"late-bounce",   900, 4000,   200, 1500,  2,    4,   0.5f, 0.0f,  true},
+    {"glitchy",       400, 4000,   200, 1500,  2,    2,   0.1f, 0.3f,  true},
+    {"stalled-loop",  400, 700,    200, 300,   2,    2,   0.0f, 0.0f,  true},
+    {"high-flow",     20,  400,    160, 300,   2,    2,   0.0f, 0.0f,  false},
+};
+
+Trace generateTrace(const SignalModel& m, uint32_t pulses, uint32_t seed, uint32_t bootDelayMs) {
+    Trace trace;
+    trace.name = m.name;
+    trace.mustBeExact = m.mustBeExact;
+    trace.hasExpected = true;
+    trace.edges.reserve((size_t)pulses * (2 + m.entryBouncesMax + m.exitBouncesMax + 2));
+
+    std::mt19937 rng(seed);
+    auto uniform = [&](uint32_t lo, uint32_t hi) {
+        return std::uniform_int_distribution<uint32_t>(lo, hi)(rng);
+    };
+    auto chance = [&](float p) {
+        return p > 0 && std::uniform_real_distribution<float>(0.0f, 1.0f)(rng) < p;
+    };
+    auto toggle = [&](uint64_t& t, uint8_t level, uint32_t minUs, uint32_t maxUs) {
+        t += uniform(minUs, maxUs);
+        trace.edges.push_back({t, level});
+    };
+
+    uint64_t t = (uint64_t)(bootDelayMs + 1000) * 1000;
+    for (uint32_t i = 0; i < pulses; i++) {
+        uint32_t gapUs = uniform(m.gapMinMs, m.gapMaxMs) * 1000;
+        uint64_t gapEnd = t + gapUs;
+
+        // Idle glitch in the middle of the gap (short HIGH spike)
+        if (chance(m.glitchProb) && gapUs > 120000) {
+            uint64_t g = t + gapUs / 2;
+            trace.edges.push_back({g, HIGH});
+            toggle(g, LOW, 1000, 50000);
+        }
+        t = gapEnd;
+
+        // Magnet arrives: entry bounces then settle HIGH
+        trace.edges.push_back({t, HIGH});
+        uint8_t entry = m.entryBouncesMax ? uniform(0, m.entryBouncesMax) : 0;
+        for (uint8_t b = 0; b < entry; b++) {
+            toggle(t, LOW, 200, 3000);
+            toggle(t, HIGH, 200, 3000);
+        }
+
+        // Magnet leaves: counted FALLING edge, then exit bounces
+        t += (uint64_t)uniform(m.dwellMinMs, m.dwellMaxMs) * 1000;
+        trace.edges.push_back({t, LOW});
+        uint8_t exits = m.exitBouncesMax ? uniform(0, m.exitBouncesMax) : 0;
+        for (uint8_t b = 0; b < exits; b++) {
+            toggle(t, HIGH, 200, 5000);
+            toggle(t, LOW, 200, 5000);
+        }
+
+        // Late exit bounce (the double-count failure mode of plain debounce)
+        if (chance(m.lateBounceProb)) {
+            toggle(t, HIGH, 550000, 850000);
+            toggle(t, LOW, 2000, 20000);
+        }
+    }
+
+    // Ground truth: the debounce window also rejects genuine pulses closer
+    // than pulseDebounceMs, so expected = all real pulses (accuracy is then
+    // the fraction actually counted).
+    trace.expectedPulses = pulses;
+    return trace;
+}
+
+bool loadTrace(const char* path, Trace& trace) {
+    std::ifstream in(path);
+    if (!in) return false;
+    trace.name = path;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty()) continue;
+        if (line[0] == '#') {
+            unsigned long long n;
+            if (sscanf(line.c_str(), "# expected %llu", &n) == 1) {
+                trace.expectedPulses = n;
+                trace.hasExpected = true;
+            }
+            continue;
+        }
+        for (char& c : line) {
+            if (c == ',' || c == ';' || c == '\t') c = ' ';
+        }
+        std::istringstream ss(line);
+        unsigned long long tUs;
+        int level;
+        if (ss >> tUs >> level) {
+            trace.edges.push_back({(uint64_t)tUs, (uint8_t)(level ? HIGH : LOW)});
+        }
+    }
+    trace.mustBeExact = trace.hasExpected;
+    return true;
+}
+
+struct ReplayOptions {
+    WaterMeterConfig config;
+    uint32_t loopPeriodUs = 5000;
+    uint32_t stallUs = 0;
+    uint32_t stallEveryUs = 10000000;
+};
+
+struct ReplayResult {
+    uint64_t edges = 0;
+    uint64_t fallingEdges = 0;
+    uint64_t counted = 0;
+    uint64_t rejectedFalling = 0;
+    uint64_t bootDropped = 0;
+    uint64_t loopCalls = 0;
+    uint64_t dailyMl = 0;
+    uint32_t queueOverflows = 0;
+    uint32_t saveWrites = 0;
+    uint32_t saveSkipped = 0;
+    uint32_t debounceMs = 0;     // Config at the end of the run (auto-tune)
+    uint32_t highStableMs = 0;
+    bool isrStatsOk = true;      // IsrStats counters agree with the harness' own tally
+    bool eventsOk = true;        // "watermeter.pulses" batches add up to the pulses credited
+    bool snapshotsOk = true;     // getData() on other threads never returned a torn/mixed state
+    bool metricsOk = true;       // /metrics text complete, per-meter counts right, no allocation
+    bool baselineOk = true;      // Hour-of-week baseline survives a reload and flags only the unusual hour
+    uint32_t taskRuns = 0;       // Pulse task (config.pulseTask): work calls and worst run time
+    uint32_t taskMaxRunUs = 0;
+    double nsPerEdge = 0;
+};
+
+/** @brief Power-on RAM state (warmReset keeps RTC slow memory) */
+void resetIsrState(bool warmReset = false) {
+    for (uint8_t ch = 0; ch < PulseChannelTable::SIZE; ch++) {
+        g_channels.lastPulseTime[ch] = 0;
+        g_channels.pulseIgnored[ch] = false;
+        g_channels.lastIgnoredTimeDiff[ch] = 0;
+        g_channels.lastRisingTime[ch] = 0;
+        g_channels.initJustCompleted[ch] = false;
+        g_channels.pulseTask[ch] = nullptr;
+    }
+    memset(&g_channels.isr, 0, sizeof(g_channels.isr));
+    if (!warmReset) {
+        memset(g_rtcJournal, 0, sizeof(g_rtcJournal));
+    }
+}
+
+/**
+ * @brief Fresh Core + Storage + WaterMeter at virtual time 0
+ */
+struct Harness {
+    Core core;
+    WaterMeterComponent* meter;
+
+    explicit Harness(const WaterMeterConfig& cfg, std::unique_ptr<PulseSource> source = nullptr) {
+        NativeArduino::reset();
+        resetIsrState();
+        core.addComponent(std::unique_ptr<Components::StorageComponent>(new Components::StorageComponent()));
+        meter = new WaterMeterComponent(cfg);
+        if (source) meter->setPulseSource(std::move(source));
+        core.addComponent(std::unique_ptr<WaterMeterComponent>(meter));
+        core.begin();
+    }
+
+    ~Harness() {
+        int lvl = NativeLog::level();
+        NativeLog::level() = NativeLog::Error;
+        core.shutdown();
+        NativeLog::level() = lvl;
+    }
+};
+
+/**
+ * @brief Pulse task: give its thread the real time a device would have between loop() calls
+ *
+ * Virtual time runs far ahead of the task thread; without this every loop
+ * period would overflow the ISR queue. Bounded: a stuck task still fails.
+ */
+void pacePulseTask(Harness& h) {
+    if (!h.meter->getPulseTaskStats()) return;
+    for (int i = 0; i < 20000 && g_channels.queue[0].size() > 0; i++) {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+/**
+ * @brief Pulse task: loop() until every accepted pulse has been handed over and credited
+ */
+void settlePulseTask(Harness& h) {
+    if (!h.meter->getPulseTaskStats()) return;
+    for (int i = 0; i < 2000 && h.meter->getData().pulseCount != g_channels.isr[0].accepted; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        h.core.loop();
+    }
+}
+
+uint64_t nextLoopTime(uint64_t tUs, const ReplayOptions& opt) {
+    uint64_t next = tUs + opt.loopPeriodUs;
+    if (opt.stallUs > 0) {
+        uint64_t windowStart = next - (next % opt.stallEveryUs);
+        if (next - windowStart < opt.stallUs) {
+            next = windowStart + opt.stallUs;
+        }
+    }
+    return next;
+}
+
+/**
+ * @brief Accuracy pass: edges interleaved with loop() at the configured cadence
+ */
+ReplayResult replayAccuracy(const Trace& trace, const ReplayOptions& opt) {
+    ReplayResult r;
+    Harness h(opt.config);
+    const uint8_t pin = opt.config.pulseInputPin;
+    uint64_t nextLoopUs = nextLoopTime(NativeArduino::nowMicros64(), opt);
+
+    for (const Edge& e : trace.edges) {
+        // loop() only runs when the main loop is due (idle gaps collapse to one call)
+        if (e.tUs >= nextLoopUs) {
+            NativeArduino::setMicros(nextLoopUs);
+            pacePulseTask(h);
+            h.core.loop();
+            r.loopCalls++;
+            nextLoopUs = nextLoopTime(e.tUs, opt);
+        }
+
+        NativeArduino::setMicros(e.tUs);
+        uint32_t before = g_channels.isr[0].accepted;
+        NativeArduino::setPinLevel(pin, e.level);
+        r.edges++;
+
+        if (!g_channels.initializationComplete[0]) {
+            r.bootDropped++;
+            continue;
+        }
+        if (e.level == LOW) {
+            r.fallingEdges++;
+            if (g_channels.isr[0].accepted == before) r.rejectedFalling++;
+        }
+    }
+
+    // Let the main loop catch up after the last edge
+    NativeArduino::advanceMicros(opt.stallUs + opt.loopPeriodUs);
+    pacePulseTask(h);
+    h.core.loop();
+    r.loopCalls++;
+    settlePulseTask(h);
+    if (const PulseTask::Stats* task = h.meter->getPulseTaskStats()) {
+        r.taskRuns = task->runs;
+        r.taskMaxRunUs = task->maxRunUs;
+    }
+
+    WaterMeterData data = h.meter->getData();
+    r.counted = data.pulseCount;
+    r.dailyMl = data.dailyMl;
+    r.queueOverflows = h.meter->getQueueOverflowCount();
+    r.saveWrites = h.meter->getPersistenceStats().writes;
+    r.saveSkipped = h.meter->getPersistenceStats().skipped;
+    r.debounceMs = h.meter->getConfig().pulseDebounceMs;
+    r.highStableMs = h.meter->getConfig().pulseHighStableMs;
+
+    IsrStats::Snapshot isr = h.meter->getIsrStats();
+    r.isrStatsOk = isr.edges == r.edges && isr.bootDropped == r.bootDropped &&
+                   isr.rejectedDebounce + isr.rejectedStable == r.rejectedFalling &&
+                   isr.accepted == r.fallingEdges - r.rejectedFalling &&
+                   (!WATER_METER_ISR_TIMING || isr.timedEdges == r.edges);
+    return r;
+}
+
+/**
+ * @brief Benchmark pass: back-to-back ISR invocations, loop() every BENCH_CHUNK edges
+ */
+double benchmarkIsr(const Trace& trace, const ReplayOptions& opt) {
+    static constexpr size_t BENCH_CHUNK = 64;  // Never more pulses than queue slots between drains
+    Harness h(opt.config);
+    const uint8_t pin = opt.config.pulseInputPin;
+    const size_t n = trace.edges.size();
+
+    std::chrono::nanoseconds isrTime(0);
+    for (size_t base = 0; base < n; base += BENCH_CHUNK) {
+        size_t end = base + BENCH_CHUNK < n ? base + BENCH_CHUNK : n;
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t i = base; i < end; i++) {
+            NativeArduino::setMicros(trace.edges[i].tUs);
+            NativeArduino::setPinLevel(pin, trace.edges[i].level);
+        }
+        isrTime += std::chrono::steady_clock::now() - t0;
+        h.core.loop();
+    }
+    return n ? (double)isrTime.count() / (double)n : 0.0;
+}
+
+/**
+ * @brief Pulse source pass: accepted pulses injected through MockPulseSource
+ *
+ * Every 500th pulse starts a burst larger than the queue (timestamps
+ * overflow) and every 1000th adds untimed pulses; loop() must still credit
+ * every single one.
+ */
+ReplayResult replayMockSource(Trace& trace, uint32_t pulses, const ReplayOptions& opt) {
+    ReplayResult r;
+    MockPulseSource* mock = new MockPulseSource();
+    Harness h(opt.config, std::unique_ptr<PulseSource>(mock));
+    uint64_t t = (uint64_t)(opt.config.bootInitDelayMs + 1000) * 1000;
+    uint64_t injected = 0;
+
+    // Subscribed before the first listener check (1 s), so no pulse predates them
+    uint64_t batchedPulses = 0;
+    uint32_t batches = 0;
+    uint32_t dataEvents = 0;
+    bool batchesOk = true;
+    h.core.on<WaterMeterPulseBatch>("watermeter.pulses", [&](const WaterMeterPulseBatch& b) {
+        batchesOk = batchesOk && b.sequence == ++batches && b.count <= WATER_METER_PULSE_BATCH_SIZE;
+        for (uint8_t i = 1; i < b.count; i++) {
+            batchesOk = batchesOk && (int32_t)(b.timestampsUs[i] - b.timestampsUs[i - 1]) > 0;
+        }
+        batchedPulses += b.count + b.untimed;
+    });
+    h.core.on<WaterMeterData>("watermeter.data", [&](const WaterMeterData&) { dataEvents++; });
+
+    // Pulse log on the emulated partition: timestamps unwrapped to 64 bit, fixed epoch origin
+    static constexpr uint64_t EPOCH0_MS = 1760000000000ULL;
+    PulseLogRegion().clear();
+    PulseLog log;
+    bool logOk = log.begin(60000);
+    uint64_t lastLoggedUs = 0;
+    h.core.on<WaterMeterPulseBatch>("watermeter.pulses", [&](const WaterMeterPulseBatch& b) {
+        for (uint8_t i = 0; i < b.count; i++) {
+            lastLoggedUs += (uint32_t)(b.timestampsUs[i] - (uint32_t)lastLoggedUs);
+            log.append(b.channel, EPOCH0_MS + lastLoggedUs / 1000, millis());
+        }
+        for (uint32_t i = 0; i < b.untimed; i++) {
+            log.append(b.channel, EPOCH0_MS + lastLoggedUs / 1000, millis());
+        }
+    });
+
+    for (uint32_t i = 0; i < pulses; i++) {
+        t += 2000000;
+        NativeArduino::setMicros(t);
+        uint32_t burst = (i % 500 == 499) ? WATER_METER_PULSE_QUEUE_SIZE + 8 : 1;
+        for (uint32_t b = 0; b < burst; b++) {
+            mock->inject((uint32_t)(t + b * 1000));
+        }
+        injected += burst;
+        if (i % 1000 == 999) {
+            mock->injectUntimed(3);
+            injected += 3;
+        }
+        h.core.loop();
+        r.loopCalls++;
+    }
+    NativeArduino::advanceMicros((uint64_t)(opt.config.pulseBatchMs + 1) * 1000);
+    h.core.loop();
+
+    trace.expectedPulses = injected;
+    uint32_t maxDataEvents = opt.config.publishIntervalMs
+        ? (uint32_t)(NativeArduino::nowMicros64() / 1000 / opt.config.publishIntervalMs) + 1 : UINT32_MAX;
+    r.eventsOk = batchesOk && batchedPulses == injected && dataEvents > 0 && dataEvents <= maxDataEvents;
+    printf("  events: %llu pulses in %lu batches, %lu data events  %s\n",
+           (unsigned long long)batchedPulses, (unsigned long)batches, (unsigned long)dataEvents,
+           r.eventsOk ? "ok" : "MISMATCH");
+
+    // Pulse log: prefix-sum range counts vs a streamed export of the same ranges
+    log.flush();
+    uint64_t endMs = EPOCH0_MS + lastLoggedUs / 1000 + 1;
+    logOk = logOk && log.pulsesBefore(0, endMs) == injected;
+    uint32_t ranges = 0;
+    for (uint64_t from = EPOCH0_MS; from < endMs && logOk; from += (endMs - EPOCH0_MS) / 7 + 1, ranges++) {
+        uint64_t to = from + (endMs - EPOCH0_MS) / 5;
+        PulseLogExportWriter writer(log, 0, from, to, false);
+        uint8_t chunk[256];
+        size_t n;
+        uint64_t lines = 0;
+        while ((n = writer.read(chunk, sizeof(chunk))) > 0) {
+            lines += std::count(chunk, chunk + n, (uint8_t)'\n');
+        }
+        logOk = lines - 1 == log.pulsesBefore(0, to) - log.pulsesBefore(0, from);  // Minus the CSV header
+    }
+    printf("  pulse log: %llu pulses, %lu/%lu pages, %lu records, %lu ranges  %s\n",
+           (unsigned long long)log.pulsesBefore(0, endMs), (unsigned long)log.pages(),
+           (unsigned long)log.capacityPages(), (unsigned long)log.getStats().records, (unsigned long)ranges,
+           logOk ? "ok" : "MISMATCH");
+    r.eventsOk = r.eventsOk && logOk;
+    WaterMeterData data = h.meter->getData();
+    r.counted = data.pulseCount;
+    r.dailyMl = data.dailyMl;
+    r.queueOverflows = h.meter->getQueueOverflowCount();
+    r.saveWrites = h.meter->getPersistenceStats().writes;
+    r.saveSkipped = h.meter->getPersistenceStats().skipped;
+    return r;
+}
+
+/**
+ * @brief All channels at once: one component per channel, edges interleaved
+ *
+ * Each channel gets the same trace shifted by a few ms so edges of different
+ * meters land between each other. Every channel must count exactly.
+ */
+ReplayResult replayMultiChannel(const Trace& base, Trace& out, const ReplayOptions& opt, bool& channelsOk) {
+    struct ChannelEdge {
+        uint64_t tUs;
+        uint8_t channel;
+        uint8_t level;
+    };
+    static constexpr uint8_t CHANNELS = PulseChannelTable::SIZE;
+    static constexpr uint8_t FIRST_PIN = 20;
+
+    ReplayResult r;
+    NativeArduino::reset();
+    resetIsrState();
+    Core core;
+    core.addComponent(std::unique_ptr<Components::StorageComponent>(new Components::StorageComponent()));
+    WaterMeterComponent* meters[CHANNELS];
+    for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+        WaterMeterConfig cfg = opt.config;
+        cfg.channel = ch;
+        cfg.pulseInputPin = FIRST_PIN + ch;
+        meters[ch] = new WaterMeterComponent(cfg);
+        core.addComponent(std::unique_ptr<WaterMeterComponent>(meters[ch]));
+    }
+    core.begin();
+
+    std::vector<ChannelEdge> edges;
+    edges.reserve(base.edges.size() * CHANNELS);
+    for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+        for (const Edge& e : base.edges) {
+            edges.push_back({e.tUs + (uint64_t)ch * 7300, ch, e.level});
+        }
+    }
+    std::stable_sort(edges.begin(), edges.end(),
+                     [](const ChannelEdge& a, const ChannelEdge& b) { return a.tUs < b.tUs; });
+
+    // Clock stopped around loop() so ns/edge compares with the single-channel benchmark
+    std::chrono::nanoseconds isrTime(0);
+    uint64_t nextLoopUs = nextLoopTime(NativeArduino::nowMicros64(), opt);
+    auto t0 = std::chrono::steady_clock::now();
+    for (const ChannelEdge& e : edges) {
+        if (e.tUs >= nextLoopUs) {
+            isrTime += std::chrono::steady_clock::now() - t0;
+            NativeArduino::setMicros(nextLoopUs);
+            core.loop();
+            r.loopCalls++;
+            nextLoopUs = nextLoopTime(e.tUs, opt);
+            t0 = std::chrono::steady_clock::now();
+        }
+        NativeArduino::setMicros(e.tUs);
+        NativeArduino::setPinLevel(FIRST_PIN + e.channel, e.level);
+        r.edges++;
+    }
+    isrTime += std::chrono::steady_clock::now() - t0;
+    NativeArduino::advanceMicros(opt.loopPeriodUs);
+    core.loop();
+
+    channelsOk = true;
+    out.expectedPulses = base.expectedPulses * CHANNELS;
+    for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+        WaterMeterData data = meters[ch]->getData();
+        r.counted += data.pulseCount;
+        r.dailyMl += data.dailyMl;
+        r.queueOverflows += meters[ch]->getQueueOverflowCount();
+        r.saveWrites += meters[ch]->getPersistenceStats().writes;
+        r.saveSkipped += meters[ch]->getPersistenceStats().skipped;
+        if (data.pulseCount != base.expectedPulses) {
+            printf("  channel %u counted %llu, expected %llu\n", (unsigned)ch,
+                   (unsigned long long)data.pulseCount, (unsigned long long)base.expectedPulses);
+            channelsOk = false;
+        }
+    }
+    r.nsPerEdge = r.edges ? (double)isrTime.count() / (double)r.edges : 0.0;
+
+    // /metrics for all channels into a static page, as the web route renders it
+    static MetricsPage page;
+    static const char* const NAMES[CHANNELS] = {"", "hot"};  // Rest unnamed: labelled by channel
+    uint64_t allocBefore = g_allocations.load();
+    MetricsWriter writer(page.text, sizeof(page.text));
+    waterMeterWriteMetrics(writer, meters, NAMES, CHANNELS);
+    size_t len = writer.finish();
+    uint64_t allocs = g_allocations.load() - allocBefore;
+    r.metricsOk = allocs == 0 && writer.dropped() == 0 && len >= 6 && strcmp(page.text + len - 6, "# EOF\n") == 0;
+    for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+        char expect[96];
+        snprintf(expect, sizeof(expect), "\nwatermeter_pulses_total{meter=\"%s\"} %llu\n",
+                 NAMES[ch] && NAMES[ch][0] ? NAMES[ch] : std::to_string(ch).c_str(),
+                 (unsigned long long)meters[ch]->getData().pulseCount);
+        if (!strstr(page.text, expect)) r.metricsOk = false;
+    }
+    printf("  metrics: %lu bytes, %lu lines, %lu dropped, %llu allocations  %s\n", (unsigned long)len,
+           (unsigned long)writer.samples(), (unsigned long)writer.dropped(), (unsigned long long)allocs,
+           r.metricsOk ? "ok" : "FAIL");
+
+    int lvl = NativeLog::level();
+    NativeLog::level() = NativeLog::Error;
+    core.shutdown();
+    NativeLog::level() = lvl;
+    return r;
+}
+
+/**
+ * @brief Power cuts between full saves: journaled pulses must survive
+ *
+ * Pulses go in through MockPulseSource, one every 2 s, plus a short burst
+ * right before each cut (not flushed to flash yet). Every CUT_EVERY pulses
+ * the board dies without shutdown(), alternating:
+ * - warm reset: RTC journal kept, cut right after loop()
+ * - cold power loss: RTC memory garbage, cut journalFlushMs after the burst
+ * The next boot continues on a copy of the storage; nothing may be lost.
+ */
+ReplayResult replayPowerLoss(Trace& trace, uint32_t pulses, const ReplayOptions& opt) {
+    static constexpr uint32_t CUT_EVERY = 997;
+    static constexpr uint32_t BURST = 3;
+
+    ReplayResult r;
+    NativeArduino::reset();
+    resetIsrState();
+    std::unique_ptr<Core> core;
+    Components::StorageComponent* flash = nullptr;
+    WaterMeterComponent* meter = nullptr;
+    MockPulseSource* mock = nullptr;
+
+    auto boot = [&]() {
+        if (meter) {
+            r.saveWrites += meter->getPersistenceStats().writes;
+            r.saveSkipped += meter->getPersistenceStats().skipped;
+        }
+        Components::StorageComponent* next = new Components::StorageComponent();
+        if (flash) next->copyFrom(*flash);
+        core.reset(new Core());  // Previous board is gone: no shutdown(), no final save
+        resetIsrState(true);
+        flash = next;
+        core->addComponent(std::unique_ptr<Components::StorageComponent>(next));
+        mock = new MockPulseSource();
+        meter = new WaterMeterComponent(opt.config);
+        meter->setPulseSource(std::unique_ptr<PulseSource>(mock));
+        core->addComponent(std::unique_ptr<WaterMeterComponent>(meter));
+        core->begin();
+    };
+
+    boot();
+    uint64_t t = NativeArduino::nowMicros64();
+    uint64_t injected = 0;
+    uint32_t cuts = 0;
+    for (uint32_t i = 0; i < pulses; i++) {
+        t += 2000000;
+        NativeArduino::setMicros(t);
+        mock->inject((uint32_t)t);
+        injected++;
+        core->loop();
+        r.loopCalls++;
+        if (i % CUT_EVERY != CUT_EVERY - 1) continue;
+
+        for (uint32_t b = 0; b < BURST; b++) {
+            t += 10000;
+            NativeArduino::setMicros(t);
+            mock->inject((uint32_t)t);
+            injected++;
+            core->loop();
+        }
+        bool cold = (cuts++ % 2) == 1;
+        if (cold) {
+            t += (uint64_t)opt.config.journalFlushMs * 1000;
+            NativeArduino::setMicros(t);
+            core->loop();
+            memset(g_rtcJournal, 0xA5, sizeof(g_rtcJournal));
+        }
+        boot();
+    }
+    NativeArduino::advanceMicros(opt.loopPeriodUs);
+    core->loop();
+
+    trace.expectedPulses = injected;
+    WaterMeterData data = meter->getData();
+    r.counted = data.pulseCount;
+    r.dailyMl = data.dailyMl;
+    r.saveWrites += meter->getPersistenceStats().writes;
+    r.saveSkipped += meter->getPersistenceStats().skipped;
+
+    // Hour-of-week baseline on the final board's storage: 6 weeks of a daily
+    // pattern with noise, flushed, reloaded on the next boot's copy, then scored
+    WeeklyBaseline learned;
+    learned.configure(8, 3, 5.0f, 4.0f);
+    learned.attach(flash, 1);
+    uint32_t rng = 12345;
+    uint32_t hoursFed = 0;
+    for (int32_t day = ConsumptionHistory::dayNumber(20260105); day < ConsumptionHistory::dayNumber(20260216); day++) {
+        uint32_t dayKey = ConsumptionHistory::dayKeyOf(day);
+        for (uint32_t hour = 0; hour < 24; hour++) {
+            rng = rng * 1103515245u + 12345u;
+            float usual = (hour == 7 || hour == 19) ? 60.0f : (hour >= 23 || hour < 6 ? 0.0f : 8.0f);
+            learned.closeHour(dayKey * 100 + hour, usual + (float)((rng >> 16) % 7));
+            hoursFed++;
+        }
+    }
+    uint8_t blobs = learned.flush();
+    Components::StorageComponent copy;
+    copy.copyFrom(*flash);
+    WeeklyBaseline reloaded;
+    reloaded.configure(8, 3, 5.0f, 4.0f);
+    reloaded.attach(&copy, 1);
+    reloaded.load();
+    bool sameSlots = true;
+    for (uint8_t slot = 0; slot < WeeklyBaseline::SLOTS; slot++) {
+        sameSlots = sameSlots && reloaded.samples(slot) == learned.samples(slot) &&
+                    reloaded.slotMean(slot) == learned.slotMean(slot) && reloaded.slotSigma(slot) == learned.slotSigma(slot);
+    }
+    float usualScore = reloaded.closeHour(2026021607, 63.0f);  // Monday 07h, shower time as always
+    bool usualFlagged = reloaded.isAnomaly();
+    float nightScore = reloaded.closeHour(2026021603, 180.0f);  // Monday 03h: 3 L/min for an hour
+    bool nightFlagged = reloaded.isAnomaly();
+    r.baselineOk = blobs == 7 && hoursFed == WeeklyBaseline::SLOTS * 6 && sameSlots &&
+                   WeeklyBaseline::slotOf(2026021607) == 7 && WeeklyBaseline::slotOf(2026022223) == WeeklyBaseline::SLOTS - 1 &&
+                   !usualFlagged && nightFlagged && reloaded.getStats().anomalies == 1;
+    printf("  baseline: %lu hours, %u blobs, reload %s, usual hour %.1f, night burst %.1f -> %s\n",
+           (unsigned long)hoursFed, (unsigned)blobs, sameSlots ? "identical" : "DIFFERS", usualScore, nightScore,
+           r.baselineOk ? "ok" : "FAIL");
+
+    int lvl = NativeLog::level();
+    NativeLog::level() = NativeLog::Error;
+    core->shutdown();
+    NativeLog::level() = lvl;
+    return r;
+}
+
+/**
+ * @brief Concurrency pass: getData() on reader threads while loop() credits pulses
+ *
+ * Pulses come in bursts so the snapshot changes every loop(). A fresh meter
+ * without NTP has no period rollover, so every consistent copy satisfies
+ * totalMl == pulseCount * mL/pulse == each period total.
+ */
+ReplayResult replaySnapshot(Trace& trace, uint32_t pulses, const ReplayOptions& opt) {
+    static constexpr uint32_t READERS = 3;
+    ReplayResult r;
+    MockPulseSource* mock = new MockPulseSource();
+    Harness h(opt.config, std::unique_ptr<PulseSource>(mock));
+    const uint32_t mlpp = h.meter->getMlPerPulse();
+
+    std::atomic<bool> done(false);
+    std::atomic<uint32_t> started(0);
+    std::atomic<uint64_t> reads(0);
+    std::atomic<uint64_t> bad(0);
+    std::vector<std::thread> readers;
+    for (uint32_t i = 0; i < READERS; i++) {
+        readers.emplace_back([&]() {
+            uint64_t lastCount = 0;
+            uint64_t n = 0;
+            uint64_t wrong = 0;
+            started++;
+            do {
+                WaterMeterData d = h.meter->getData();
+                bool ok = d.totalMl == d.pulseCount * mlpp && d.pulseCount >= lastCount;
+                for (uint8_t p = 0; p < WATER_PERIOD_COUNT; p++) {
+                    ok = ok && d.periodMl[p] == d.totalMl;
+                }
+                ok = ok && d.dailyMl == d.totalMl && d.yearlyMl == d.totalMl;
+                if (!ok) wrong++;
+                lastCount = d.pulseCount;
+                n++;
+            } while (!done.load(std::memory_order_relaxed));
+            reads += n;
+            bad += wrong;
+        });
+    }
+
+    while (started < READERS) {
+        std::this_thread::yield();
+    }
+
+    uint64_t t = NativeArduino::nowMicros64() + (uint64_t)opt.config.bootInitDelayMs * 1000;
+    uint64_t injected = 0;
+    for (uint32_t i = 0; i < pulses; i++) {
+        t += 20000;
+        NativeArduino::setMicros(t);
+        uint32_t burst = 1 + i % 7;
+        for (uint32_t b = 0; b < burst; b++) {
+            mock->inject((uint32_t)t);
+        }
+        injected += burst;
+        h.core.loop();
+        r.loopCalls++;
+    }
+    done = true;
+    for (std::thread& th : readers) th.join();
+
+    trace.expectedPulses = injected;
+    WaterMeterData data = h.meter->getData();
+    r.counted = data.pulseCount;
+    r.dailyMl = data.dailyMl;
+    r.saveWrites = h.meter->getPersistenceStats().writes;
+    r.saveSkipped = h.meter->getPersistenceStats().skipped;
+    r.snapshotsOk = bad == 0 && reads > 0;
+    printf("  snapshot: %llu reads on %lu threads during %llu loops, %llu inconsistent  %s\n",
+           (unsigned long long)reads.load(), (unsigned long)READERS, (unsigned long long)r.loopCalls,
+           (unsigned long long)bad.load(), r.snapshotsOk ? "ok" : "TORN");
+    return r;
+}
+
+bool report(const Trace& trace, const ReplayResult& r, uint32_t mlPerPulse) {
+    long long diff = (long long)r.counted - (long long)trace.expectedPulses;
+    double accuracy = trace.expectedPulses
+        ? 100.0 * (double)(r.counted < trace.expectedPulses ? r.counted : trace.expectedPulses) / (double)trace.expectedPulses
+        : 0.0;
+    bool loopConsistent = (r.dailyMl == r.counted * mlPerPulse);
+    bool exactOk = !trace.mustBeExact || diff == 0;
+    bool ok = exactOk && loopConsistent && r.isrStatsOk && r.eventsOk && r.snapshotsOk;
+
+    printf("%-14s edges=%-9llu expected=%-8llu counted=%-8llu %s=%-6lld acc=%7.3f%% "
+           "rejected=%-8llu boot=%-4llu overflow=%-4u loop=%s isr=%s saves=%u/%u  %6.1f ns/edge  %s\n",
+           trace.name.c_str(),
+           (unsigned long long)r.edges,
+           (unsigned long long)trace.expectedPulses,
+           (unsigned long long)r.counted,
+           diff > 0 ? "extra" : "missed",
+           diff > 0 ? diff : -diff,
+           trace.hasExpected ? accuracy : 0.0,
+           (unsigned long long)r.rejectedFalling,
+           (unsigned long long)r.bootDropped,
+           r.queueOverflows,
+           loopConsistent ? "ok" : "DRIFT",
+           r.isrStatsOk ? "ok" : "DIFF",
+           r.saveWrites, r.saveWrites + r.saveSkipped,
+           r.nsPerEdge,
+           ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    ReplayOptions opt;
+    String scenario = "all";
+    const char* tracePath = nullptr;
+    uint32_t pulses = 250000;
+    uint32_t seed = 1;
+
+    NativeLog::level() = NativeLog::Error;  // Per-edge "ignored" warnings would dominate the run
+    for (int i = 1; i < argc; i++) {
+        String arg = argv[i];
+        const char* val = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (arg == "--verbose") { NativeLog::level() = NativeLog::Info; continue; }
+        if (arg == "--auto-tune") { opt.config.autoTuneDebounce = true; continue; }
+        if (!val) { fprintf(stderr, "Missing value for %s\n", argv[i]); return 2; }
+        i++;
+        if (arg == "--scenario") scenario = val;
+        else if (arg == "--trace") tracePath = val;
+        else if (arg == "--pulses") pulses = strtoul(val, nullptr, 10);
+        else if (arg == "--seed") seed = strtoul(val, nullptr, 10);
+        else if (arg == "--debounce-ms") opt.config.pulseDebounceMs = strtoul(val, nullptr, 10);
+        else if (arg == "--stable-ms") opt.config.pulseHighStableMs = strtoul(val, nullptr, 10);
+        else if (arg == "--liters-per-pulse") opt.config.litersPerPulse = strtof(val, nullptr);
+        else if (arg == "--loop-ms") opt.loopPeriodUs = strtoul(val, nullptr, 10) * 1000;
+        else if (arg == "--stall-ms") opt.stallUs = strtoul(val, nullptr, 10) * 1000;
+        else if (arg == "--stall-every-ms") opt.stallEveryUs = strtoul(val, nullptr, 10) * 1000;
+        else { fprintf(stderr, "Unknown option %s\n", argv[i - 1]); return 2; }
+    }
+    if (opt.stallEveryUs == 0 || opt.stallUs >= opt.stallEveryUs) {
+        fprintf(stderr, "--stall-ms must be shorter than --stall-every-ms\n");
+        return 2;
+    }
+
+    opt.config.enableLed = false;
+    PulseVolume volume;
+    volume.configure(opt.config.litersPerPulse);
+    const uint32_t mlpp = volume.mlPerPulse();
+    printf("WaterMeter replay: debounce=%lums stable=%lums volume=%lumL/pulse loop=%lums stall=%lums/%lums queue=%u\n",
+           (unsigned long)opt.config.pulseDebounceMs, (unsigned long)opt.config.pulseHighStableMs, (unsigned long)mlpp,
+           (unsigned long)(opt.loopPeriodUs / 1000), (unsigned long)(opt.stallUs / 1000),
+           (unsigned long)(opt.stallEveryUs / 1000), (unsigned)WATER_METER_PULSE_QUEUE_SIZE);
+
+    std::vector<Trace> traces;
+    if (tracePath) {
+        Trace t;
+        if (!loadTrace(tracePath, t)) {
+            fprintf(stderr, "Cannot read trace %s\n", tracePath);
+            return 2;
+        }
+        traces.push_back(std::move(t));
+    } else {
+        for (const SignalModel& m : MODELS) {
+            if (scenario == "all" || scenario == m.name) {
+                traces.push_back(generateTrace(m, pulses, seed, opt.config.bootInitDelayMs));
+            }
+        }
+        if (traces.empty() && scenario != "mock-source" && scenario != "multi-channel" &&
+            scenario != "auto-tune" && scenario != "power-loss" && scenario != "snapshot" &&
+            scenario != "pulse-task") {
+            fprintf(stderr, "Unknown scenario %s\n", scenario.c_str());
+            return 2;
+        }
+    }
+
+    bool ok = true;
+    for (const Trace& trace : traces) {
+        ReplayOptions runOpt = opt;
+        // stalled-loop: WiFi/MQTT style stalls unless the user chose their own
+        if (trace.name == "stalled-loop" && runOpt.stallUs == 0) {
+            runOpt.stallUs = 3000000;
+        }
+        ReplayResult r = replayAccuracy(trace, runOpt);
+        r.nsPerEdge = benchmarkIsr(trace, runOpt);
+        ok = report(trace, r, mlpp) && ok;
+    }
+    if (!tracePath && (scenario == "all" || scenario == "mock-source")) {
+        Trace mockTrace;
+        mockTrace.name = "mock-source";
+        mockTrace.hasExpected = true;
+        mockTrace.mustBeExact = true;
+        ReplayResult r = replayMockSource(mockTrace, pulses < 20000 ? pulses : 20000, opt);
+        ok = report(mockTrace, r, mlpp) && ok;
+    }
+    if (!tracePath && (scenario == "all" || scenario == "multi-channel")) {
+        Trace base = generateTrace(MODELS[1], pulses < 50000 ? pulses : 50000, seed, opt.config.bootInitDelayMs);
+        Trace multiTrace;
+        multiTrace.name = "multi-channel";
+        multiTrace.hasExpected = true;
+        multiTrace.mustBeExact = true;
+        bool channelsOk = false;
+        ReplayResult r = replayMultiChannel(base, multiTrace, opt, channelsOk);
+        ok = report(multiTrace, r, mlpp) && channelsOk && r.metricsOk && ok;
+    }
+    if (!tracePath && (scenario == "all" || scenario == "auto-tune")) {
+        Trace tuneTrace = generateTrace(MODELS[5], pulses, seed, opt.config.bootInitDelayMs);
+        tuneTrace.name = "auto-tune";
+        ReplayOptions tuneOpt = opt;
+        tuneOpt.config.autoTuneDebounce = true;
+        ReplayResult r = replayAccuracy(tuneTrace, tuneOpt);
+        ok = report(tuneTrace, r, mlpp) && ok;
+        printf("  tuned: debounce %lu -> %lu ms, high stable %lu -> %lu ms\n",
+               (unsigned long)opt.config.pulseDebounceMs, (unsigned long)r.debounceMs,
+               (unsigned long)opt.config.pulseHighStableMs, (unsigned long)r.highStableMs);
+    }
+    if (!tracePath && (scenario == "all" || scenario == "power-loss")) {
+        Trace lossTrace;
+        lossTrace.name = "power-loss";
+        lossTrace.hasExpected = true;
+        lossTrace.mustBeExact = true;
+        ReplayResult r = replayPowerLoss(lossTrace, pulses < 20000 ? pulses : 20000, opt);
+        ok = report(lossTrace, r, mlpp) && r.baselineOk && ok;
+    }
+    if (!tracePath && (scenario == "all" || scenario == "pulse-task")) {
+        // Bouncy trace with pulses drained by the pulse task thread, woken per accepted edge
+        Trace taskTrace = generateTrace(MODELS[1], pulses, seed, opt.config.bootInitDelayMs);
+        taskTrace.name = "pulse-task";
+        ReplayOptions taskOpt = opt;
+        taskOpt.config.pulseTask = true;
+        ReplayResult r = replayAccuracy(taskTrace, taskOpt);
+        ok = report(taskTrace, r, mlpp) && r.taskRuns > 0 && ok;
+        printf("  pulse task: %lu runs, max run %lu us\n", (unsigned long)r.taskRuns, (unsigned long)r.taskMaxRunUs);
+    }
+    if (!tracePath && (scenario == "all" || scenario == "snapshot")) {
+        Trace snapTrace;
+        snapTrace.name = "snapshot";
+        snapTrace.hasExpected = true;
+        snapTrace.mustBeExact = true;
+        ReplayResult r = replaySnapshot(snapTrace, pulses < 200000 ? pulses : 200000, opt);
+        ok = report(snapTrace, r, mlpp) && ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+/**
+ * @file Arduino.h (native shim)
+ * @brief Minimal Arduino API for host builds of the WaterMeter pulse logic
+ *
+ * Time is virtual: millis()/micros() return the clock set by the replay
+ * harness (NativeArduino::setMicros/advanceMicros), so ISR and loop() code
+ * see exactly the timeline being replayed. GPIO levels are simulated and
+ * NativeArduino::setPinLevel() invokes the attached interrupt handler like
+ * the ESP32 GPIO matrix would (RISING/FALLING/CHANGE).
+ *
+ * The clock is atomic so a pulse task thread (WaterMeterPulseTask.h) can
+ * read it while the harness thread advances it.
+ *
+ * Only what WaterMeter headers use is provided - this is not an emulator.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <atomic>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define IRAM_ATTR
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+namespace NativeArduino {
+
+static constexpr int MAX_PINS = 40;
+
+struct State {
+    uint8_t level[MAX_PINS] = {};
+    void (*isr[MAX_PINS])() = {};
+    void (*isrArg[MAX_PINS])(void*) = {};
+    void* isrArgValue[MAX_PINS] = {};
+    int isrMode[MAX_PINS] = {};
+};
+
+inline State& state() {
+    static State s;
+    return s;
+}
+
+inline std::atomic<uint64_t>& clock() {
+    static std::atomic<uint64_t> nowUs{0};
+    return nowUs;
+}
+
+inline void setMicros(uint64_t us) { clock().store(us); }
+inline void advanceMicros(uint64_t us) { clock().fetch_add(us); }
+inline uint64_t nowMicros64() { return clock().load(); }
+
+/**
+ * @brief Drive a simulated input pin, firing its interrupt on a matching edge
+ */
+inline void setPinLevel(uint8_t pin, int level) {
+    State& s = state();
+    if (pin >= MAX_PINS) return;
+    uint8_t prev = s.level[pin];
+    s.level[pin] = level ? HIGH : LOW;
+    if (prev == s.level[pin] || (!s.isr[pin] && !s.isrArg[pin])) return;
+    int mode = s.isrMode[pin];
+    bool rising = (s.level[pin] == HIGH);
+    if (mode == CHANGE || (mode == RISING && rising) || (mode == FALLING && !rising)) {
+        if (s.isrArg[pin]) {
+            s.isrArg[pin](s.isrArgValue[pin]);
+        } else {
+            s.isr[pin]();
+        }
+    }
+}
+
+inline void reset() {
+    state() = State();
+    clock().store(0);
+}
+
+} // namespace NativeArduino
+
+// 32-bit wrap like the ESP32 (unsigned long is 32-bit there)
+inline unsigned long millis() { return (uint32_t)(NativeArduino::nowMicros64() / 1000); }
+inline unsigned long micros() { return (uint32_t)NativeArduino::nowMicros64(); }
+inline void delay(unsigned long ms) { NativeArduino::advanceMicros((uint64_t)ms * 1000); }
+inline void delayMicroseconds(unsigned int us) { NativeArduino::advanceMicros(us); }
+inline void yield() {}
+
+/**
+ * @brief ESP object subset: cycle counter for ISR timing
+ *
+ * Real elapsed time, not the virtual replay clock: the TSC on x86 (cheap
+ * enough to leave the ns/edge benchmark meaningful, only relative values
+ * mean anything), steady_clock scaled to a 240 MHz core elsewhere.
+ */
+class EspClass {
+public:
+    uint32_t getCycleCount() {
+#if defined(__x86_64__) || defined(__i386__)
+        return (uint32_t)__rdtsc();
+#else
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        return (uint32_t)((uint64_t)ns * 240 / 1000);
+#endif
+    }
+};
+static EspClass ESP __attribute__((unused));
+inline uint32_t getCpuFrequencyMhz() { return 240; }
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t pin) {
+    return pin < NativeArduino::MAX_PINS ? NativeArduino::state().level[pin] : LOW;
+}
+inline void digitalWrite(uint8_t pin, uint8_t val) {
+    if (pin < NativeArduino::MAX_PINS) NativeArduino::state().level[pin] = val ? HIGH : LOW;
+}
+inline int digitalPinToInterrupt(uint8_t pin) { return pin; }
+inline void attachInterrupt(int pin, void (*fn)(), int mode) {
+    if (pin < 0 || pin >= NativeArduino::MAX_PINS) return;
+    NativeArduino::state().isr[pin] = fn;
+    NativeArduino::state().isrArg[pin] = nullptr;
+    NativeArduino::state().isrMode[pin] = mode;
+}
+inline void attachInterruptArg(uint8_t pin, void (*fn)(void*), void* arg, int mode) {
+    if (pin >= NativeArduino::MAX_PINS) return;
+    NativeArduino::state().isr[pin] = nullptr;
+    NativeArduino::state().isrArg[pin] = fn;
+    NativeArduino::state().isrArgValue[pin] = arg;
+    NativeArduino::state().isrMode[pin] = mode;
+}
+inline void detachInterrupt(int pin) {
+    if (pin < 0 || pin >= NativeArduino::MAX_PINS) return;
+    NativeArduino::state().isr[pin] = nullptr;
+    NativeArduino::state().isrArg[pin] = nullptr;
+}
+
+/**
+ * @brief Arduino String subset backed by std::string
+ */
+class String {
+public:
+    String() {}
+    String(const char* s) : str(s ? s : "") {}
+    String(const std::string& s) : str(s) {}
+    String(char c) : str(1, c) {}
+    String(int v) : str(std::to_string(v)) {}
+    String(unsigned int v) : str(std::to_string(v)) {}
+    String(long v) : str(std::to_string(v)) {}
+    String(unsigned long v) : str(std::to_string(v)) {}
+    String(long long v) : str(std::to_string(v)) {}
+    String(unsigned long long v) : str(std::to_string(v)) {}
+    String(double v, unsigned int decimals = 2) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*f", (int)decimals, v);
+        str = buf;
+    }
+
+    const char* c_str() const { return str.c_str(); }
+    unsigned int length() const { return (unsigned int)str.length(); }
+    bool isEmpty() const { return str.empty(); }
+    void reserve(unsigned int n) { str.reserve(n); }
+    long toInt() const { return strtol(str.c_str(), nullptr, 10); }
+    float toFloat() const { return strtof(str.c_str(), nullptr); }
+    bool startsWith(const String& p) const { return str.compare(0, p.str.size(), p.str) == 0; }
+    int indexOf(char c, unsigned int from = 0) const {
+        size_t i = str.find(c, from);
+        return i == std::string::npos ? -1 : (int)i;
+    }
+    int indexOf(const String& s, unsigned int from = 0) const {
+        size_t i = str.find(s.str, from);
+        return i == std::string::npos ? -1 : (int)i;
+    }
+    String substring(unsigned int from) const { return from < str.size() ? String(str.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from >= str.size() || to <= from) return String();
+        return String(str.substr(from, to - from));
+    }
+    void trim() {
+        size_t b = str.find_first_not_of(" \t\r\n");
+        size_t e = str.find_last_not_of(" \t\r\n");
+        str = (b == std::string::npos) ? std::string() : str.substr(b, e - b + 1);
+    }
+    char operator[](unsigned int i) const { return i < str.size() ? str[i] : 0; }
+
+    String& operator+=(const String& o) { str += o.str; return *this; }
+    String& operator+=(const char* o) { str += (o ? o : ""); return *this; }
+    String& operator+=(char c) { str += c; return *this; }
+    bool operator==(const String& o) const { return str == o.str; }
+    bool operator==(const char* o) const { return str == (o ? o : ""); }
+    bool operator!=(const String& o) const { return str != o.str; }
+    bool operator!=(const char* o) const { return !(*this == o); }
+    bool operator<(const String& o) const { return str < o.str; }
+
+    friend String operator+(String a, const String& b) { a += b; return a; }
+    friend String operator+(String a, const char* b) { a += b; return a; }
+    friend String operator+(const char* a, const String& b) { String r(a); r += b; return r; }
+
+private:
+    std::string str;
+};
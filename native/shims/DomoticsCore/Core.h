@@ -0,0 +1,8 @@
+#pragma once
+
+/**
+ * @file Core.h (native shim)
+ * @brief Core is defined together with IComponent in the native shims
+ */
+
+#include "IComponent.h"
@@ -0,0 +1,161 @@
+#pragma once
+
+/**
+ * @file IComponent.h (native shim)
+ * @brief IComponent, Core and EventBus subset used by WaterMeter
+ *
+ * Same call surface as DomoticsCore (getCore()->getComponent<T>("Name"),
+ * emit(topic, data, sticky), Core::on<T>(topic, handler)), implemented
+ * synchronously and single-threaded for host builds.
+ */
+
+#include <Arduino.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace DomoticsCore {
+
+enum class ComponentStatus {
+    Success,
+    InvalidConfig,
+    HardwareError,
+    DependencyError,
+    TimeoutError,
+    MemoryError
+};
+
+struct Dependency {
+    String name;
+    bool required;
+};
+
+struct ComponentMetadata {
+    String name;
+    String version;
+    String author;
+    String description;
+};
+
+/**
+ * @brief Synchronous topic → handler dispatch
+ */
+class EventBus {
+public:
+    template <typename T>
+    void subscribe(const String& topic, std::function<void(const T&)> handler) {
+        subscribers[topic].push_back([handler](const void* payload) {
+            handler(*static_cast<const T*>(payload));
+        });
+    }
+
+    template <typename T>
+    void publish(const String& topic, const T& payload, bool /*sticky*/ = false) {
+        auto it = subscribers.find(topic);
+        if (it == subscribers.end()) return;
+        for (auto& handler : it->second) {
+            handler(&payload);
+        }
+    }
+
+    bool hasSubscribers(const String& topic) const {
+        auto it = subscribers.find(topic);
+        return it != subscribers.end() && !it->second.empty();
+    }
+
+private:
+    std::map<String, std::vector<std::function<void(const void*)>>> subscribers;
+};
+
+class Core;
+
+class IComponent {
+public:
+    ComponentMetadata metadata;
+
+    virtual ~IComponent() {}
+    virtual ComponentStatus begin() = 0;
+    virtual void loop() = 0;
+    virtual ComponentStatus shutdown() = 0;
+    virtual std::vector<Dependency> getDependencies() const { return {}; }
+
+    bool isActive() const { return active; }
+    void setActive(bool a) { active = a; }
+
+    Core* getCore() const { return core; }
+    void setCore(Core* c) { core = c; }
+
+    template <typename T>
+    void emit(const String& topic, const T& payload, bool sticky = false);
+
+private:
+    bool active = false;
+    Core* core = nullptr;
+};
+
+class Core {
+public:
+    void addComponent(std::unique_ptr<IComponent> component) {
+        component->setCore(this);
+        components.push_back(std::move(component));
+    }
+
+    IComponent* getComponent(const String& name) {
+        for (auto& c : components) {
+            if (c->metadata.name == name) return c.get();
+        }
+        return nullptr;
+    }
+
+    template <typename T>
+    T* getComponent(const String& name) {
+        return static_cast<T*>(getComponent(name));
+    }
+
+    bool begin() {
+        for (auto& c : components) {
+            if (c->begin() != ComponentStatus::Success) return false;
+        }
+        return true;
+    }
+
+    void loop() {
+        for (auto& c : components) {
+            if (c->isActive()) c->loop();
+        }
+    }
+
+    void shutdown() {
+        for (auto it = components.rbegin(); it != components.rend(); ++it) {
+            (*it)->shutdown();
+        }
+    }
+
+    template <typename T>
+    void on(const String& topic, std::function<void(const T&)> handler) {
+        eventBus.subscribe<T>(topic, handler);
+    }
+
+    template <typename T>
+    void emit(const String& topic, const T& payload, bool sticky = false) {
+        eventBus.publish<T>(topic, payload, sticky);
+    }
+
+    EventBus& getEventBus() { return eventBus; }
+
+private:
+    std::vector<std::unique_ptr<IComponent>> components;
+    EventBus eventBus;
+};
+
+template <typename T>
+void IComponent::emit(const String& topic, const T& payload, bool sticky) {
+    if (core) core->emit<T>(topic, payload, sticky);
+}
+
+namespace Components {
+using DomoticsCore::IComponent;
+} // namespace Components
+
+} // namespace DomoticsCore
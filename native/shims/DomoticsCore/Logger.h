@@ -0,0 +1,31 @@
+#pragma once
+
+/**
+ * @file Logger.h (native shim)
+ * @brief DLOG_* macros printing to stderr, filtered by NativeLog::level()
+ *
+ * Default level is warnings only so replaying millions of edges is not
+ * dominated by per-pulse info logs.
+ */
+
+#include <stdio.h>
+
+namespace NativeLog {
+enum Level { None = 0, Error = 1, Warning = 2, Info = 3, Debug = 4 };
+inline int& level() {
+    static int lvl = Warning;
+    return lvl;
+}
+} // namespace NativeLog
+
+#define DLOG_AT(lvl, tag, fmt, ...)                                          \
+    do {                                                                     \
+        if (NativeLog::level() >= (lvl)) {                                   \
+            fprintf(stderr, "[%s] " fmt "\n", tag, ##__VA_ARGS__);           \
+        }                                                                    \
+    } while (0)
+
+#define DLOG_E(tag, fmt, ...) DLOG_AT(NativeLog::Error, tag, fmt, ##__VA_ARGS__)
+#define DLOG_W(tag, fmt, ...) DLOG_AT(NativeLog::Warning, tag, fmt, ##__VA_ARGS__)
+#define DLOG_I(tag, fmt, ...) DLOG_AT(NativeLog::Info, tag, fmt, ##__VA_ARGS__)
+#define DLOG_D(tag, fmt, ...) DLOG_AT(NativeLog::Debug, tag, fmt, ##__VA_ARGS__)
@@ -0,0 +1,92 @@
+#pragma once
+
+/**
+ * @file Storage.h (native shim)
+ * @brief In-memory key/value StorageComponent with write accounting
+ *
+ * Mirrors the NVS-backed DomoticsCore Storage API used by WaterMeter.
+ * getWriteCount()/getBytesWritten() let host runs measure flash traffic.
+ */
+
+#include "IComponent.h"
+#include <string.h>
+
+namespace DomoticsCore {
+namespace Components {
+
+class StorageComponent : public IComponent {
+public:
+    StorageComponent() {
+        metadata.name = "Storage";
+        metadata.version = "native";
+    }
+
+    ComponentStatus begin() override {
+        setActive(true);
+        return ComponentStatus::Success;
+    }
+    void loop() override {}
+    ComponentStatus shutdown() override { return ComponentStatus::Success; }
+
+    bool putULong64(const String& key, uint64_t value) { return putRaw(key, &value, sizeof(value)); }
+    uint64_t getULong64(const String& key, uint64_t def = 0) const { return getRaw(key, def); }
+    bool putULong(const String& key, uint32_t value) { return putRaw(key, &value, sizeof(value)); }
+    uint32_t getULong(const String& key, uint32_t def = 0) const { return getRaw(key, def); }
+    bool putUInt(const String& key, uint32_t value) { return putRaw(key, &value, sizeof(value)); }
+    uint32_t getUInt(const String& key, uint32_t def = 0) const { return getRaw(key, def); }
+    bool putInt(const String& key, int32_t value) { return putRaw(key, &value, sizeof(value)); }
+    int32_t getInt(const String& key, int32_t def = 0) const { return getRaw(key, def); }
+    bool putFloat(const String& key, float value) { return putRaw(key, &value, sizeof(value)); }
+    float getFloat(const String& key, float def = 0) const { return getRaw(key, def); }
+    bool putBool(const String& key, bool value) { return putRaw(key, &value, sizeof(value)); }
+    bool getBool(const String& key, bool def = false) const { return getRaw(key, def); }
+
+    bool putBlob(const String& key, const uint8_t* data, size_t len) { return putRaw(key, data, len); }
+
+    /** @return Bytes copied (0 if key missing or buffer too small) */
+    size_t getBlob(const String& key, uint8_t* out, size_t maxLen) const {
+        auto it = values.find(key);
+        if (it == values.end() || it->second.size() > maxLen) return 0;
+        memcpy(out, it->second.data(), it->second.size());
+        return it->second.size();
+    }
+
+    size_t getBlobSize(const String& key) const {
+        auto it = values.find(key);
+        return it == values.end() ? 0 : it->second.size();
+    }
+
+    bool hasKey(const String& key) const { return values.count(key) > 0; }
+    bool remove(const String& key) { return values.erase(key) > 0; }
+
+    /** @brief Take over another instance's contents (flash surviving a simulated reboot) */
+    void copyFrom(const StorageComponent& other) { values = other.values; }
+
+    uint32_t getWriteCount() const { return writes; }
+    uint64_t getBytesWritten() const { return bytesWritten; }
+
+private:
+    bool putRaw(const String& key, const void* data, size_t len) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        values[key].assign(p, p + len);
+        writes++;
+        bytesWritten += len;
+        return true;
+    }
+
+    template <typename T>
+    T getRaw(const String& key, T def) const {
+        auto it = values.find(key);
+        if (it == values.end() || it->second.size() != sizeof(T)) return def;
+        T v;
+        memcpy(&v, it->second.data(), sizeof(T));
+        return v;
+    }
+
+    std::map<String, std::vector<uint8_t>> values;
+    uint32_t writes = 0;
+    uint64_t bytesWritten = 0;
+};
+
+} // namespace Components
+} // namespace DomoticsCore
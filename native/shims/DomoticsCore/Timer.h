@@ -0,0 +1,37 @@
+#pragma once
+
+/**
+ * @file Timer.h (native shim)
+ * @brief Utils::NonBlockingDelay on the virtual millis() clock
+ */
+
+#include <Arduino.h>
+
+namespace DomoticsCore {
+namespace Utils {
+
+class NonBlockingDelay {
+public:
+    explicit NonBlockingDelay(unsigned long intervalMs = 0)
+        : interval(intervalMs), last(millis()) {}
+
+    bool isReady() {
+        unsigned long now = millis();
+        if ((uint32_t)(now - last) >= interval) {
+            last = now;
+            return true;
+        }
+        return false;
+    }
+
+    void reset() { last = millis(); }
+    void setInterval(unsigned long intervalMs) { interval = intervalMs; }
+    unsigned long getInterval() const { return interval; }
+
+private:
+    unsigned long interval;
+    unsigned long last;
+};
+
+} // namespace Utils
+} // namespace DomoticsCore
@@ -17,7 +17,7 @@
  * - Improved discovery timing (works after WebUI config)
  * - Core::on<>() and Core::emit() helpers
  * 
- * Hardware: ESP32 with magnetic pulse sensor on GPIO34
+ * Hardware: ESP32 with magnetic pulse sensor on GPIO34 (more meters: see METERS)
  */
 
 #include <Arduino.h>
@@ -28,23 +28,761 @@
 #include <DomoticsCore/MQTT.h>
 #include <DomoticsCore/HomeAssistant.h>
 #include <DomoticsCore/Timer.h>
+#include <sys/time.h>
+#include <AsyncTCP.h>
+#include <mutex>
 #include "WaterMeterComponent.h"
 #include "WaterMeterWebUI.h"
+#include "WaterMeterPublishPolicy.h"
+#include "WaterMeterWatch.h"
+#include "WaterMeterBacklog.h"
+#include "WaterMeterMetrics.h"
 
 using namespace DomoticsCore;
 using namespace DomoticsCore::Components;
 
 #define LOG_APP "APP"
+#define LOG_WATCH "WATCH"
+
+// `water watch` lines go to one TCP session on this port (telnet <ip> 2323), nowhere else
+#define WATCH_PORT 2323
+
+// Meters on this board: one WaterMeterComponent per channel (max WATER_METER_MAX_CHANNELS).
+// A single unnamed meter keeps the historical entity ids, contexts and routes.
+// Example site: {34, "cold"}, {35, "hot"}, {36, "irrigation"}
+struct MeterSetup {
+    uint8_t pin;
+    const char* name;
+};
+static const MeterSetup METERS[] = {
+    {34, ""},
+};
+static constexpr uint8_t METER_COUNT = sizeof(METERS) / sizeof(METERS[0]);
+static_assert(METER_COUNT <= WATER_METER_MAX_CHANNELS, "More meters than WATER_METER_MAX_CHANNELS");
 
 // Global instances
 System* domotics = nullptr;
-WaterMeterComponent* waterMeter = nullptr;
+WaterMeterComponent* meters[METER_COUNT] = {};
 HomeAssistant::HomeAssistantComponent* haPtr = nullptr;
 MQTTComponent* mqttPtr = nullptr;
 
 // State tracking for HA
 bool initialStatePublished = false;
 
+// Change-driven HA publishing: one policy (shared rate limit), handles per meter.
+// Every sensor is one key of a single JSON state document on <node>/state, sent
+// whole when any value is due; discovery configs pick their key with value_template.
+PublishPolicy haPolicy;
+struct HaSensorInfo {
+    String name;
+    const char* unit;
+    const char* deviceClass;
+    const char* icon;
+    const char* stateClass;
+    int8_t decimals;  // JSON number format, -1 = binary sensor (true/false)
+};
+HaSensorInfo haInfo[WATER_METER_PUBLISH_MAX_SENSORS];  // Indexed by policy handle
+float haValues[WATER_METER_PUBLISH_MAX_SENSORS];       // Latest values, indexed by policy handle
+String haNodeId;      // HA component's node id: device identifier, discovery node id, unique_id prefix
+String haDeviceName;
+String haStateTopic;  // "<node>/state"
+String haAvailabilityTopic;  // HA component's LWT topic ("online"/"offline"), shared with its buttons
+String haDiscoveryPrefix;
+bool haDiscoveryPending = false;  // A discovery config was refused: resent on the next policy tick
+uint32_t haDiscoveryFailures = 0;
+bool haStateFailing = false;  // Last state publish was refused (logged once per streak)
+struct MeterHaHandles {
+    int totalVolume, totalLiters, dailyVolume, dailyLiters, yearlyVolume, yearlyLiters;
+    int pulseCount, flowRate, flowRateAvg;
+    int leak, burst;
+    int anomalyScore, anomaly;               // Last closed hour vs hour-of-week baseline
+    int periodLiters[WATER_PERIOD_COUNT];    // Hour/week/month/billing (-1 for day/year: daily/yearly_liters)
+    int previousLiters[WATER_PERIOD_COUNT];  // Closing value of the last cycle, every period
+    int isrRejectedDebounce, isrRejectedStable, isrBootDropped, isrMaxUs;  // -1 unless haDiagnostics
+};
+MeterHaHandles haSensor[METER_COUNT];
+struct {
+    int wifiSignal, uptime;
+} haSystem;
+
+// `water watch` console stream: bounded line queue + per-meter deltas since the last line
+WatchStream watch;
+AsyncServer watchServer(WATCH_PORT);
+AsyncClient* watchClient = nullptr;        // Set/cleared on the async_tcp task, written by loop(); under watchClientMutex
+std::mutex watchClientMutex;
+volatile bool watchSessionClosed = false;  // Session went away: loop() stops the stream
+struct WatchMeterState {
+    uint32_t lastPulseUs;
+    bool haveLastPulse;
+    uint64_t lastPulseCount;
+    uint32_t lastRejectedDebounce, lastRejectedStable;
+};
+WatchMeterState watchState[METER_COUNT];
+Utils::NonBlockingDelay watchTick(1000);
+bool watchSubscribed = false;
+
+// Store-and-forward while MQTT is down: readings buffered offline, replayed in batches after reconnect
+BacklogStore backlog;
+Utils::NonBlockingDelay backlogTimer(60000);
+Utils::NonBlockingDelay backlogReplayTimer(1000);
+String backlogTopic;
+bool mqttEverConnected = false;  // Nothing is buffered on a board that never reached a broker
+
+// Main loop duration for /metrics (written by loop(), read by the web server task)
+LoopTiming loopTiming;
+
+#if WATER_METER_PULSE_LOG
+// Every pulse timestamp, delta/varint encoded on the raw "spiffs" partition (months of history)
+PulseLog pulseLog;
+#endif
+
+/**
+ * @brief Per-meter entity id ("daily_liters" + "_hot")
+ */
+static String entityId(uint8_t index, const char* base) {
+    return String(base) + meters[index]->getEntitySuffix();
+}
+
+/**
+ * @brief Human readable suffix for entity names (" (hot)"), empty for a single unnamed meter
+ */
+static String entityLabel(uint8_t index) {
+    String suffix = meters[index]->getEntitySuffix();
+    return suffix.length() ? String(" (") + suffix.substring(1) + ")" : String("");
+}
+
+/**
+ * @brief Meter selected by a console argument (index or name), first meter when empty
+ */
+static WaterMeterComponent* meterFromArgs(const String& args) {
+    String arg = args;
+    arg.trim();
+    if (arg.length() == 0) return meters[0];
+    for (uint8_t i = 0; i < METER_COUNT; i++) {
+        if (arg == METERS[i].name || arg == String((unsigned)i)) return meters[i];
+    }
+    return nullptr;
+}
+
+/**
+ * @brief `water stats` output: edge counters by outcome + ISR time histogram
+ */
+static String formatIsrStats(WaterMeterComponent* meter) {
+    IsrStats::Snapshot s = meter->getIsrStats();
+    char line[112];
+    String output = "=== Pulse Input Stats " + meter->metadata.name + " (" + meter->getPulseSourceName() + ") ===\n";
+    snprintf(line, sizeof(line), "Edges:     %lu seen, %lu accepted\n", (unsigned long)s.edges, (unsigned long)s.accepted);
+    output += line;
+    snprintf(line, sizeof(line), "Rejected:  %lu debounce, %lu stability, %lu boot window\n",
+             (unsigned long)s.rejectedDebounce, (unsigned long)s.rejectedStable, (unsigned long)s.bootDropped);
+    output += line;
+    if (s.timedEdges == 0) {
+        output += "ISR time:  no samples (polled/mock source or WATER_METER_ISR_TIMING=0)\n";
+        return output;
+    }
+    snprintf(line, sizeof(line), "ISR time:  min %.2f us, avg %.2f us, max %.2f us (%lu cycles max @ %lu MHz)\n",
+             s.cyclesToUs(s.cyclesMin), s.cyclesToUs(s.cyclesAvg), s.cyclesToUs(s.cyclesMax),
+             (unsigned long)s.cyclesMax, (unsigned long)s.cpuMhz);
+    output += line;
+    output += "   cycles      runs\n";
+    for (uint8_t b = 0; b < IsrStats::CYCLE_BINS; b++) {
+        if (!s.cycleBins[b]) continue;
+        snprintf(line, sizeof(line), "%8s%lu %9lu\n", b ? ">=" : "<", 
+                 (unsigned long)(b ? IsrStats::cycleBinLower(b) : IsrStats::cycleBinLower(1)),
+                 (unsigned long)s.cycleBins[b]);
+        output += line;
+    }
+    return output;
+}
+
+/**
+ * @brief ISR rejections since the previous watch line of this meter (counting restarts)
+ */
+static void takeWatchRejections(uint8_t index, uint32_t& debounce, uint32_t& stable) {
+    IsrStats::Snapshot isr = meters[index]->getIsrStats();
+    WatchMeterState& w = watchState[index];
+    debounce = isr.rejectedDebounce - w.lastRejectedDebounce;
+    stable = isr.rejectedStable - w.lastRejectedStable;
+    w.lastRejectedDebounce = isr.rejectedDebounce;
+    w.lastRejectedStable = isr.rejectedStable;
+}
+
+/**
+ * @brief `water watch` (pulse mode): one line per pulse from the "watermeter.pulses" batches
+ */
+static void watchPulseBatch(const WaterMeterPulseBatch& batch) {
+    if (watch.getMode() != WatchStream::Mode::Pulse || batch.channel >= METER_COUNT) return;
+    if (!watch.watches(batch.channel)) return;
+    WatchMeterState& w = watchState[batch.channel];
+    const char* name = meters[batch.channel]->metadata.name.c_str();
+    uint32_t mlPerPulse = PulseVolume::mlFromLiters(meters[batch.channel]->getConfig().litersPerPulse);
+    uint32_t debounce, stable;
+    takeWatchRejections(batch.channel, debounce, stable);
+    
+    for (uint8_t i = 0; i < batch.count; i++) {
+        uint32_t t = batch.timestampsUs[i];
+        uint32_t dt = w.haveLastPulse ? t - w.lastPulseUs : 0;
+        w.lastPulseUs = t;
+        w.haveLastPulse = true;
+        if (dt) {
+            watch.printf("%s pulse t=%lu.%03lus dt=%lu ms %.2f L/min rej d%lu s%lu", name,
+                         (unsigned long)(t / 1000000), (unsigned long)(t / 1000 % 1000), (unsigned long)(dt / 1000),
+                         (float)mlPerPulse * 60000.0f / dt, (unsigned long)debounce, (unsigned long)stable);
+        } else {
+            watch.printf("%s pulse t=%lu.%03lus dt=? rej d%lu s%lu", name,
+                         (unsigned long)(t / 1000000), (unsigned long)(t / 1000 % 1000),
+                         (unsigned long)debounce, (unsigned long)stable);
+        }
+        debounce = stable = 0;  // Reported once, on the first line of the batch
+    }
+    if (batch.untimed) {
+        w.haveLastPulse = false;  // Interval chain broken
+        watch.printf("%s +%lu pulses without timestamp (queue overflow)", name, (unsigned long)batch.untimed);
+    }
+    w.lastPulseCount += batch.count + batch.untimed;
+}
+
+/**
+ * @brief `water watch` 1 s tick: summary line (second mode) or rejections without a pulse (pulse mode)
+ */
+static void watchSecondTick() {
+    for (uint8_t i = 0; i < METER_COUNT; i++) {
+        if (!watch.watches(i)) continue;
+        WatchMeterState& w = watchState[i];
+        uint32_t debounce, stable;
+        takeWatchRejections(i, debounce, stable);
+        WaterMeterData data = meters[i]->getData();
+        const char* name = meters[i]->metadata.name.c_str();
+        if (watch.getMode() == WatchStream::Mode::Second) {
+            watch.printf("%s +%lu pulses %.2f L/min (1m %.2f) rej d%lu s%lu, day %lu L",
+                         name, (unsigned long)(data.pulseCount - w.lastPulseCount), data.flowRateLpm, data.flow1mLpm,
+                         (unsigned long)debounce, (unsigned long)stable, (unsigned long)data.dailyLiters());
+        } else if (debounce || stable) {
+            watch.printf("%s no pulse, rej d%lu s%lu", name,
+                         (unsigned long)debounce, (unsigned long)stable);
+        }
+        w.lastPulseCount = data.pulseCount;
+    }
+}
+
+/**
+ * @brief WatchStream sink: the watch session only, never blocking loop()
+ *
+ * false (line kept, or dropped once the queue is full) while nobody is
+ * connected or the session's TCP send window cannot take the whole line.
+ */
+static bool watchToSession(const char* line) {
+    std::lock_guard<std::mutex> lock(watchClientMutex);
+    if (!watchClient || !watchClient->connected()) return false;
+    size_t len = strlen(line);
+    if (watchClient->space() < len + 2) return false;
+    watchClient->add(line, len);
+    watchClient->add("\r\n", 2);
+    watchClient->send();
+    return true;
+}
+
+/**
+ * @brief Accept one watch session at a time on WATCH_PORT
+ */
+static void setupWatchServer() {
+    watchServer.onClient([](void*, AsyncClient* client) {
+        client->onDisconnect([](void*, AsyncClient* c) {
+            {
+                std::lock_guard<std::mutex> lock(watchClientMutex);
+                if (c == watchClient) {
+                    watchClient = nullptr;
+                    watchSessionClosed = true;
+                }
+            }
+            delete c;
+        }, nullptr);
+        bool busy;
+        {
+            std::lock_guard<std::mutex> lock(watchClientMutex);
+            busy = watchClient != nullptr;
+            if (!busy) watchClient = client;
+        }
+        if (busy) {
+            client->close(true);  // Outside the lock: onDisconnect may run right here
+            return;
+        }
+        client->setNoDelay(true);
+    }, nullptr);
+    watchServer.begin();
+}
+
+/**
+ * @brief `water watch [pulse|sec|off] [meter]`
+ */
+static String startWatch(const String& args) {
+    String rest = args;
+    rest.trim();
+    WatchStream::Mode mode = WatchStream::Mode::Pulse;
+    if (rest.startsWith("off")) {
+        watch.stop();
+        return String("Watch stopped\n");
+    }
+    if (rest.startsWith("sec")) {
+        mode = WatchStream::Mode::Second;
+        rest = rest.substring(3);
+    } else if (rest.startsWith("pulse")) {
+        rest = rest.substring(5);
+    }
+    rest.trim();
+    int8_t meterIndex = -1;
+    if (rest.length()) {
+        WaterMeterComponent* meter = meterFromArgs(rest);
+        if (!meter) return String("ERROR: Unknown meter (use index or name)\n");
+        meterIndex = (int8_t)meter->getChannel();
+    }
+    
+    // First use: timestamps come from the pulse batches (the meter only builds them once someone listens)
+    if (!watchSubscribed) {
+        domotics->getCore().on<WaterMeterPulseBatch>("watermeter.pulses", watchPulseBatch);
+        watchSubscribed = true;
+    }
+    for (uint8_t i = 0; i < METER_COUNT; i++) {
+        WatchMeterState& w = watchState[i];
+        uint32_t debounce, stable;
+        takeWatchRejections(i, debounce, stable);  // Start counting from now
+        w.haveLastPulse = false;
+        w.lastPulseCount = meters[i]->getData().pulseCount;
+    }
+    watch.start(mode, meterIndex);
+    watchTick.reset();
+    return String("Watching ") + (meterIndex < 0 ? String("all meters") : meters[meterIndex]->metadata.name) +
+           (mode == WatchStream::Mode::Pulse ? " (one line per pulse)" : " (one line per second)") +
+           ", lines on port " + String(WATCH_PORT) + " (telnet <ip> " + String(WATCH_PORT) +
+           "; rej dN sN = edges rejected by debounce / stability); 'water watch off' to stop\n";
+}
+
+#if WATER_METER_EDGE_STATS
+/**
+ * @brief Bin lower bound for the edge histogram table ("384us", "1.5ms", "2.1s")
+ */
+static String formatEdgeTime(uint32_t us) {
+    char buf[16];
+    if (us < 1000) snprintf(buf, sizeof(buf), "%luus", (unsigned long)us);
+    else if (us < 1000000) snprintf(buf, sizeof(buf), "%.1fms", us / 1000.0);
+    else snprintf(buf, sizeof(buf), "%.1fs", us / 1000000.0);
+    return String(buf);
+}
+
+static String formatTunerSplit(const char* label, const DebounceTuner::Split& split) {
+    char buf[112];
+    if (!split.valid) {
+        snprintf(buf, sizeof(buf), "%s no safe proposal yet\n", label);
+    } else {
+        snprintf(buf, sizeof(buf), "%s %lu ms (noise <= %s, real >= %s)\n", label,
+                 (unsigned long)split.thresholdMs, split.noiseUs ? formatEdgeTime(split.noiseUs).c_str() : "none",
+                 formatEdgeTime(split.realUs).c_str());
+    }
+    return String(buf);
+}
+#endif
+
+/**
+ * @brief UTC seconds, 0 until NTP has set the clock
+ */
+static uint32_t epochNow() {
+    time_t now = time(nullptr);
+    return now > 1577836800 ? (uint32_t)now : 0;  // Before 2020: not synced
+}
+
+/**
+ * @brief One reading per meter into the offline backlog
+ */
+static void bufferReadings() {
+    uint32_t epoch = epochNow();
+    for (uint8_t i = 0; i < METER_COUNT; i++) {
+        WaterMeterData data = meters[i]->getData();
+        BacklogReading r = {};
+        r.time = epoch ? epoch : millis() / 1000;
+        r.flags = epoch ? BacklogReading::FLAG_EPOCH : 0;
+        r.channel = i;
+        float centi = data.flowRateLpm * 100.0f;
+        r.flowCentiLpm = centi > 65535.0f ? 65535 : (uint16_t)centi;
+        r.totalMl = data.totalMl;
+        r.dailyMl = data.dailyMl;
+        backlog.push(r);
+    }
+}
+
+/**
+ * @brief Publish the oldest buffered readings as one JSON message, drop them once sent
+ *
+ * {"readings":[{"meter":"hot","ts":1760000000,"total_ml":..,"daily_ml":..,"flow_lpm":1.25},..]}
+ * "ts" is replaced by "uptime_s" when the reading predates NTP sync in an earlier boot.
+ */
+static bool replayBacklogBatch(uint8_t maxReadings) {
+    BacklogReading batch[32];
+    bool sameBoot = true;
+    uint8_t n = backlog.peek(batch, maxReadings < 32 ? maxReadings : 32, sameBoot);
+    if (n == 0) return false;
+    
+    uint32_t epoch = epochNow();
+    uint32_t uptime = millis() / 1000;
+    String payload;
+    payload.reserve(24 + n * 112);
+    payload = "{\"readings\":[";
+    char item[128];
+    for (uint8_t k = 0; k < n; k++) {
+        const BacklogReading& r = batch[k];
+        uint32_t ts = BacklogStore::epochOf(r, sameBoot, epoch, uptime);
+        const char* meter = r.channel < METER_COUNT ? METERS[r.channel].name : "";
+        snprintf(item, sizeof(item), "%s{\"meter\":\"%s\",\"%s\":%lu,\"total_ml\":%llu,\"daily_ml\":%llu,\"flow_lpm\":%u.%02u}",
+                 k ? "," : "", meter, ts ? "ts" : "uptime_s", (unsigned long)(ts ? ts : r.time),
+                 (unsigned long long)r.totalMl, (unsigned long long)r.dailyMl,
+                 (unsigned)(r.flowCentiLpm / 100), (unsigned)(r.flowCentiLpm % 100));
+        payload += item;
+    }
+    payload += "]}";
+    if (!mqttPtr->publish(backlogTopic, payload)) return false;  // Kept for the next attempt
+    backlog.pop(n);
+    return true;
+}
+
+/**
+ * @brief Buffer while offline, drain at a fixed rate once MQTT is back
+ */
+static void serviceBacklog(bool online) {
+    if (!mqttPtr) return;
+    if (!online) {
+        if ((mqttEverConnected || !backlog.empty()) && backlogTimer.getInterval() && backlogTimer.isReady()) {
+            bufferReadings();
+        }
+        return;
+    }
+    if (backlog.empty() || !backlogReplayTimer.isReady()) return;
+    WaterMeterConfig cfg = meters[0]->getConfig();
+    if (replayBacklogBatch(cfg.backlogBatch) && backlog.empty()) {
+        const BacklogStore::Stats& s = backlog.getStats();
+        DLOG_I(LOG_APP, "Offline backlog forwarded (%lu readings total, %lu dropped)",
+               (unsigned long)s.forwarded, (unsigned long)s.dropped);
+    }
+}
+
+#if WATER_METER_PULSE_LOG
+/**
+ * @brief "watermeter.pulses" batch -> pulse log (micros() timestamps turned into UTC ms)
+ */
+static void logPulseBatch(const WaterMeterPulseBatch& batch) {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    bool synced = tv.tv_sec > 1577836800;  // Before 2020: NTP not done yet
+    uint64_t nowMs = (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    uint32_t nowUs = micros();
+    uint32_t loopMs = millis();
+    for (uint8_t i = 0; i < batch.count; i++) {
+        uint32_t ageMs = (nowUs - batch.timestampsUs[i]) / 1000;
+        pulseLog.append(batch.channel, synced ? nowMs - ageMs : 0, loopMs);
+    }
+    for (uint32_t i = 0; i < batch.untimed; i++) {
+        pulseLog.append(batch.channel, synced ? nowMs : 0, loopMs);  // Overflowed pulses: batch time
+    }
+}
+#endif
+
+/**
+ * @brief /metrics content: every meter, then board health (heap, uptime, loop time, HA, backlog)
+ *
+ * Runs on the web server task; reads only plain counters and getData()
+ * snapshots, formats into the writer's static page without allocating.
+ */
+static void writeMetrics(MetricsWriter& w) {
+    const char* names[METER_COUNT];
+    for (uint8_t i = 0; i < METER_COUNT; i++) {
+        names[i] = METERS[i].name;
+    }
+    waterMeterWriteMetrics(w, meters, names, METER_COUNT);
+    
+    w.family("watermeter_build", "info", "Firmware version");
+    w.sample("version=\"" WATER_METER_VERSION "\"", 1, "_info");
+    
+    w.family("watermeter_uptime_seconds", "gauge", "Time since boot", "seconds");
+    w.sampleFixed(nullptr, millis(), 3);
+    
+    w.family("watermeter_heap_free_bytes", "gauge", "Free heap", "bytes");
+    w.sample(nullptr, ESP.getFreeHeap());
+    w.family("watermeter_heap_min_free_bytes", "gauge", "Lowest free heap since boot", "bytes");
+    w.sample(nullptr, ESP.getMinFreeHeap());
+    w.family("watermeter_heap_max_alloc_bytes", "gauge", "Largest free heap block (fragmentation)", "bytes");
+    w.sample(nullptr, ESP.getMaxAllocHeap());
+    
+    w.family("watermeter_loop_duration_seconds", "summary", "Main loop() run time", "seconds");
+    w.sample(nullptr, loopTiming.count, "_count");
+    w.sampleFixed(nullptr, loopTiming.totalUs, 6, "_sum");
+    w.family("watermeter_loop_duration_max_seconds", "gauge", "Longest main loop() run", "seconds");
+    w.sampleFixed(nullptr, loopTiming.maxUs, 6);
+    
+    const PublishPolicy::Stats& ha = haPolicy.getStats();
+    w.family("watermeter_ha_states", "counter", "Home Assistant state values by outcome");
+    w.sample("result=\"published\"", ha.published, "_total");
+    w.sample("result=\"unchanged\"", ha.suppressed, "_total");
+    w.sample("result=\"rate_limited\"", ha.rateLimited, "_total");
+    w.family("watermeter_ha_messages", "counter", "Home Assistant state documents by outcome");
+    w.sample("result=\"published\"", ha.messages, "_total");
+    w.sample("result=\"failed\"", ha.failed, "_total");
+    w.family("watermeter_ha_discovery_failures", "counter", "Home Assistant discovery configs the MQTT client refused");
+    w.sample(nullptr, haDiscoveryFailures, "_total");
+    
+    const BacklogStore::Stats& bl = backlog.getStats();
+    w.family("watermeter_backlog_readings", "gauge", "Offline readings waiting for MQTT");
+    w.sample(nullptr, backlog.size());
+    w.family("watermeter_backlog_forwarded", "counter", "Offline readings replayed to MQTT");
+    w.sample(nullptr, bl.forwarded, "_total");
+    w.family("watermeter_backlog_dropped", "counter", "Offline readings lost (RAM and flash full)");
+    w.sample(nullptr, bl.dropped, "_total");
+    
+    auto* wifiComp = domotics->getWiFi();
+    if (wifiComp && wifiComp->isSTAConnected()) {
+        w.family("watermeter_wifi_rssi_dbm", "gauge", "WiFi signal strength");
+        w.sampleFloat(nullptr, (float)wifiComp->getRSSI());
+    }
+}
+
+/**
+ * @brief Register one HA sensor: policy threshold + discovery metadata, returns its handle
+ */
+static int addHaSensor(const String& id, const String& name, float threshold, int8_t decimals, const char* unit,
+                       const char* deviceClass, const char* icon, const char* stateClass = "") {
+    int h = haPolicy.addSensor(id.c_str(), threshold);
+    if (h < 0) {
+        DLOG_W(LOG_APP, "HA sensor '%s' dropped: raise WATER_METER_PUBLISH_MAX_SENSORS", id.c_str());
+        return h;
+    }
+    haInfo[h] = {name, unit, deviceClass, icon, stateClass, decimals};
+    haValues[h] = 0.0f;
+    return h;
+}
+
+static int addHaBinarySensor(const String& id, const String& name, const char* deviceClass, const char* icon) {
+    return addHaSensor(id, name, 0.5f, -1, "", deviceClass, icon);  // Any flip
+}
+
+/**
+ * @brief Register HA sensors (thresholds from config, names/units for discovery)
+ */
+void setupHaSensors(const WaterMeterConfig& cfg) {
+    PublishPolicy::Timing timing;
+    timing.activeIntervalMs = cfg.haActiveIntervalMs;
+    timing.idleIntervalMs = cfg.haIdleIntervalMs;
+    timing.heartbeatMs = cfg.haHeartbeatMs;
+    timing.burstTokens = cfg.haBurstMessages;
+    timing.tokensPerMinute = cfg.haMessagesPerMinute;
+    haPolicy.setTiming(timing);
+    
+    static const char* const PERIOD_TITLES[WATER_PERIOD_COUNT] = {
+        "Hour", "Day", "Week", "Month", "Billing Period", "Year"
+    };
+    for (uint8_t i = 0; i < METER_COUNT; i++) {
+        WaterMeterConfig meterCfg = meters[i]->getConfig();
+        float liters = meterCfg.haVolumeThresholdL;
+        float flow = meterCfg.haFlowThresholdLpm;
+        String label = entityLabel(i);
+        MeterHaHandles& h = haSensor[i];
+        
+        // Total counters need "total_increasing" state class for HA Energy Dashboard;
+        // daily/yearly are totals that reset, HA handles the resets
+        h.totalVolume = addHaSensor(entityId(i, "total_volume"), "Total Water Volume" + label, liters / 1000.0f, 3,
+                                    "m³", "water", "mdi:water-outline", "total_increasing");
+        h.totalLiters = addHaSensor(entityId(i, "total_liters"), "Total Liters" + label, liters, 0,
+                                    "L", "water", "mdi:water-outline", "total_increasing");
+        h.dailyVolume = addHaSensor(entityId(i, "daily_volume"), "Daily Consumption" + label, liters / 1000.0f, 3,
+                                    "m³", "water", "mdi:water-outline", "total_increasing");
+        h.dailyLiters = addHaSensor(entityId(i, "daily_liters"), "Daily Liters" + label, liters, 0,
+                                    "L", "water", "mdi:water-outline", "total_increasing");
+        h.yearlyVolume = addHaSensor(entityId(i, "yearly_volume"), "Yearly Consumption" + label, liters / 1000.0f, 3,
+                                     "m³", "water", "mdi:water-pump", "total_increasing");
+        h.yearlyLiters = addHaSensor(entityId(i, "yearly_liters"), "Yearly Liters" + label, liters, 0,
+                                     "L", "water", "mdi:water-pump", "total_increasing");
+        h.pulseCount = addHaSensor(entityId(i, "pulse_count"), "Total Pulses" + label, 1.0f, 0,
+                                   "", "", "mdi:counter", "total_increasing");
+        
+        // Flow rate is a measurement (computed on-device from pulse intervals)
+        h.flowRate = addHaSensor(entityId(i, "flow_rate"), "Flow Rate" + label, flow, 2,
+                                 "L/min", "volume_flow_rate", "mdi:water-pump", "measurement");
+        h.flowRateAvg = addHaSensor(entityId(i, "flow_rate_avg"), "Flow Rate (15 min avg)" + label, flow, 2,
+                                    "L/min", "volume_flow_rate", "mdi:water-pump", "measurement");
+        
+        // Alarms detected on-device (pushed on transition via watermeter.alarm, no polling needed)
+        h.leak = addHaBinarySensor(entityId(i, "leak"), "Water Leak" + label, "moisture", "mdi:water-alert");
+        h.burst = addHaBinarySensor(entityId(i, "burst"), "Pipe Burst" + label, "problem", "mdi:pipe-leak");
+        
+        // Hourly usage vs the usual for that hour of the week (changes once an hour)
+        h.anomalyScore = addHaSensor(entityId(i, "usage_score"), "Hourly Usage Score" + label, 0.5f, 1,
+                                     "", "", "mdi:chart-bell-curve", "measurement");
+        h.anomaly = addHaBinarySensor(entityId(i, "unusual_usage"), "Unusual Usage" + label, "problem", "mdi:water-alert-outline");
+        
+        // Period totals (hour, ISO week, month, billing cycle) and each period's previous closing value
+        for (uint8_t p = 0; p < WATER_PERIOD_COUNT; p++) {
+            String base = PeriodAccumulators::name((WaterPeriod)p);
+            bool alreadyPublished = p == (uint8_t)WaterPeriod::Day || p == (uint8_t)WaterPeriod::Year;
+            h.periodLiters[p] = alreadyPublished ? -1 :
+                addHaSensor(entityId(i, (base + "_liters").c_str()), String("This ") + PERIOD_TITLES[p] + label, liters, 0,
+                            "L", "water", "mdi:water-outline", "total_increasing");
+            h.previousLiters[p] = addHaSensor(entityId(i, ("last_" + base + "_liters").c_str()),
+                                              String("Previous ") + PERIOD_TITLES[p] + label, liters, 0,
+                                              "L", "water", "mdi:history");
+        }
+        
+        // Optional diagnostics: pulse input health (bouncing reed, noisy line, ISR cost)
+        h.isrRejectedDebounce = h.isrRejectedStable = h.isrBootDropped = h.isrMaxUs = -1;
+        if (meterCfg.haDiagnostics) {
+            h.isrRejectedDebounce = addHaSensor(entityId(i, "isr_rejected_debounce"), "Edges Rejected (debounce)" + label, 1.0f, 0,
+                                                "", "", "mdi:filter-remove", "total_increasing");
+            h.isrRejectedStable = addHaSensor(entityId(i, "isr_rejected_stability"), "Edges Rejected (stability)" + label, 1.0f, 0,
+                                              "", "", "mdi:filter-remove", "total_increasing");
+            h.isrBootDropped = addHaSensor(entityId(i, "isr_boot_dropped"), "Edges Dropped at Boot" + label, 1.0f, 0,
+                                           "", "", "mdi:timer-sand", "total_increasing");
+            h.isrMaxUs = addHaSensor(entityId(i, "isr_max_time"), "Pulse ISR Max Time" + label, 1.0f, 1,
+                                     "µs", "duration", "mdi:timer-outline", "measurement");
+        }
+    }
+    
+    // System sensors
+    haSystem.wifiSignal = addHaSensor("wifi_signal", "WiFi Signal", 5.0f, 0, "dBm", "signal_strength", "mdi:wifi");  // dBm jitter is not news
+    haSystem.uptime = addHaSensor("uptime", "Uptime", 1e9f, 0, "s", "", "mdi:clock-outline");                        // Heartbeat only
+}
+
+/**
+ * @brief Retained discovery config of every policy sensor, all reading haStateTopic through value_template
+ *
+ * Sent on every MQTT connect (cheap, retained: HA restarts need nothing from us).
+ * Topic homeassistant/<sensor|binary_sensor>/<node>/<id>/config, unique_id <node>_<id>.
+ * Same device identifier and availability (LWT) topic as the HA component's
+ * buttons: one device in HA, every entity unavailable while the board is offline.
+ * @return false if any config was refused (counted, the caller retries)
+ */
+static bool publishHaDiscovery() {
+    uint8_t failed = 0;
+    for (uint8_t h = 0; h < haPolicy.size(); h++) {
+        const HaSensorInfo& info = haInfo[h];
+        const char* id = haPolicy.getId(h);
+        bool binary = info.decimals < 0;
+        String uniqueId = haNodeId + "_" + id;
+        
+        JsonDocument doc;
+        doc["name"] = info.name;
+        doc["unique_id"] = uniqueId;
+        doc["object_id"] = uniqueId;
+        doc["state_topic"] = haStateTopic;
+        doc["availability_topic"] = haAvailabilityTopic;
+        doc["payload_available"] = "online";
+        doc["payload_not_available"] = "offline";
+        doc["value_template"] = binary ? String("{{ 'ON' if value_json.") + id + " else 'OFF' }}"
+                                       : String("{{ value_json.") + id + " }}";
+        if (info.unit[0]) doc["unit_of_measurement"] = info.unit;
+        if (info.deviceClass[0]) doc["device_class"] = info.deviceClass;
+        if (info.stateClass[0]) doc["state_class"] = info.stateClass;
+        doc["icon"] = info.icon;
+        JsonObject device = doc["device"].to<JsonObject>();
+        device["identifiers"][0] = haNodeId;
+        device["name"] = haDeviceName;
+        device["sw_version"] = WATER_METER_VERSION;
+        
+        String payload;
+        serializeJson(doc, payload);
+        String topic = haDiscoveryPrefix + (binary ? "/binary_sensor/" : "/sensor/") + haNodeId + "/" + id + "/config";
+        if (!mqttPtr->publish(topic, payload, 0, true)) failed++;
+    }
+    if (failed) {
+        haDiscoveryFailures += failed;
+        DLOG_W(LOG_APP, "HA discovery: %u/%u configs not published, retrying", (unsigned)failed, (unsigned)haPolicy.size());
+    }
+    return failed == 0;
+}
+
+static inline void setHaValue(int handle, float value) {
+    if (handle >= 0) haValues[handle] = value;  // -1: not registered (diagnostics off, policy full)
+}
+
+/**
+ * @brief Current value of every policy sensor (one getData() snapshot per meter)
+ */
+static void collectHaValues() {
+    for (uint8_t i = 0; i < METER_COUNT; i++) {
+        const MeterHaHandles& h = haSensor[i];
+        WaterMeterData data = meters[i]->getData();
+        // Integer mL converted once here (m³ / whole liters)
+        setHaValue(h.totalVolume, data.totalM3());
+        setHaValue(h.totalLiters, (float)data.totalLiters());
+        setHaValue(h.dailyVolume, data.dailyM3());
+        setHaValue(h.dailyLiters, (float)data.dailyLiters());
+        setHaValue(h.yearlyVolume, data.yearlyM3());
+        setHaValue(h.yearlyLiters, (float)data.yearlyLiters());
+        setHaValue(h.pulseCount, (float)data.pulseCount);
+        setHaValue(h.flowRate, data.flowRateLpm);
+        setHaValue(h.flowRateAvg, data.flow15mLpm);
+        setHaValue(h.leak, data.leakAlarm ? 1.0f : 0.0f);
+        setHaValue(h.burst, data.burstAlarm ? 1.0f : 0.0f);
+        setHaValue(h.anomalyScore, data.anomalyScore);
+        setHaValue(h.anomaly, data.anomaly ? 1.0f : 0.0f);
+        for (uint8_t p = 0; p < WATER_PERIOD_COUNT; p++) {
+            setHaValue(h.periodLiters[p], (float)data.periodLiters((WaterPeriod)p));
+            setHaValue(h.previousLiters[p], (float)data.previousLiters((WaterPeriod)p));
+        }
+        if (h.isrMaxUs >= 0) {
+            IsrStats::Snapshot isr = meters[i]->getIsrStats();
+            setHaValue(h.isrRejectedDebounce, (float)isr.rejectedDebounce);
+            setHaValue(h.isrRejectedStable, (float)isr.rejectedStable);
+            setHaValue(h.isrBootDropped, (float)isr.bootDropped);
+            setHaValue(h.isrMaxUs, isr.cyclesToUs(isr.cyclesMax));
+        }
+    }
+    
+    // System metrics
+    setHaValue(haSystem.uptime, (float)(millis() / 1000));
+    
+    // WiFi signal if connected (last value kept otherwise)
+    auto* wifiComp = domotics->getWiFi();
+    if (wifiComp && wifiComp->isSTAConnected()) {
+        setHaValue(haSystem.wifiSignal, (float)wifiComp->getRSSI());
+    }
+}
+
+/**
+ * @brief One retained JSON state document with every sensor, if the policy says any value is due
+ *
+ * {"total_volume":12.345,"total_liters":12345,...,"leak":false,"wifi_signal":-61,"uptime":3600}
+ * Committed to the policy only when the client accepted it: a failed publish
+ * (broker hiccup, document over the client's packet buffer) is retried.
+ */
+static void publishHaState() {
+    if (!haPolicy.dueAll(haValues)) return;
+    
+    String payload;
+    payload.reserve(8 + haPolicy.size() * 36);
+    payload = "{";
+    char value[64];  // -FLT_MAX with 3 decimals is 44 chars
+    for (uint8_t h = 0; h < haPolicy.size(); h++) {
+        if (h) payload += ',';
+        payload += '"';
+        payload += haPolicy.getId(h);  // Ids any length: appended, never formatted into a fixed buffer
+        payload += "\":";
+        if (haInfo[h].decimals < 0) {
+            payload += haValues[h] != 0.0f ? "true" : "false";
+            continue;
+        }
+        int n = isfinite(haValues[h]) ? snprintf(value, sizeof(value), "%.*f", (int)haInfo[h].decimals, (double)haValues[h]) : -1;
+        payload += (n > 0 && (size_t)n < sizeof(value)) ? value : "null";  // Never a cut-off number or "nan"
+    }
+    payload += "}";
+    if (!mqttPtr->publish(haStateTopic, payload, 0, true)) {
+        if (!haStateFailing) {  // Once per failure streak, retried every activeIntervalMs
+            DLOG_W(LOG_APP, "HA state not published (%u bytes on %s), check the MQTT buffer size; retrying",
+                   (unsigned)payload.length(), haStateTopic.c_str());
+        }
+        haStateFailing = true;
+        haPolicy.sendFailed();
+        return;
+    }
+    if (haStateFailing) DLOG_I(LOG_APP, "HA state published again (%u bytes)", (unsigned)payload.length());
+    haStateFailing = false;
+    haPolicy.commitAll(haValues);
+}
+
 void setup() {
     Serial.begin(115200);
     delay(100);  // Brief delay for serial
@@ -66,9 +804,15 @@ void setup() {
     
     domotics = new System(config);
     
-    // Add WaterMeter component (can be before or after begin() thanks to lazy Core injection)
-    waterMeter = new WaterMeterComponent();
-    domotics->getCore().addComponent(std::unique_ptr<WaterMeterComponent>(waterMeter));
+    // Add one WaterMeter component per meter (can be before or after begin() thanks to lazy Core injection)
+    for (uint8_t i = 0; i < METER_COUNT; i++) {
+        WaterMeterConfig meterConfig;
+        meterConfig.channel = i;
+        meterConfig.channelName = METERS[i].name;
+        meterConfig.pulseInputPin = METERS[i].pin;
+        meters[i] = new WaterMeterComponent(meterConfig);
+        domotics->getCore().addComponent(std::unique_ptr<WaterMeterComponent>(meters[i]));
+    }
     
     if (!domotics->begin()) {
         DLOG_E(LOG_APP, "System initialization failed!");
@@ -78,11 +822,31 @@ void setup() {
         }
     }
     
+#if WATER_METER_PULSE_LOG
+    if (pulseLog.begin(meters[0]->getConfig().pulseLogFlushMs)) {
+        domotics->getCore().on<WaterMeterPulseBatch>("watermeter.pulses", logPulseBatch);
+        DLOG_I(LOG_APP, "✓ Pulse log: %lu/%lu pages used", (unsigned long)pulseLog.pages(),
+               (unsigned long)pulseLog.capacityPages());
+    } else {
+        DLOG_W(LOG_APP, "Pulse log disabled: no '%s' data partition", WATER_METER_PULSE_LOG_PARTITION);
+    }
+    const PulseLog* routeLog = &pulseLog;
+#else
+    const PulseLog* routeLog = nullptr;
+#endif
+    
     // Register WaterMeter WebUI provider
     auto* webui = domotics->getCore().getComponent<WebUIComponent>("WebUI");
-    if (webui && waterMeter) {
-        webui->registerProviderWithComponent(new WaterMeterWebUIProvider(waterMeter), waterMeter);
-        DLOG_I(LOG_APP, "✓ WaterMeter WebUI provider registered");
+    if (webui) {
+        for (uint8_t i = 0; i < METER_COUNT; i++) {
+            auto* provider = new WaterMeterWebUIProvider(meters[i]);
+            webui->registerProviderWithComponent(provider, meters[i]);
+            registerWaterMeterRoutes(webui->getServer(), meters[i], provider, routeLog);
+            DLOG_I(LOG_APP, "✓ WaterMeter WebUI provider registered for %s (history: %s/history)",
+                   meters[i]->metadata.name.c_str(), waterMeterApiBase(meters[i]).c_str());
+        }
+        registerWaterMeterMetricsRoute(webui->getServer(), writeMetrics);
+        DLOG_I(LOG_APP, "✓ Metrics: /metrics (OpenMetrics, %u byte static page)", (unsigned)WATER_METER_METRICS_BYTES);
     }
     
     // ========================================================================
@@ -95,40 +859,48 @@ void setup() {
     mqttPtr = domotics->getCore().getComponent<MQTTComponent>("MQTT");
     haPtr = domotics->getCore().getComponent<HomeAssistant::HomeAssistantComponent>("HomeAssistant");
     
+    // Offline backlog: chunks left in flash by an earlier boot are replayed after the first connect
+    if (mqttPtr) {
+        WaterMeterConfig cfg = meters[0]->getConfig();
+        backlog.attach(domotics->getCore().getComponent<StorageComponent>("Storage"), esp_random());
+        backlogTimer = Utils::NonBlockingDelay(cfg.backlogIntervalMs);
+        backlogReplayTimer = Utils::NonBlockingDelay(cfg.backlogReplayMs);
+        backlogTopic = config.deviceName + "/backlog";
+        backlogTopic.toLowerCase();
+        if (!backlog.empty()) {
+            DLOG_I(LOG_APP, "Offline backlog: %lu readings from before reboot", (unsigned long)backlog.size());
+        }
+    }
+    
     if (haPtr && mqttPtr) {
         DLOG_I(LOG_APP, "Setting up Home Assistant entities...");
+        // Device identity and LWT from the HA component, so sensors and buttons share one device
+        const HomeAssistant::HAConfig& haConfig = haPtr->getConfig();
+        haDeviceName = haConfig.deviceName;
+        haNodeId = haConfig.nodeId;
+        haDiscoveryPrefix = haConfig.discoveryPrefix;
+        haAvailabilityTopic = haConfig.availabilityTopic.isEmpty() ? haNodeId + "/availability"
+                                                                    : haConfig.availabilityTopic;
+        haStateTopic = haNodeId + "/state";
+        setupHaSensors(meters[0]->getConfig());
         
-        // Water meter sensors
-        // Total counters need "total_increasing" state class for HA Energy Dashboard
-        haPtr->addSensor("total_volume", "Total Water Volume", "m³", "water", "mdi:water-outline", "total_increasing");
-        haPtr->addSensor("total_liters", "Total Liters", "L", "water", "mdi:water-outline", "total_increasing");
-        
-        // Daily/Yearly are also totals that reset, so they are also "total_increasing" (HA handles resets automatically)
-        haPtr->addSensor("daily_volume", "Daily Consumption", "m³", "water", "mdi:water-outline", "total_increasing");
-        haPtr->addSensor("daily_liters", "Daily Liters", "L", "water", "mdi:water-outline", "total_increasing");
-        haPtr->addSensor("yearly_volume", "Yearly Consumption", "m³", "water", "mdi:water-pump", "total_increasing");
-        haPtr->addSensor("yearly_liters", "Yearly Liters", "L", "water", "mdi:water-pump", "total_increasing");
-        
-        haPtr->addSensor("pulse_count", "Total Pulses", "", "", "mdi:counter", "total_increasing");
-        
-        // System sensors
-        haPtr->addSensor("wifi_signal", "WiFi Signal", "dBm", "signal_strength", "mdi:wifi");
-        haPtr->addSensor("uptime", "Uptime", "s", "", "mdi:clock-outline");
-        
-        // Reset buttons
-        haPtr->addButton("reset_daily", "Reset Daily Counter", []() {
-            if (waterMeter) {
-                waterMeter->resetDaily();
-                DLOG_I(LOG_APP, "Daily counter reset from Home Assistant");
-            }
-        }, "mdi:refresh");
-        
-        haPtr->addButton("reset_yearly", "Reset Yearly Counter", []() {
-            if (waterMeter) {
-                waterMeter->resetYearly();
-                DLOG_I(LOG_APP, "Yearly counter reset from Home Assistant");
-            }
-        }, "mdi:calendar-refresh");
+        // Sensors: own discovery + one batched state document (publishHaDiscovery/publishHaState);
+        // the HA component keeps the device's buttons
+        for (uint8_t i = 0; i < METER_COUNT; i++) {
+            WaterMeterComponent* meter = meters[i];
+            String label = entityLabel(i);
+            
+            // Reset buttons
+            haPtr->addButton(entityId(i, "reset_daily"), "Reset Daily Counter" + label, [meter]() {
+                meter->resetDaily();
+                DLOG_I(LOG_APP, "Daily counter reset from Home Assistant (%s)", meter->metadata.name.c_str());
+            }, "mdi:refresh");
+            
+            haPtr->addButton(entityId(i, "reset_yearly"), "Reset Yearly Counter" + label, [meter]() {
+                meter->resetYearly();
+                DLOG_I(LOG_APP, "Yearly counter reset from Home Assistant (%s)", meter->metadata.name.c_str());
+            }, "mdi:calendar-refresh");
+        }
         
         haPtr->addButton("restart", "Restart Device", []() {
             DLOG_I(LOG_APP, "Restart requested from Home Assistant");
@@ -136,12 +908,12 @@ void setup() {
             ESP.restart();
         }, "mdi:restart");
         
-        DLOG_I(LOG_APP, "✓ Home Assistant entities created (%d entities)", 
-               haPtr->getStatistics().entityCount);
+        DLOG_I(LOG_APP, "✓ Home Assistant entities created (%u sensors on %s, %d buttons)",
+               (unsigned)haPolicy.size(), haStateTopic.c_str(), haPtr->getStatistics().entityCount);
         
-        // v1.2.1: Discovery is AUTOMATICALLY published via EventBus orchestration:
+        // v1.2.1: Button discovery is AUTOMATICALLY published via EventBus orchestration:
         // WiFi Connected → MQTT Connect → HA Discovery → NTP Sync
-        // No manual discovery needed - works immediately after WebUI config!
+        // Sensor discovery goes out from the mqtt/connected handler below
         DLOG_I(LOG_APP, "✓ Discovery will auto-publish when MQTT connects (EventBus orchestration)");
     } else {
         if (!haPtr) {
@@ -156,96 +928,216 @@ void setup() {
     // Listen to MQTT events for better integration
     domotics->getCore().on<bool>("mqtt/connected", [](const bool&) {
         DLOG_I(LOG_APP, "🔗 MQTT connected via EventBus - WaterMeter ready for HA discovery");
+        if (haPtr && haPolicy.size()) haDiscoveryPending = !publishHaDiscovery();
+        haPolicy.invalidate();  // Retained states may be stale after a reconnect: resend all
+        mqttEverConnected = true;
+        if (!backlog.empty()) {
+            DLOG_I(LOG_APP, "Replaying %lu offline readings to %s", (unsigned long)backlog.size(), backlogTopic.c_str());
+            backlogReplayTimer.reset();  // First batch one interval after the reconnect burst
+        }
     });
     
     domotics->getCore().on<bool>("mqtt/disconnected", [](const bool&) {
         DLOG_W(LOG_APP, "🔌 MQTT disconnected via EventBus");
     });
     
+    // Alarm transitions go out immediately, not on the next policy tick
+    domotics->getCore().on<WaterMeterAlarm>("watermeter.alarm", [](const WaterMeterAlarm& alarm) {
+        if (!haPtr || !haPtr->isMQTTConnected()) return;
+        if (alarm.channel >= METER_COUNT) return;
+        collectHaValues();  // The flipped alarm is due: the whole document goes out with it (or is retried on the next tick)
+        // Taken from the event itself: a deferred delivery may see a newer or older snapshot
+        const MeterHaHandles& h = haSensor[alarm.channel];
+        setHaValue(alarm.type == WaterMeterAlarm::Leak ? h.leak : h.burst, alarm.active ? 1.0f : 0.0f);
+        publishHaState();
+    });
+    
     DLOG_I(LOG_APP, "=== WaterMeter v" WATER_METER_VERSION " Ready ===");
     DLOG_I(LOG_APP, "WebUI: http://watermeter-esp32.local or http://192.168.4.1");
-    DLOG_I(LOG_APP, "Console: telnet IP_ADDRESS (commands: water, reset_daily, reset_yearly)");
+    DLOG_I(LOG_APP, "Console: telnet IP_ADDRESS (commands: water, water stats, water watch, edges, reset_daily, reset_yearly)");
+    setupWatchServer();
     
     // Register console commands for water meter
     domotics->registerCommand("water", [](const String& args) {
-        if (!waterMeter) return String("ERROR: WaterMeter not initialized\n");
+        String sub = args;
+        sub.trim();
+        if (sub.startsWith("watch")) {
+            return startWatch(sub.substring(5));
+        }
+        if (sub.startsWith("stats")) {
+            WaterMeterComponent* meter = meterFromArgs(sub.substring(5));
+            if (!meter) return String("ERROR: Unknown meter (use index or name)\n");
+            return formatIsrStats(meter);
+        }
         
-        WaterMeterData data = waterMeter->getData();
         String output;
-        output += "=== Water Meter Status ===\n";
-        output += "Total:   " + String(data.totalM3, 3) + " m³ (" + String(data.pulseCount) + " pulses)\n";
-        output += "Daily:   " + String(data.dailyM3, 3) + " m³ (" + String(data.dailyLiters) + " L)\n";
-        output += "Yearly:  " + String(data.yearlyM3, 3) + " m³ (" + String(data.yearlyLiters) + " L)\n";
-        output += "\nCommands: water, reset_daily, reset_yearly\n";
+        for (uint8_t i = 0; i < METER_COUNT; i++) {
+            WaterMeterComponent* meter = meters[i];
+            if (!meter) return String("ERROR: WaterMeter not initialized\n");
+            
+            WaterMeterData data = meter->getData();
+            output += "=== Water Meter Status";
+            output += METER_COUNT > 1 ? " [" + String((unsigned)i) + "] " + meter->metadata.name + " ===\n" : String(" ===\n");
+            char m3[24];
+            waterMeterFormatM3(m3, sizeof(m3), data.totalMl);
+            output += "Total:   " + String(m3) + " m³ (" + String(data.pulseCount) + " pulses)\n";
+            waterMeterFormatM3(m3, sizeof(m3), data.dailyMl);
+            output += "Daily:   " + String(m3) + " m³ (" + String(data.dailyLiters()) + " L)\n";
+            waterMeterFormatM3(m3, sizeof(m3), data.yearlyMl);
+            output += "Yearly:  " + String(m3) + " m³ (" + String(data.yearlyLiters()) + " L)\n";
+            output += "Periods:";
+            for (uint8_t p = 0; p < WATER_PERIOD_COUNT; p++) {
+                output += String(p ? ", " : " ") + PeriodAccumulators::name((WaterPeriod)p) + " " +
+                          String(data.periodLiters((WaterPeriod)p)) + " L (prev " +
+                          String(data.previousLiters((WaterPeriod)p)) + ")";
+            }
+            output += " [billing from day " + String((unsigned)meter->getConfig().billingStartDay) + "]\n";
+            output += "Flow:    " + String(data.flowRateLpm, 2) + " L/min (avg " + String(data.flowRateAvgLpm, 2) +
+                      ", 1m " + String(data.flow1mLpm, 2) + ", 15m " + String(data.flow15mLpm, 2) + ")\n";
+            output += "Alarms:  leak " + String(data.leakAlarm ? "ACTIVE" : "ok") + ", burst " +
+                      String(data.burstAlarm ? "ACTIVE" : "ok") + " (continuous flow " +
+                      String(data.continuousFlowS / 60) + " min)\n";
+            WeeklyBaseline::Stats usage = meter->getBaselineStats();
+            output += "Usage:   last hour " + String(data.previousLiters(WaterPeriod::Hour)) + " L (usual " +
+                      String(data.usualHourL, 0) + " L), score " + String(data.anomalyScore, 1) +
+                      (data.anomaly ? " UNUSUAL" : "") + " [" + String((unsigned long)usage.updates) + " hours learned, " +
+                      String((unsigned long)usage.anomalies) + " flagged since boot]\n";
+            CounterStore::Stats saves = meter->getPersistenceStats();
+            output += "Saves:   " + String(saves.writes) + " written, " + String(saves.skipped) + " skipped (unchanged), " +
+                      String(saves.avgLatencyUs()) + " us avg, " + String(saves.maxLatencyUs) + " us max\n";
+            if (const PulseTask::Stats* task = meter->getPulseTaskStats()) {
+                output += "Task:    core " + String((unsigned)meter->getConfig().pulseTaskCore) + ", " +
+                          String((unsigned long)task->runs) + " runs, " + String((unsigned long)task->lastRunUs) +
+                          " us last, " + String((unsigned long)task->maxRunUs) + " us max\n";
+            }
+        }
+        const PublishPolicy::Stats& ha = haPolicy.getStats();
+        output += "Loop:    " + String((unsigned long)loopTiming.lastUs) + " us last, " +
+                  String((unsigned long)loopTiming.maxUs) + " us max\n";
+        output += "HA:      " + String(ha.messages) + " state messages (" + String(ha.published) + " values published, " +
+                  String(ha.suppressed) + " unchanged, " + String(ha.rateLimited) + " rate limited), " +
+                  String(ha.failed) + " failed, " + String(haDiscoveryFailures) + " discovery configs failed\n";
+        const BacklogStore::Stats& bl = backlog.getStats();
+        output += "Offline: " + String(backlog.size()) + " readings waiting, " + String(bl.forwarded) + " forwarded, " +
+                  String(bl.dropped) + " dropped, " + String(bl.spills) + " spilled to flash\n";
+#if WATER_METER_PULSE_LOG
+        const PulseLog::Stats& pl = pulseLog.getStats();
+        output += "Pulse log: " + String(pulseLog.pages()) + "/" + String(pulseLog.capacityPages()) + " pages, " +
+                  String(pl.logged) + " logged, " + String(pl.unsynced) + " before NTP, " + String(pl.writeFailures) +
+                  " write errors\n";
+#endif
+        output += "\nCommands: water, water stats [meter], water watch [pulse|sec|off] [meter], edges [meter], "
+                  "reset_daily [meter], reset_yearly [meter]\n";
+        return output;
+    });
+    
+#if WATER_METER_EDGE_STATS
+    domotics->registerCommand("edges", [](const String& args) {
+        WaterMeterComponent* meter = meterFromArgs(args);
+        if (!meter) return String("ERROR: Unknown meter (use index or name)\n");
+        const EdgeStats& stats = meter->getEdgeStats();
+        WaterMeterConfig cfg = meter->getConfig();
+        
+        String output = "=== Edge Timing " + meter->metadata.name + " (" + String((unsigned long)stats.accepted) +
+                        " pulses since boot) ===\n";
+        output += "    from      fall     pulse       low      high\n";
+        char row[64];
+        for (uint8_t b = 0; b < EdgeHistogram::BINS; b++) {
+            uint32_t fall = stats.fallInterval.bins[b], pulse = stats.pulseInterval.bins[b];
+            uint32_t low = stats.lowTime.bins[b], high = stats.highTime.bins[b];
+            if (!fall && !pulse && !low && !high) continue;
+            snprintf(row, sizeof(row), "%8s %9lu %9lu %9lu %9lu\n", formatEdgeTime(EdgeHistogram::binLowerUs(b)).c_str(),
+                     (unsigned long)fall, (unsigned long)pulse, (unsigned long)low, (unsigned long)high);
+            output += row;
+        }
+        
+        DebounceTuner::Result tuner = meter->evaluateDebounce();
+        output += "Current: debounce " + String(cfg.pulseDebounceMs) + " ms, high stable " + String(cfg.pulseHighStableMs) +
+                  " ms (max " + String(cfg.litersPerPulse * 60000.0f / (cfg.pulseDebounceMs ? cfg.pulseDebounceMs : 1), 1) +
+                  " L/min), auto-tune " + String(cfg.autoTuneDebounce ? "on" : "off") + "\n";
+        output += formatTunerSplit("Tuner:   debounce", tuner.debounce);
+        output += formatTunerSplit("         high stable", tuner.stable);
+        output += "(fall = falling-to-falling, pulse = since last pulse for stable edges, low/high = level durations)\n";
         return output;
     });
+#endif
     
     domotics->registerCommand("reset_daily", [](const String& args) {
-        if (!waterMeter) return String("ERROR: WaterMeter not initialized\n");
-        waterMeter->resetDaily();
-        return String("Daily counter reset to 0\n");
+        WaterMeterComponent* meter = meterFromArgs(args);
+        if (!meter) return String("ERROR: Unknown meter (use index or name)\n");
+        meter->resetDaily();
+        return String("Daily counter reset to 0 (") + meter->metadata.name + ")\n";
     });
     
     domotics->registerCommand("reset_yearly", [](const String& args) {
-        if (!waterMeter) return String("ERROR: WaterMeter not initialized\n");
-        waterMeter->resetYearly();
-        return String("Yearly counter reset to 0\n");
+        WaterMeterComponent* meter = meterFromArgs(args);
+        if (!meter) return String("ERROR: Unknown meter (use index or name)\n");
+        meter->resetYearly();
+        return String("Yearly counter reset to 0 (") + meter->metadata.name + ")\n";
     });
 }
 
-// Non-blocking timer for MQTT publishing
-Utils::NonBlockingDelay mqttPublishTimer(60000);  // 60 seconds (water consumption changes slowly)
+/**
+ * @brief Backlog service + change-driven HA state publishing (once per loop)
+ */
+static void publishHaStates() {
+    // ========================================================================
+    // MQTT STATE PUBLISHING (to Home Assistant)
+    // ========================================================================
+    // One document with every value, sent when any of them changed beyond its
+    // threshold (or its heartbeat expired); cadence is fast while any meter
+    // flows, slow when idle.
+    bool online = haPtr && haPtr->isMQTTConnected();
+    serviceBacklog(online);
+    if (!online) return;
+    
+    bool flowing = false;
+    for (uint8_t i = 0; i < METER_COUNT; i++) {
+        flowing = flowing || meters[i]->getData().flowRateLpm > 0.0f;
+    }
+    if (!haPolicy.tick(millis(), flowing)) return;
+    
+    if (haDiscoveryPending) haDiscoveryPending = !publishHaDiscovery();
+    collectHaValues();
+    publishHaState();
+}
 
 void loop() {
+    uint32_t loopStartUs = micros();
+    
     // DomoticsCore System handles everything
-    // WaterMeter component loop is called automatically
+    // WaterMeter component loops are called automatically
     domotics->loop();
     
+#if WATER_METER_PULSE_LOG
+    pulseLog.service(millis());
+#endif
+    
+    // `water watch` stream: bounded per loop, a slow client only loses lines
+    if (watchSessionClosed) {
+        watchSessionClosed = false;
+        if (watch.active()) {
+            watch.stop();
+            DLOG_I(LOG_WATCH, "Watch session closed, stream stopped");
+        }
+    }
+    if (watch.active()) {
+        if (watchTick.isReady()) {
+            watchSecondTick();
+        }
+        watch.drain(watchToSession);
+    }
+    
     // ========================================================================
     // PUBLISH INITIAL STATE (once HA is ready)
     // ========================================================================
-    if (!initialStatePublished && haPtr && haPtr->isReady() && waterMeter) {
-        WaterMeterData data = waterMeter->getData();
-        
-        // Publish all water meter values (cast double to float for publishState)
-        haPtr->publishState("total_volume", (float)data.totalM3);
-        haPtr->publishState("total_liters", (float)data.pulseCount);  // 1 pulse = 1 liter
-        haPtr->publishState("daily_volume", (float)data.dailyM3);
-        haPtr->publishState("daily_liters", (float)data.dailyLiters);
-        haPtr->publishState("yearly_volume", (float)data.yearlyM3);
-        haPtr->publishState("yearly_liters", (float)data.yearlyLiters);
-        haPtr->publishState("pulse_count", (float)data.pulseCount);
-        
+    if (!initialStatePublished && haPtr && haPtr->isReady()) {
+        haPolicy.invalidate();  // Next policy tick sends every sensor
         initialStatePublished = true;
-        DLOG_I(LOG_APP, "✓ Published initial water meter state to Home Assistant");
+        DLOG_I(LOG_APP, "✓ Home Assistant ready, publishing initial water meter state");
     }
     
-    // ========================================================================
-    // MQTT STATE PUBLISHING (to Home Assistant)
-    // ========================================================================
-    if (mqttPublishTimer.isReady() && haPtr && haPtr->isMQTTConnected() && waterMeter) {
-        WaterMeterData data = waterMeter->getData();
-        
-        // Publish water meter data (cast double to float)
-        haPtr->publishState("total_volume", (float)data.totalM3);
-        haPtr->publishState("total_liters", (float)data.pulseCount);
-        haPtr->publishState("daily_volume", (float)data.dailyM3);
-        haPtr->publishState("daily_liters", (float)data.dailyLiters);
-        haPtr->publishState("yearly_volume", (float)data.yearlyM3);
-        haPtr->publishState("yearly_liters", (float)data.yearlyLiters);
-        haPtr->publishState("pulse_count", (float)data.pulseCount);
-        
-        // System metrics
-        haPtr->publishState("uptime", (float)(millis() / 1000));
-        
-        // WiFi signal if connected
-        auto* wifiComp = domotics->getWiFi();
-        if (wifiComp && wifiComp->isSTAConnected()) {
-            int32_t rssi = wifiComp->getRSSI();
-            haPtr->publishState("wifi_signal", (float)rssi);
-        }
-        
-        DLOG_D(LOG_APP, "📡 Published to HA: Total=%.3f m³, Daily=%.3f m³, Yearly=%.3f m³",
-               data.totalM3, data.dailyM3, data.yearlyM3);
-    }
+    publishHaStates();
+    
+    loopTiming.record(micros() - loopStartUs);
 }